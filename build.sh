@@ -23,7 +23,18 @@ if [ ! -f build/RGFW.o ]; then
 fi
 
 /usr/bin/c99 ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} -c src/uir.c -o build/uir.o
-/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/bench.c build/uir.o ${LINK_FLAGS} -o build/bench
-/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/test.c build/uir.o ${LINK_FLAGS} -o build/test
-/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/text.c build/stb_truetype.o build/uir.o ${LINK_FLAGS} -o build/text
-/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/ui.c build/stb_truetype.o build/uir.o build/RGFW.o ${LINK_FLAGS} -lX11 -lXrandr -o build/ui
+/usr/bin/c99 ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} -c src/uir_thread.c -o build/uir_thread.o
+/usr/bin/c99 ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} -c src/uir_glyph.c -o build/uir_glyph.o
+/usr/bin/c99 ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} -c src/uir_trace.c -o build/uir_trace.o
+/usr/bin/c99 ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} -c src/uir_record.c -o build/uir_record.o
+/usr/bin/c99 ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} -c src/uir_tiled.c -o build/uir_tiled.o
+/usr/bin/c99 ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} -DUIR_FIXED_POINT -c src/uir.c -o build/uir_fixed.o
+/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/bench.c build/uir.o build/uir_thread.o build/uir_trace.o ${LINK_FLAGS} -lpthread -o build/bench
+/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/test.c build/stb_truetype.o build/uir.o build/uir_thread.o build/uir_trace.o build/uir_record.o build/uir_tiled.o build/uir_glyph.o ${LINK_FLAGS} -lpthread -o build/test
+/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/diff.c build/uir.o build/uir_thread.o ${LINK_FLAGS} -lpthread -o build/diff
+/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} -DUIR_FIXED_POINT examples/diff.c build/uir_fixed.o build/uir_thread.o ${LINK_FLAGS} -lpthread -o build/diff_fixed
+/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/bench_fixed.c build/uir_fixed.o ${LINK_FLAGS} -o build/bench_fixed
+/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/replay.c build/uir.o build/uir_record.o ${LINK_FLAGS} -o build/replay
+/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/tiled.c build/uir.o build/uir_tiled.o ${LINK_FLAGS} -o build/tiled
+/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/text.c build/stb_truetype.o build/uir.o build/uir_glyph.o ${LINK_FLAGS} -o build/text
+/usr/bin/gcc ${WARN_FLAGS} ${PATH_FLAGS} ${BASE_FLAGS} examples/ui.c build/stb_truetype.o build/uir.o build/uir_glyph.o build/RGFW.o ${LINK_FLAGS} -lX11 -lXrandr -o build/ui
@@ -2,18 +2,55 @@
 #include <time.h>
 #include <unistd.h>
 #include <string.h>
+#include <math.h>
 
 #include "../src/uir.h"
+#include "../src/uir_thread.h"
+#include "../src/uir_trace.h"
 
 #define W 1280
 #define H 720
 
 unsigned char memory[2000*2000*4];
 unsigned char image[W*H*4];
+unsigned char scratch[1 << 20];
+unsigned char thumbnail_memory[(W/16) * (H/16) * 80];
+unsigned char quarter[(W/4) * (H/4) * 4];
+unsigned char compressed_memory[(W/16) * (H/16) * (4 + 1 + sizeof(UIR_Tile))];
 
 uint8_t glyph[10*30];
 uint8_t glyph_rgba[24*24*4];
 
+UIR_DrawCmd async_drawcmds[UIR_RENDER_THREAD_FRAMES * 16];
+
+#define WIDGETS 50
+#define WIDGET_CMDS 20
+UIR_DrawCmd widget_drawcmds[WIDGETS * (WIDGET_CMDS + 1)];
+
+#define PANELS 64
+#define PANEL_W 320
+#define PANEL_H 240
+unsigned char panel_memory[PANELS][(PANEL_W/16 + 1) * (PANEL_H/16 + 1) * 1100];
+
+#define SCATTER 50000
+UIR_DrawCmd scatter_drawcmds[SCATTER];
+unsigned char stream_memory[SCATTER * (sizeof(UIR_DrawCmd) + 5 * sizeof(float)) + 4096];
+
+// one pixel longer, so alternate frames can start one pixel in and hash as new content
+uint8_t video_bgra[W*H*4 + 4];
+uint8_t video_rgba[W*H*4 + 4];
+
+UIR_Point chart[2000];
+UIR_DrawCmd chart_drawcmds[] = {
+    { .path = {
+        .type = UIR_DRAW_PATH_STROKE,
+        .colour = {0, 0, 0, 255},
+        .stroke_width = 1.5f,
+        .points = chart,
+        .point_count = sizeof(chart)/sizeof(chart[0]),
+    }},
+};
+
 UIR_DrawCmd drawcmds[] = {
     { .shape = {
         .type = UIR_DRAW_SHAPE_RECT,
@@ -49,9 +86,12 @@ UIR_DrawCmd drawcmds[] = {
         .data = glyph_rgba,
         .data_stride = 24*4,
         .scale = 1,
+        .flags = UIR_IMAGE_OPAQUE,
     }},
 };
 
+UIR_DrawCmd panel_drawcmds[PANELS][sizeof(drawcmds)/sizeof(drawcmds[0])];
+
 typedef struct timespec TimeSpec;
 typedef struct {
     TimeSpec start;
@@ -77,6 +117,26 @@ Timer timer_start(void) {
     return t;
 }
 
+uint64_t bench_now(void *user_data) {
+    (void)user_data;
+    TimeSpec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+
+// The i-th of the scattered shapes, from a running seed.
+static UIR_DrawCmd scatter_cmd(uint32_t i, uint32_t *seed) {
+    *seed = *seed * 1664525u + 1013904223u;
+    float x = (float)(*seed >> 8 & 0x7ff) * (float)(W - 8) / 2048.f;
+    *seed = *seed * 1664525u + 1013904223u;
+    float y = (float)(*seed >> 8 & 0x7ff) * (float)(H - 8) / 2048.f;
+    return (UIR_DrawCmd) { .shape = {
+        .type = i % 3 ? UIR_DRAW_SHAPE_RECT : UIR_DRAW_SHAPE_CIRCLE,
+        .fill_colour = {(uint8_t)(*seed >> 24), 80, 160, 255},
+        .rect = { x, y, x + 6, y + 6 },
+    }};
+}
+
 int main(void) {
     // write 'T' shape to glyph
     for (uint32_t x = 0; x < 10; ++x) glyph[x] = 255;
@@ -93,6 +153,12 @@ int main(void) {
             glyph_rgba[i + 3] = 255;
         }
     }
+
+    // write line chart
+    for (uint32_t i = 0; i < sizeof(chart)/sizeof(chart[0]); ++i) {
+        chart[i].x = 20.f + (float)i * 0.6f;
+        chart[i].y = 360.f + sinf((float)i * 0.05f) * 200.f + sinf((float)i * 0.7f) * 20.f;
+    }
     
     {
         double sum = 0;
@@ -116,6 +182,40 @@ int main(void) {
         }
         printf("full draw: %fus\n", sum / count);
     }
+
+    {
+        // grayscale and monochrome panels, and writing out their pixels
+        const char *names[] = { "rgba", "l8", "mono" };
+        for (uint32_t format = UIR_TILE_FORMAT_RGBA; format <= UIR_TILE_FORMAT_MONO; ++format) {
+            double draw_sum = 0;
+            double write_sum = 0;
+            double count = 0;
+            size_t size = UIR_packed_memory_size(W, H, format);
+
+            for (uint32_t i = 0; i < 16; ++i) {
+                memset(memory, 0, size);
+                UIR *uir = UIR_new_packed(W, H, format, memory, size);
+                if (!uir || uir->error_flags) {
+                    printf("err\n");
+                    exit(1);
+                }
+                uir->clear_colour = (RGBA) { 255, 100, 100, 255 };
+
+                Timer t = timer_start();
+                UIR_draw(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]));
+                draw_sum += timer_elapsed_us(&t);
+
+                t = timer_start();
+                if (format == UIR_TILE_FORMAT_MONO)
+                    UIR_write_buffer_mono(uir, image, W/8);
+                else
+                    UIR_write_buffer_l8(uir, image, W);
+                write_sum += timer_elapsed_us(&t);
+                count += 1;
+            }
+            printf("%s panel full draw: %fus, write: %fus, %zu bytes\n", names[format], draw_sum / count, write_sum / count, size);
+        }
+    }
     
     {
         memset(memory, 0, sizeof(memory));
@@ -160,6 +260,45 @@ int main(void) {
         }
         printf("small draw: %fus\n", sum / count);
     }
+
+    {
+        // quarter size previews after a small draw: updating a thumbnail, against downscaling the frame
+        memset(memory, 0, sizeof(memory));
+        UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+        UIR_draw(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]));
+        UIR_Thumbnail thumbnail;
+        UIR_thumbnail_init(&thumbnail, uir, thumbnail_memory, sizeof(thumbnail_memory));
+
+        double update_sum = 0;
+        double downscale_sum = 0;
+        double count = 0;
+        uint32_t filtered = 0;
+
+        for (uint32_t i = 0; i < 256; ++i) {
+            drawcmds[4].image.rect.x0 += 1;
+            drawcmds[4].image.rect.x1 += 1;
+            UIR_draw(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]));
+
+            Timer t = timer_start();
+            filtered += UIR_thumbnail_update(&thumbnail, uir);
+            update_sum += timer_elapsed_us(&t);
+
+            t = timer_start();
+            UIR_write_buffer_rgba(uir, image, W*4);
+            for (uint32_t y = 0; y < H/4; ++y) {
+                for (uint32_t x = 0; x < W/4*4; ++x) {
+                    uint32_t sum = 0;
+                    for (uint32_t sy = 0; sy < 4; ++sy)
+                        for (uint32_t sx = 0; sx < 4; ++sx)
+                            sum += image[(y*4 + sy)*W*4 + (x/4*4 + sx)*4 + x%4];
+                    quarter[y*W + x] = (uint8_t)((sum + 8) / 16);
+                }
+            }
+            downscale_sum += timer_elapsed_us(&t);
+            count += 1;
+        }
+        printf("thumbnail update: %fus, %f tiles, full downscale: %fus\n", update_sum / count, filtered / count, downscale_sum / count);
+    }
     
     {
         memset(memory, 0, sizeof(memory));
@@ -179,4 +318,417 @@ int main(void) {
         }
         printf("no draw: %fus\n", sum / count);
     }
+    
+    {
+        double sum = 0;
+        double count = 0;
+    
+        for (uint32_t i = 0; i < 64; ++i) {
+            memset(memory, 0, sizeof(memory));
+            UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+            uir->clear_colour = (RGBA) { 255, 255, 255, 255 };
+            uir->scratch = scratch;
+            uir->scratch_size = sizeof(scratch);
+        
+            Timer t = timer_start();
+            UIR_draw(uir, chart_drawcmds, sizeof(chart_drawcmds)/sizeof(chart_drawcmds[0]));
+            double elapsed = timer_elapsed_us(&t);
+            sum += elapsed;
+            count += 1; 
+        }
+        printf("chart draw: %fus\n", sum / count);
+    }
+    
+    {
+        memset(memory, 0, sizeof(memory));
+        UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+        UIR_RenderThread rt = { 0 };
+        if (!UIR_render_thread_start(&rt, uir, async_drawcmds, 16)) {
+            printf("err\n");
+            exit(1);
+        }
+
+        double sum = 0;
+        double count = 0;
+        uint64_t frame_id = 0;
+        
+        for (uint32_t i = 0; i < 256; ++i) {
+            drawcmds[0].shape.rect.x0 += 1;
+            drawcmds[0].shape.rect.x1 += 1;
+
+            UIR_DrawCmd *cmds = UIR_render_thread_commands(&rt);
+            memcpy(cmds, drawcmds, sizeof(drawcmds));
+
+            Timer t = timer_start();
+            frame_id = UIR_render_thread_publish(&rt, sizeof(drawcmds)/sizeof(drawcmds[0]));
+            double elapsed = timer_elapsed_us(&t);
+            sum += elapsed;
+            count += 1; 
+
+            usleep(500);
+        }
+
+        UIR_render_thread_wait(&rt, frame_id, NULL);
+        UIR_render_thread_stop(&rt);
+        printf("async publish: %fus\n", sum / count);
+    }
+
+    {
+        // 50 widgets of 20 commands each, first as flat commands, then as groups
+        for (uint32_t grouped = 0; grouped < 2; ++grouped) {
+            uint32_t n = 0;
+            for (uint32_t w = 0; w < WIDGETS; ++w) {
+                float x = (float)(w % 10) * 128.f;
+                float y = (float)(w / 10) * 144.f;
+                if (grouped) {
+                    widget_drawcmds[n++] = (UIR_DrawCmd) { .group = {
+                        .type = UIR_DRAW_GROUP,
+                        .cmd_count = WIDGET_CMDS,
+                    }};
+                }
+                for (uint32_t c = 0; c < WIDGET_CMDS; ++c) {
+                    widget_drawcmds[n++] = (UIR_DrawCmd) { .shape = {
+                        .type = UIR_DRAW_SHAPE_RECT,
+                        .fill_colour = {(uint8_t)(c * 12), 100, 200, 255},
+                        .rect = { x + 4, y + 4 + (float)c * 6.5f, x + 124, y + 10 + (float)c * 6.5f },
+                        .corner_radius = 2,
+                    }};
+                }
+            }
+
+            memset(memory, 0, sizeof(memory));
+            UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+            UIR_draw(uir, widget_drawcmds, n);
+
+            double sum = 0;
+            double count = 0;
+
+            for (uint32_t i = 0; i < 256; ++i) {
+                Timer t = timer_start();
+                UIR_draw(uir, widget_drawcmds, n);
+                double elapsed = timer_elapsed_us(&t);
+                sum += elapsed;
+                count += 1;
+            }
+            printf("%s no draw: %fus\n", grouped ? "grouped widgets" : "widgets", sum / count);
+        }
+    }
+
+    {
+        // idle panels: compressing every tile, then decompressing them all, as a full write after waking would
+        const char *names[] = { "scene", "widgets" };
+        for (uint32_t scene = 0; scene < 2; ++scene) {
+            size_t panel_size = UIR_minimum_memory_size(W, H);
+            memset(memory, 0, panel_size);
+            UIR *uir = UIR_new(W, H, memory, panel_size);
+            uir->clear_colour = (RGBA) { 255, 100, 100, 255 };
+            if (scene == 0)
+                UIR_draw(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]));
+            else
+                UIR_draw(uir, widget_drawcmds, WIDGETS * (WIDGET_CMDS + 1));
+
+            double compress_sum = 0;
+            double decompress_sum = 0;
+            double count = 0;
+            size_t size = 0;
+
+            for (uint32_t i = 0; i < 16; ++i) {
+                Timer t = timer_start();
+                size = UIR_compressed_size(uir);
+                if (!UIR_compress_tiles(uir, compressed_memory, size)) {
+                    printf("err\n");
+                    exit(1);
+                }
+                compress_sum += timer_elapsed_us(&t);
+
+                t = timer_start();
+                UIR_decompress_tiles(uir);
+                decompress_sum += timer_elapsed_us(&t);
+                count += 1;
+            }
+            printf("%s idle compress: %fus, %zu of %zu bytes, decompress: %fns per tile\n",
+                names[scene], compress_sum / count, size, uir->tile_count * sizeof(UIR_Tile),
+                decompress_sum * 1000.0 / count / uir->tile_count
+            );
+        }
+    }
+
+    {
+        // 64 small panels redrawn in full, one after another, then as a batch on 4 workers
+        UIR_WorkerPool pool;
+        if (!UIR_worker_pool_start(&pool, 4)) {
+            printf("err\n");
+            exit(1);
+        }
+
+        UIR_BatchPanel panels[PANELS];
+        for (uint32_t batched = 0; batched < 2; ++batched) {
+            double sum = 0;
+            double count = 0;
+
+            for (uint32_t i = 0; i < 16; ++i) {
+                for (uint32_t p = 0; p < PANELS; ++p) {
+                    memset(panel_memory[p], 0, sizeof(panel_memory[p]));
+                    memcpy(panel_drawcmds[p], drawcmds, sizeof(drawcmds));
+                    panels[p] = (UIR_BatchPanel) {
+                        .uir = UIR_new(PANEL_W, PANEL_H, panel_memory[p], sizeof(panel_memory[p])),
+                        .cmds = panel_drawcmds[p],
+                        .cmd_count = sizeof(drawcmds)/sizeof(drawcmds[0]),
+                    };
+                    if (!panels[p].uir || panels[p].uir->error_flags) {
+                        printf("err\n");
+                        exit(1);
+                    }
+                }
+
+                Timer t = timer_start();
+                if (batched) {
+                    UIR_draw_batch(&pool, panels, PANELS);
+                } else {
+                    for (uint32_t p = 0; p < PANELS; ++p)
+                        UIR_draw(panels[p].uir, panels[p].cmds, panels[p].cmd_count);
+                }
+                sum += timer_elapsed_us(&t);
+                count += 1;
+            }
+            printf("%s: %fus\n", batched ? "panels batch draw" : "panels draw", sum / count);
+        }
+
+        UIR_worker_pool_stop(&pool);
+    }
+
+    {
+        // 50k small shapes, as an array and as a stream
+        uint32_t seed = 1;
+        for (uint32_t i = 0; i < SCATTER; ++i)
+            scatter_drawcmds[i] = scatter_cmd(i, &seed);
+
+        UIR_CmdStream *stream = UIR_cmd_stream_new(SCATTER, SCATTER * sizeof(UIR_DrawCmd), stream_memory, sizeof(stream_memory));
+        if (!stream) {
+            printf("err\n");
+            exit(1);
+        }
+        UIR_cmd_stream_push_array(stream, scatter_drawcmds, SCATTER);
+
+        for (uint32_t streamed = 0; streamed < 2; ++streamed) {
+            double full_sum = 0;
+            double move_sum = 0;
+            double count = 0;
+
+            for (uint32_t i = 0; i < 8; ++i) {
+                memset(memory, 0, sizeof(memory));
+                UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+
+                Timer t = timer_start();
+                if (streamed)
+                    UIR_draw_stream(uir, stream);
+                else
+                    UIR_draw(uir, scatter_drawcmds, SCATTER);
+                full_sum += timer_elapsed_us(&t);
+
+                // move one shape, redrawing a few tiles
+                float dx = i % 2 ? -16.f : 16.f;
+                scatter_drawcmds[0].shape.rect.x0 += dx;
+                scatter_drawcmds[0].shape.rect.x1 += dx;
+                if (streamed) {
+                    UIR_cmd_stream_clear(stream);
+                    UIR_cmd_stream_push_array(stream, scatter_drawcmds, SCATTER);
+                }
+
+                t = timer_start();
+                if (streamed)
+                    UIR_draw_stream(uir, stream);
+                else
+                    UIR_draw(uir, scatter_drawcmds, SCATTER);
+                move_sum += timer_elapsed_us(&t);
+                count += 1;
+            }
+            printf("%s full draw: %fus\n", streamed ? "scatter stream" : "scatter", full_sum / count);
+            printf("%s small draw: %fus\n", streamed ? "scatter stream" : "scatter", move_sum / count);
+        }
+        printf("scatter stream payload: %u bytes, array: %zu bytes\n", stream->offsets[stream->count], sizeof(scatter_drawcmds));
+    }
+
+    {
+        // laying out the 50k shapes every frame, then drawing them with nothing changed,
+        // so the frame is the layout, the prepass and the hash
+        for (uint32_t built = 0; built < 2; ++built) {
+            memset(memory, 0, sizeof(memory));
+            UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+
+            double sum = 0;
+            double count = 0;
+            for (uint32_t i = 0; i < 9; ++i) {
+                Timer t = timer_start();
+                uint32_t seed = 1;
+                if (built) {
+                    UIR_Builder builder;
+                    UIR_builder_begin(&builder, uir, scatter_drawcmds, SCATTER);
+                    for (uint32_t j = 0; j < SCATTER; ++j) {
+                        UIR_DrawCmd cmd = scatter_cmd(j, &seed);
+                        UIR_builder_push(&builder, &cmd);
+                    }
+                    UIR_builder_draw(&builder);
+                } else {
+                    for (uint32_t j = 0; j < SCATTER; ++j)
+                        scatter_drawcmds[j] = scatter_cmd(j, &seed);
+                    UIR_draw(uir, scatter_drawcmds, SCATTER);
+                }
+                double elapsed = timer_elapsed_us(&t);
+
+                // the first frame draws every tile
+                if (i) {
+                    sum += elapsed;
+                    count += 1;
+                }
+            }
+            printf("%s: %fus\n", built ? "scatter layout builder" : "scatter layout array", sum / count);
+        }
+    }
+
+    {
+        // large rings and rounded panels, whose bounding boxes are mostly empty or solid
+        UIR_DrawCmd ring_drawcmds[8];
+        for (uint32_t i = 0; i < 8; ++i) {
+            float x = (float)(i % 4) * 320.f;
+            float y = (float)(i / 4) * 360.f;
+            ring_drawcmds[i] = (UIR_DrawCmd) { .shape = {
+                .type = i % 2 ? UIR_DRAW_SHAPE_CIRCLE : UIR_DRAW_SHAPE_RECT,
+                .fill_colour = i < 4 ? (RGBA) {0} : (RGBA) {40, 60, 80, 255},
+                .outline_colour = {200, 200, 255, 255},
+                .outline_radius = 3,
+                .corner_radius = 60,
+                .rect = { x + 8, y + 8, x + 312, y + 352 },
+            }};
+        }
+
+        double sum = 0;
+        double count = 0;
+        for (uint32_t i = 0; i < 64; ++i) {
+            memset(memory, 0, sizeof(memory));
+            UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+
+            Timer t = timer_start();
+            UIR_draw(uir, ring_drawcmds, 8);
+            sum += timer_elapsed_us(&t);
+            count += 1;
+        }
+        printf("rings full draw: %fus\n", sum / count);
+    }
+
+    {
+        // a theme switch redrawing every tile, in one frame, then spread over frames of at most 2ms
+        for (uint32_t progressive = 0; progressive < 2; ++progressive) {
+            memset(memory, 0, sizeof(memory));
+            UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+            uir->scratch = scratch;
+            uir->scratch_size = sizeof(scratch);
+            UIR_draw(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]));
+
+            double sum = 0;
+            double worst = 0;
+            double frames = 0;
+            double count = 0;
+
+            for (uint32_t i = 0; i < 16; ++i) {
+                uir->clear_colour.r ^= 0x40;
+                uint32_t remaining = 1;
+                while (remaining) {
+                    Timer t = timer_start();
+                    if (progressive) {
+                        UIR_DrawBudget budget = {
+                            .now = bench_now,
+                            .deadline = bench_now(NULL) + 2000000,
+                            .focus = { W/2, H/2, W/2, H/2 },
+                        };
+                        UIR_draw_progressive(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]), &budget, &remaining);
+                    } else {
+                        UIR_draw(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]));
+                        remaining = 0;
+                    }
+                    double elapsed = timer_elapsed_us(&t);
+                    sum += elapsed;
+                    worst = elapsed > worst ? elapsed : worst;
+                    frames += 1;
+                }
+                count += 1;
+            }
+            printf("%s: %fus total, %f frames, worst frame %fus\n",
+                progressive ? "theme switch progressive" : "theme switch", sum / count, frames / count, worst);
+        }
+    }
+
+    {
+        // a BGRA video frame each frame, sampled directly, then converted to RGBA first
+        for (uint32_t i = 0; i < sizeof(video_bgra); ++i)
+            video_bgra[i] = i % 4 == 3 ? 255 : (uint8_t)(i * 7);
+
+        for (uint32_t direct = 0; direct < 2; ++direct) {
+            memset(memory, 0, sizeof(memory));
+            UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+
+            double sum = 0;
+            double count = 0;
+            for (uint32_t i = 0; i < 64; ++i) {
+                uint32_t offset = (i & 1) * 4;
+                UIR_DrawCmd frame = { .image = {
+                    .type = UIR_DRAW_IMAGE_RGBA,
+                    .rect = { 0, 0, W, H },
+                    .data_stride = W*4,
+                    .scale = 1,
+                    .flags = UIR_IMAGE_OPAQUE,
+                }};
+
+                Timer t = timer_start();
+                if (direct) {
+                    frame.image.data = &video_bgra[offset];
+                    frame.image.format = UIR_IMAGE_FORMAT_BGRA;
+                } else {
+                    for (uint32_t p = offset; p < sizeof(video_bgra); p += 4) {
+                        video_rgba[p + 0] = video_bgra[p + 2];
+                        video_rgba[p + 1] = video_bgra[p + 1];
+                        video_rgba[p + 2] = video_bgra[p + 0];
+                        video_rgba[p + 3] = video_bgra[p + 3];
+                    }
+                    frame.image.data = &video_rgba[offset];
+                }
+                UIR_draw(uir, &frame, 1);
+                sum += timer_elapsed_us(&t);
+                count += 1;
+            }
+            printf("%s: %fus\n", direct ? "video frame bgra" : "video frame converted", sum / count);
+        }
+    }
+
+    {
+        // writes trace.json, and times the draw with tracing on
+        FILE *f = fopen("trace.json", "wb");
+        UIR_TraceFile trace_file;
+        UIR_trace_file_begin(&trace_file, f, 16);
+
+        memset(memory, 0, sizeof(memory));
+        UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+        uir->trace = &trace_file.trace;
+        uir->scratch = scratch;
+        uir->scratch_size = sizeof(scratch);
+
+        double sum = 0;
+        double count = 0;
+
+        for (uint32_t i = 0; i < 64; ++i) {
+            drawcmds[0].shape.rect.x0 += 1;
+            drawcmds[0].shape.rect.x1 += 1;
+
+            UIR_trace_file_frame(&trace_file, i);
+            Timer t = timer_start();
+            UIR_draw(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]));
+            double elapsed = timer_elapsed_us(&t);
+            sum += elapsed;
+            count += 1;
+        }
+
+        UIR_trace_file_end(&trace_file);
+        fclose(f);
+        printf("traced medium draw: %fus\n", sum / count);
+    }
 }
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <time.h>
+#include <string.h>
+
+#include "../src/uir.h"
+
+// Benchmark for small panels, such as display controllers without an FPU. Built against the
+// UIR_FIXED_POINT profile as bench_fixed. Only uses the C standard library and static memory,
+// and times with clock(), so it runs under an emulator, e.g. qemu-arm for a cross compiled build.
+
+#define W 320
+#define H 240
+#define ROWS 5
+
+unsigned char memory[(W/UIR_TILE_SIZE + 1) * (H/UIR_TILE_SIZE + 1) * 1100];
+uint8_t icon[16*16];
+
+UIR_DrawCmd drawcmds[4 + ROWS * 5];
+
+// A settings screen: a card, and rows of an icon, a label bar and a toggle switch.
+// The toggle of row `moving` is drawn with its knob offset px to the right.
+static uint32_t build_scene(uint32_t moving, float offset) {
+    uint32_t n = 0;
+    drawcmds[n++] = (UIR_DrawCmd) { .shadow = {
+        .type = UIR_DRAW_SHAPE_SHADOW,
+        .colour = {0, 0, 0, 96},
+        .shape_rect = { 12, 12, W - 12, H - 12 },
+        .corner_radius = 12,
+        .blur_radius = 4,
+    }};
+    drawcmds[n++] = (UIR_DrawCmd) { .shape = {
+        .type = UIR_DRAW_SHAPE_RECT,
+        .rect = { 12, 12, W - 12, H - 12 },
+        .fill_colour = {250, 250, 252, 255},
+        .outline_colour = {200, 200, 210, 255},
+        .outline_radius = 1,
+        .corner_radius = 12,
+    }};
+    drawcmds[n++] = (UIR_DrawCmd) { .shape = {
+        .type = UIR_DRAW_SHAPE_RECT,
+        .rect = { 12, 12, W - 12, 48 },
+        .fill_colour = {40, 90, 200, 255},
+        .corner_radius = 0,
+    }};
+    drawcmds[n++] = (UIR_DrawCmd) { .shape = {
+        .type = UIR_DRAW_SHAPE_CIRCLE,
+        .rect = { W - 44, 18, W - 20, 42 },
+        .outline_colour = {255, 255, 255, 255},
+        .outline_radius = 1.5f,
+    }};
+
+    for (uint32_t i = 0; i < ROWS; ++i) {
+        float y = 60.f + (float)i * 34.f;
+        bool on = i % 2 == 0;
+        float knob = (on ? 266.f : 248.f) + (i == moving ? offset : 0.f);
+
+        drawcmds[n++] = (UIR_DrawCmd) { .image = {
+            .type = UIR_DRAW_IMAGE_A,
+            .rect = { 24, y + 1, 48, y + 25 },
+            .tint_colour = {60, 60, 70, 255},
+            .data = icon,
+            .data_stride = 16,
+            .scale = 1.5f,
+        }};
+        drawcmds[n++] = (UIR_DrawCmd) { .shape = {
+            .type = UIR_DRAW_SHAPE_RECT,
+            .rect = { 60, y + 8, 60 + 90 + (float)(i * 17 % 60), y + 18 },
+            .fill_colour = {90, 90, 100, 255},
+            .corner_radius = 3,
+        }};
+        drawcmds[n++] = (UIR_DrawCmd) { .shape = {
+            .type = UIR_DRAW_SHAPE_RECT,
+            .rect = { 246, y + 3, 292, y + 23 },
+            .fill_colour = on ? (RGBA) {40, 160, 90, 255} : (RGBA) {190, 190, 200, 255},
+            .corner_radius = 10,
+        }};
+        drawcmds[n++] = (UIR_DrawCmd) { .shape = {
+            .type = UIR_DRAW_SHAPE_CIRCLE,
+            .rect = { knob, y + 5, knob + 16, y + 21 },
+            .fill_colour = {255, 255, 255, 255},
+            .outline_colour = {0, 0, 0, 40},
+            .outline_radius = 1,
+        }};
+        drawcmds[n++] = (UIR_DrawCmd) { .shape = {
+            .type = UIR_DRAW_SHAPE_RECT,
+            .rect = { 24, y + 30, W - 24, y + 31 },
+            .fill_colour = {0, 0, 0, 24},
+        }};
+    }
+    return n;
+}
+
+static unsigned long elapsed_us(clock_t start) {
+    return (unsigned long)((uint64_t)(clock() - start) * 1000000u / CLOCKS_PER_SEC);
+}
+
+int main(void) {
+    // a ring icon with soft edges
+    for (int32_t y = 0; y < 16; ++y) {
+        for (int32_t x = 0; x < 16; ++x) {
+            int32_t d = (2*x - 15) * (2*x - 15) + (2*y - 15) * (2*y - 15);
+            icon[y*16 + x] = d < 100 ? 0 : d < 140 ? (uint8_t)((d - 100) * 6) : d < 196 ? 255 : d < 225 ? (uint8_t)((225 - d) * 8) : 0;
+        }
+    }
+
+    UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+    if (!uir || uir->error_flags) {
+        printf("err\n");
+        return 1;
+    }
+    uir->clear_colour = (RGBA) { 230, 232, 240, 255 };
+
+    {
+        // every tile, as after a theme change or wake from sleep
+        uint32_t count = 16;
+        clock_t start = clock();
+        for (uint32_t i = 0; i < count; ++i) {
+            uir->clear_colour.r ^= 1;
+            UIR_draw(uir, drawcmds, build_scene(ROWS, 0.f));
+        }
+        printf("full draw: %luus\n", elapsed_us(start) / count);
+    }
+
+    {
+        // a toggle knob sliding across, a sub-pixel step per frame
+        uint32_t count = 64;
+        uint32_t redrawn = 0;
+        clock_t start = clock();
+        for (uint32_t i = 0; i < count; ++i)
+            redrawn += UIR_draw(uir, drawcmds, build_scene(1, (float)i * 0.25f));
+        printf("toggle animation: %luus, %lu tiles redrawn per frame\n", elapsed_us(start) / count, (unsigned long)(redrawn / count));
+    }
+
+    {
+        uint32_t count = 64;
+        clock_t start = clock();
+        for (uint32_t i = 0; i < count; ++i)
+            UIR_draw(uir, drawcmds, build_scene(1, 16.f));
+        printf("no draw: %luus\n", elapsed_us(start) / count);
+    }
+    return 0;
+}
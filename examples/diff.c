@@ -0,0 +1,602 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../src/uir.h"
+#include "../src/uir_thread.h"
+
+// Differential test: renders random scenes with UIR_DEBUG_REFERENCE, then with every optimized
+// configuration, and reports how far each strays from the reference.
+//
+// usage: diff [scene_count] [seed]
+
+#define W 320
+#define H 240
+#define MAX_CMDS 48
+#define MAX_POINTS 1024
+#define GROUP_SIZE 8
+
+unsigned char memory_reference[4 << 20];
+unsigned char memory_test[4 << 20];
+unsigned char memory_virtual[4 << 20];
+unsigned char scratch[1 << 18];
+
+unsigned char image_reference[W*H*4];
+unsigned char image_test[W*H*4];
+
+uint8_t source_a[64*64];
+uint8_t source_rgba[64*64*4];
+uint8_t source_opaque[64*64*4];
+uint8_t source_straight[64*64*4];
+uint8_t source_rgb[64*64*3];
+RGBA palette[256];
+
+UIR_DrawCmd scene[MAX_CMDS];
+UIR_DrawCmd scene_prev[MAX_CMDS];
+UIR_DrawCmd cmds[MAX_CMDS];
+UIR_DrawCmd grouped[MAX_CMDS + MAX_CMDS/GROUP_SIZE + 1];
+UIR_DrawCmd thread_cmds[UIR_RENDER_THREAD_FRAMES * MAX_CMDS];
+unsigned char memory_batch[4 << 20];
+UIR_DrawCmd batch_cmds[MAX_CMDS];
+UIR_WorkerPool pool;
+unsigned char stream_memory[MAX_CMDS * (sizeof(UIR_DrawCmd) + 32) + 256];
+UIR_Point points[2][MAX_POINTS];
+uint8_t verbs[2][MAX_POINTS];
+
+// ------------------------------
+// Random scenes
+
+static uint64_t rng_state;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32);
+}
+
+static uint32_t rng_below(uint32_t n) { return rng() % n; }
+static bool rng_chance(uint32_t percent) { return rng_below(100) < percent; }
+static float rng_float(float min, float max) { return min + (max - min) * (float)rng_below(1 << 16) / (float)(1 << 16); }
+
+// Integer coordinates hit the fast paths, fractional ones the general paths.
+static float rng_coord(float min, float max) {
+    float f = rng_float(min, max);
+    return rng_chance(50) ? (float)(int32_t)f : f;
+}
+
+// Premultiplied, like every colour UIR blends.
+static RGBA rng_colour(void) {
+    uint32_t a = rng_chance(50) ? 255 : rng_below(256);
+    return (RGBA) {
+        (uint8_t)(rng_below(256) * a / 255),
+        (uint8_t)(rng_below(256) * a / 255),
+        (uint8_t)(rng_below(256) * a / 255),
+        (uint8_t)a,
+    };
+}
+
+static UIR_Rect rng_rect(void) {
+    float x0 = rng_coord(-40, W);
+    float y0 = rng_coord(-40, H);
+    return (UIR_Rect) { x0, y0, x0 + rng_coord(1, 200), y0 + rng_coord(1, 160) };
+}
+
+static UIR_Gradient rng_gradient(UIR_Rect rect) {
+    UIR_Gradient gradient = {
+        .type = rng_chance(50) ? UIR_GRADIENT_LINEAR : UIR_GRADIENT_RADIAL,
+        .p0 = { rect.x0, rect.y0 },
+        .p1 = { rect.x1, rect.y1 },
+        .stop_count = 2 + rng_below(UIR_GRADIENT_MAX_STOPS - 1),
+    };
+    for (uint32_t i = 0; i < gradient.stop_count; ++i) {
+        gradient.stop_offsets[i] = (float)i / (float)(gradient.stop_count - 1);
+        gradient.stop_colours[i] = rng_colour();
+    }
+    return gradient;
+}
+
+static UIR_DrawCmd rng_shape(uint32_t type) {
+    UIR_Rect rect = rng_rect();
+    UIR_DrawCmd cmd = { .shape = {
+        .type = type,
+        .rect = rect,
+        .fill_colour = rng_colour(),
+        .outline_colour = rng_colour(),
+        .outline_radius = rng_chance(50) ? 0 : rng_float(0.5f, 6),
+        .corner_radius = rng_chance(50) ? 0 : rng_float(0, 30),
+    }};
+    if (rng_chance(20))
+        cmd.shape.fill_colour.a = 0;
+    else if (rng_chance(10))
+        cmd.shape.fill_colour = (RGBA) {0};
+#ifdef UIR_FIXED_POINT
+    // blends of colours that aren't premultiplied overflow, which float and fixed point wrap differently
+    if (cmd.shape.fill_colour.a == 0)
+        cmd.shape.fill_colour = (RGBA) {0};
+#endif
+    if (rng_chance(20))
+        cmd.shape.fill_gradient = rng_gradient(rect);
+    return cmd;
+}
+
+static UIR_DrawCmd rng_image(void) {
+    bool is_rgba = rng_chance(60);
+    bool opaque = is_rgba && rng_chance(50);
+    float scale = rng_chance(60) ? (float)(1 + rng_below(4)) : rng_float(0.5f, 3);
+
+    // the rect must not reach past the source pixels
+    float x0 = rng_coord(-40, W);
+    float y0 = rng_coord(-40, H);
+    float w = (float)(1 + rng_below(64 - 8)) * scale;
+    float h = (float)(1 + rng_below(64 - 8)) * scale;
+    uint32_t sx = rng_below(8);
+    uint32_t sy = rng_below(8);
+
+    UIR_DrawCmd cmd = { .image = {
+        .type = is_rgba ? UIR_DRAW_IMAGE_RGBA : UIR_DRAW_IMAGE_A,
+        .rect = { x0, y0, x0 + w, y0 + h },
+        .scale = scale,
+    }};
+    if (is_rgba) {
+        uint8_t *data = opaque ? source_opaque : source_rgba;
+        cmd.image.data = &data[(sy*64 + sx)*4];
+        cmd.image.data_stride = 64*4;
+        cmd.image.tint_colour = rng_chance(50) ? (RGBA) {0} : rng_colour();
+        cmd.image.flags = opaque ? UIR_IMAGE_OPAQUE : 0;
+
+        // premultiplied sources read as BGRA are still premultiplied
+        if (rng_chance(40)) {
+            cmd.image.format = UIR_IMAGE_FORMAT_BGRA + rng_below(5);
+            switch (cmd.image.format) {
+                case UIR_IMAGE_FORMAT_RGBA_STRAIGHT:
+                case UIR_IMAGE_FORMAT_BGRA_STRAIGHT:
+                    cmd.image.data = &source_straight[(sy*64 + sx)*4];
+                    cmd.image.flags = 0;
+                    break;
+                case UIR_IMAGE_FORMAT_RGB:
+                    cmd.image.data = &source_rgb[(sy*64 + sx)*3];
+                    cmd.image.data_stride = 64*3;
+                    break;
+                case UIR_IMAGE_FORMAT_INDEXED:
+                    cmd.image.data = &source_a[sy*64 + sx];
+                    cmd.image.data_stride = 64;
+                    cmd.image.palette = palette;
+                    cmd.image.flags = 0;
+                    break;
+                default:
+                    break;
+            }
+        }
+    } else {
+        cmd.image.data = &source_a[sy*64 + sx];
+        cmd.image.data_stride = 64;
+        cmd.image.tint_colour = rng_colour();
+    }
+    return cmd;
+}
+
+static UIR_DrawCmd rng_path(uint32_t slot) {
+    bool is_fill = rng_chance(50);
+    uint32_t point_count = 2 + rng_below(60);
+    UIR_Point *p = points[slot];
+    uint8_t *v = verbs[slot];
+
+    float cx = rng_coord(0, W);
+    float cy = rng_coord(0, H);
+    for (uint32_t i = 0; i < point_count; ++i)
+        p[i] = (UIR_Point) { cx + rng_float(-120, 120), cy + rng_float(-90, 90) };
+
+    UIR_DrawCmd cmd = { .path = {
+        .type = is_fill ? UIR_DRAW_PATH_FILL : UIR_DRAW_PATH_STROKE,
+        .colour = rng_colour(),
+        .stroke_width = rng_float(0.5f, 8),
+        .point_count = point_count,
+        .points = p,
+    }};
+
+    // sometimes use curves, consuming the points in order
+    if (rng_chance(50)) {
+        uint32_t verb_count = 0;
+        uint32_t used = 0;
+        v[verb_count++] = UIR_PATH_MOVE;
+        used++;
+        while (used < point_count) {
+            uint32_t verb = UIR_PATH_LINE + rng_below(3);
+            uint32_t need = verb == UIR_PATH_LINE ? 1 : verb == UIR_PATH_QUAD ? 2 : 3;
+            if (used + need > point_count) {
+                verb = UIR_PATH_LINE;
+                need = 1;
+            }
+            v[verb_count++] = (uint8_t)verb;
+            used += need;
+            if (rng_chance(10) && used < point_count) {
+                v[verb_count++] = rng_chance(50) ? UIR_PATH_CLOSE : UIR_PATH_MOVE;
+                used += v[verb_count - 1] == UIR_PATH_MOVE;
+            }
+        }
+        cmd.path.verbs = v;
+        cmd.path.verb_count = verb_count;
+    }
+    return cmd;
+}
+
+// Large shadows cover whole tiles, so their insides are filled without the blur kernel.
+static UIR_DrawCmd rng_shadow(bool large) {
+    UIR_Rect rect = rng_rect();
+    if (large)
+        rect = (UIR_Rect) { rng_coord(-40, W/4), rng_coord(-40, H/4), rng_coord(W*3/4, W + 40), rng_coord(H*3/4, H + 40) };
+    return (UIR_DrawCmd) { .shadow = {
+        .type = UIR_DRAW_SHAPE_SHADOW,
+        .colour = rng_colour(),
+        .shape_rect = rect,
+        .corner_radius = rng_chance(50) ? 0 : rng_float(0, 20),
+        .blur_radius = rng_float(0.5f, 16),
+    }};
+}
+
+// Paths use point slot path_slot, so two scenes can be alive at once.
+static uint32_t rng_scene(UIR_DrawCmd *out, uint32_t path_slot) {
+    uint32_t count = 1 + rng_below(MAX_CMDS);
+    bool has_path = false;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t kind = rng_below(6);
+        if (kind == 4 && has_path)
+            kind = 0;
+
+        switch (kind) {
+            case 0: out[i] = rng_shape(UIR_DRAW_SHAPE_RECT); break;
+            case 1: out[i] = rng_shape(UIR_DRAW_SHAPE_CIRCLE); break;
+            case 2:
+            case 3: out[i] = rng_image(); break;
+            case 4: out[i] = rng_path(path_slot); has_path = true; break;
+            // large shadows past the first command usually follow an edge, so the clear colour scan stops before them
+            default: out[i] = rng_shadow(i > 0 && rng_chance(25)); break;
+        }
+    }
+    return count;
+}
+
+// ------------------------------
+// Configurations
+
+typedef enum Config {
+    CONFIG_FAST,
+    CONFIG_BINNED,
+    CONFIG_INCREMENTAL,
+    CONFIG_VIRTUAL,
+    CONFIG_THREAD,
+    CONFIG_GROUPS,
+    CONFIG_STREAM,
+    CONFIG_BATCH,
+    CONFIG_PROGRESSIVE,
+    CONFIG_BUILDER,
+    CONFIG_COUNT,
+} Config;
+
+const char *config_names[CONFIG_COUNT] = {
+    "fast paths",
+    "binned paths",
+    "incremental",
+    "virtual canvas",
+    "render thread",
+    "groups",
+    "command stream",
+    "batch",
+    "progressive",
+    "builder",
+};
+
+// Binning flattens curves the same way, but accumulates coverage in a different order.
+// In the fixed point build, the reference is still drawn in float.
+#ifdef UIR_FIXED_POINT
+    #define FIXED_POINT_TOLERANCE UIR_FIXED_POINT_TOLERANCE
+#else
+    #define FIXED_POINT_TOLERANCE 0
+#endif
+const int config_tolerance[CONFIG_COUNT] = {
+    0 + FIXED_POINT_TOLERANCE,
+    1 + FIXED_POINT_TOLERANCE,
+    0 + FIXED_POINT_TOLERANCE,
+    0 + FIXED_POINT_TOLERANCE,
+    1 + FIXED_POINT_TOLERANCE,
+    1 + FIXED_POINT_TOLERANCE,
+    1 + FIXED_POINT_TOLERANCE,
+    1 + FIXED_POINT_TOLERANCE,
+    1 + FIXED_POINT_TOLERANCE,
+    1 + FIXED_POINT_TOLERANCE,
+};
+
+typedef struct Report {
+    uint32_t scenes_failed;
+    uint32_t pixels_failed;
+    int max_diff;
+    uint64_t first_failed_seed;
+} Report;
+
+Report reports[CONFIG_COUNT];
+
+static RGBA clear_colour = { 30, 30, 40, 255 };
+
+static UIR *new_uir(unsigned char *memory, size_t memory_size) {
+    memset(memory, 0, memory_size);
+    UIR *uir = UIR_new(W, H, memory, memory_size);
+    uir->clear_colour = clear_colour;
+    return uir;
+}
+
+static void render_reference(uint32_t count) {
+    UIR *uir = new_uir(memory_reference, sizeof(memory_reference));
+    uir->debug_flags = UIR_DEBUG_REFERENCE;
+    memcpy(cmds, scene, count * sizeof(UIR_DrawCmd));
+    UIR_draw(uir, cmds, count);
+    UIR_write_buffer_rgba(uir, image_reference, W*4);
+}
+
+// Copies the scene into grouped, with every chunk of GROUP_SIZE commands but every third in a group.
+// With keep_groups, the group commands from last time are left as they were.
+static uint32_t group_scene(uint32_t count, bool keep_groups) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i += GROUP_SIZE) {
+        uint32_t chunk = count - i < GROUP_SIZE ? count - i : GROUP_SIZE;
+        if (i / GROUP_SIZE % 3 != 2) {
+            if (!keep_groups) {
+                grouped[n] = (UIR_DrawCmd) { .group = {
+                    .type = UIR_DRAW_GROUP,
+                    .cmd_count = chunk,
+                }};
+            }
+            n++;
+        }
+        memcpy(&grouped[n], &scene[i], chunk * sizeof(UIR_DrawCmd));
+        n += chunk;
+    }
+    return n;
+}
+
+// Renders into image_test. The virtual canvas only fills the window it shows.
+static void render_config(Config config, uint32_t count, uint32_t prev_count) {
+    memset(image_test, 0, sizeof(image_test));
+
+    switch (config) {
+        case CONFIG_FAST:
+        case CONFIG_BINNED:
+        case CONFIG_INCREMENTAL: {
+            UIR *uir = new_uir(memory_test, sizeof(memory_test));
+            if (config == CONFIG_BINNED) {
+                uir->scratch = scratch;
+                uir->scratch_size = sizeof(scratch);
+            }
+            if (config == CONFIG_INCREMENTAL) {
+                memcpy(cmds, scene_prev, prev_count * sizeof(UIR_DrawCmd));
+                UIR_draw(uir, cmds, prev_count);
+            }
+            memcpy(cmds, scene, count * sizeof(UIR_DrawCmd));
+            UIR_draw(uir, cmds, count);
+            UIR_write_buffer_rgba(uir, image_test, W*4);
+        } break;
+
+        case CONFIG_VIRTUAL: {
+            // a viewport inset from the panel, scrolled from elsewhere to sit at (5, 3)
+            memset(memory_virtual, 0, sizeof(memory_virtual));
+            UIR *uir = UIR_new_virtual(W - 16, H - 16, memory_virtual, sizeof(memory_virtual));
+            uir->clear_colour = clear_colour;
+
+            UIR_set_viewport(uir, 37, 21);
+            memcpy(cmds, scene_prev, prev_count * sizeof(UIR_DrawCmd));
+            UIR_draw(uir, cmds, prev_count);
+
+            UIR_set_viewport(uir, 5, 3);
+            memcpy(cmds, scene, count * sizeof(UIR_DrawCmd));
+            UIR_draw(uir, cmds, count);
+            UIR_write_buffer_rgba(uir, &image_test[(3*W + 5)*4], W*4);
+        } break;
+
+        case CONFIG_THREAD: {
+            UIR *uir = new_uir(memory_test, sizeof(memory_test));
+            uir->scratch = scratch;
+            uir->scratch_size = sizeof(scratch);
+
+            UIR_RenderThread rt = { 0 };
+            if (!UIR_render_thread_start(&rt, uir, thread_cmds, MAX_CMDS)) {
+                printf("could not start render thread\n");
+                exit(1);
+            }
+            memcpy(UIR_render_thread_commands(&rt), scene_prev, prev_count * sizeof(UIR_DrawCmd));
+            UIR_render_thread_publish(&rt, prev_count);
+            memcpy(UIR_render_thread_commands(&rt), scene, count * sizeof(UIR_DrawCmd));
+            uint64_t frame_id = UIR_render_thread_publish(&rt, count);
+            UIR_render_thread_wait(&rt, frame_id, NULL);
+            UIR_render_thread_stop(&rt);
+            UIR_write_buffer_rgba(uir, image_test, W*4);
+        } break;
+
+        case CONFIG_GROUPS: {
+            // hash the groups, then draw them again with unprepared commands over the previous scene
+            UIR *uir = new_uir(memory_test, sizeof(memory_test));
+            uir->scratch = scratch;
+            uir->scratch_size = sizeof(scratch);
+
+            uint32_t n = group_scene(count, false);
+            UIR_draw(uir, grouped, n);
+            memcpy(cmds, scene_prev, prev_count * sizeof(UIR_DrawCmd));
+            UIR_draw(uir, cmds, prev_count);
+            n = group_scene(count, true);
+            UIR_draw(uir, grouped, n);
+            UIR_write_buffer_rgba(uir, image_test, W*4);
+        } break;
+
+        case CONFIG_STREAM: {
+            UIR *uir = new_uir(memory_test, sizeof(memory_test));
+            uir->scratch = scratch;
+            uir->scratch_size = sizeof(scratch);
+
+            UIR_CmdStream *stream = UIR_cmd_stream_new(MAX_CMDS, MAX_CMDS * sizeof(UIR_DrawCmd), stream_memory, sizeof(stream_memory));
+            if (!stream) {
+                printf("could not create command stream\n");
+                exit(1);
+            }
+            UIR_cmd_stream_push_array(stream, scene_prev, prev_count);
+            UIR_draw_stream(uir, stream);
+            UIR_cmd_stream_clear(stream);
+            UIR_cmd_stream_push_array(stream, scene, count);
+            UIR_draw_stream(uir, stream);
+            UIR_write_buffer_rgba(uir, image_test, W*4);
+        } break;
+
+        case CONFIG_BATCH: {
+            // next to a second panel drawing the previous scene, so tiles of both are in flight at once
+            UIR *uir = new_uir(memory_test, sizeof(memory_test));
+            uir->scratch = scratch;
+            uir->scratch_size = sizeof(scratch);
+            UIR *other = new_uir(memory_batch, sizeof(memory_batch));
+
+            UIR_BatchPanel panels[2] = {
+                { .uir = uir, .cmds = cmds, .cmd_count = prev_count },
+                { .uir = other, .cmds = batch_cmds, .cmd_count = prev_count },
+            };
+            memcpy(cmds, scene_prev, prev_count * sizeof(UIR_DrawCmd));
+            memcpy(batch_cmds, scene_prev, prev_count * sizeof(UIR_DrawCmd));
+            UIR_draw_batch(&pool, panels, 2);
+
+            panels[0].cmd_count = count;
+            memcpy(cmds, scene, count * sizeof(UIR_DrawCmd));
+            UIR_draw_batch(&pool, panels, 2);
+            UIR_write_buffer_rgba(uir, image_test, W*4);
+        } break;
+
+        case CONFIG_PROGRESSIVE: {
+            // leave the previous scene half drawn, then finish the new one a few tiles at a time
+            UIR *uir = new_uir(memory_test, sizeof(memory_test));
+            uir->scratch = scratch;
+            uir->scratch_size = sizeof(scratch);
+
+            UIR_DrawBudget budget = {
+                .max_tiles = 37,
+                .focus = { W/3, H/2, W/3 + 40, H/2 },
+            };
+            uint32_t remaining;
+            memcpy(cmds, scene_prev, prev_count * sizeof(UIR_DrawCmd));
+            UIR_draw_progressive(uir, cmds, prev_count, &budget, &remaining);
+            do {
+                memcpy(cmds, scene, count * sizeof(UIR_DrawCmd));
+                UIR_draw_progressive(uir, cmds, count, &budget, &remaining);
+            } while (remaining);
+            UIR_write_buffer_rgba(uir, image_test, W*4);
+        } break;
+
+        case CONFIG_BUILDER: {
+            // both scenes pushed a command at a time
+            UIR *uir = new_uir(memory_test, sizeof(memory_test));
+            uir->scratch = scratch;
+            uir->scratch_size = sizeof(scratch);
+
+            UIR_Builder builder;
+            UIR_builder_begin(&builder, uir, cmds, MAX_CMDS);
+            for (uint32_t i = 0; i < prev_count; ++i)
+                UIR_builder_push(&builder, &scene_prev[i]);
+            UIR_builder_draw(&builder);
+
+            UIR_builder_begin(&builder, uir, cmds, MAX_CMDS);
+            for (uint32_t i = 0; i < count; ++i)
+                UIR_builder_push(&builder, &scene[i]);
+            UIR_builder_draw(&builder);
+            UIR_write_buffer_rgba(uir, image_test, W*4);
+        } break;
+
+        default:
+            break;
+    }
+}
+
+static void compare(Config config, uint64_t seed) {
+    uint32_t x0 = 0, y0 = 0, x1 = W, y1 = H;
+    if (config == CONFIG_VIRTUAL) {
+        x0 = 5;
+        y0 = 3;
+        x1 = 5 + W - 16;
+        y1 = 3 + H - 16;
+    }
+
+    Report *report = &reports[config];
+    uint32_t failed = 0;
+    for (uint32_t y = y0; y < y1; ++y) {
+        for (uint32_t x = x0; x < x1; ++x) {
+            int worst = 0;
+            for (uint32_t c = 0; c < 4; ++c) {
+                int d = abs(image_test[(y*W + x)*4 + c] - image_reference[(y*W + x)*4 + c]);
+                worst = d > worst ? d : worst;
+            }
+            report->max_diff = worst > report->max_diff ? worst : report->max_diff;
+            failed += worst > config_tolerance[config];
+        }
+    }
+
+    if (failed) {
+        if (!report->scenes_failed)
+            report->first_failed_seed = seed;
+        report->scenes_failed++;
+        report->pixels_failed += failed;
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t scene_count = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 100;
+    uint64_t first_seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+
+    if (!UIR_worker_pool_start(&pool, 3)) {
+        printf("could not start worker pool\n");
+        exit(1);
+    }
+
+    // sources: a soft alpha ramp, translucent noise, and opaque noise
+    rng_state = 0x9e3779b97f4a7c15ull;
+    for (uint32_t i = 0; i < 64*64; ++i) {
+        source_a[i] = (uint8_t)((i % 64) * 4 ^ (i / 64) * 2);
+        RGBA translucent = rng_colour();
+        RGBA opaque = rng_colour();
+        opaque.a = 255;
+        memcpy(&source_rgba[i*4], &translucent, 4);
+        memcpy(&source_opaque[i*4], &opaque, 4);
+    }
+
+    // other formats: straight alpha noise, opaque RGB noise, and a palette for the alpha ramp
+    for (uint32_t i = 0; i < 64*64*4; ++i)
+        source_straight[i] = (uint8_t)rng();
+    for (uint32_t i = 0; i < 64*64*3; ++i)
+        source_rgb[i] = (uint8_t)rng();
+    for (uint32_t i = 0; i < 256; ++i)
+        palette[i] = rng_colour();
+
+    for (uint32_t s = 0; s < scene_count; ++s) {
+        uint64_t seed = first_seed + s;
+        rng_state = seed * 0x2545f4914f6cdd1dull + 1;
+        uint32_t prev_count = rng_scene(scene_prev, 0);
+        uint32_t count = rng_scene(scene, 1);
+
+        render_reference(count);
+        for (uint32_t config = 0; config < CONFIG_COUNT; ++config) {
+            render_config((Config)config, count, prev_count);
+            compare((Config)config, seed);
+        }
+    }
+
+    bool ok = true;
+    printf("%u scenes from seed %llu\n", scene_count, (unsigned long long)first_seed);
+    for (uint32_t config = 0; config < CONFIG_COUNT; ++config) {
+        Report *report = &reports[config];
+        printf(
+            "%-16s max diff %3d, tolerance %d: %u scenes, %u pixels over",
+            config_names[config], report->max_diff, config_tolerance[config],
+            report->scenes_failed, report->pixels_failed
+        );
+        if (report->scenes_failed) {
+            printf(" (first seed %llu)", (unsigned long long)report->first_failed_seed);
+            ok = false;
+        }
+        printf("\n");
+    }
+
+    UIR_worker_pool_stop(&pool);
+    return ok ? 0 : 1;
+}
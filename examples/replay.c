@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <time.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../src/uir.h"
+#include "../src/uir_record.h"
+
+// Replays a capture written by UIR_record_draw, timing each frame.
+//
+// usage: replay capture [first_frame] [frame_count]
+
+#define MAX_CMDS (1 << 16)
+
+unsigned char memory[64 << 20];
+unsigned char scratch[4 << 20];
+UIR_DrawCmd cmds[MAX_CMDS];
+
+static double now_us(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec * 1000000.0 + (double)t.tv_nsec / 1000.0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: replay capture [first_frame] [frame_count]\n");
+        return 1;
+    }
+    uint32_t first_frame = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 0;
+    uint32_t frame_limit = argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 10) : UINT32_MAX;
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+        printf("can't open %s\n", argv[1]);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    const unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        printf("can't map %s\n", argv[1]);
+        return 1;
+    }
+
+    UIR_Replay replay;
+    if (!UIR_replay_open(&replay, data, size)) {
+        printf("%s isn't a capture from this build\n", argv[1]);
+        return 1;
+    }
+    printf("%u frames, up to %u commands\n", replay.frame_count, replay.max_cmd_count);
+
+    UIR *uir = NULL;
+    UIR_ReplayFrame frame = { 0 };
+    uint32_t frame_index = 0;
+    uint32_t drawn = 0;
+    uint64_t total_cmds = 0;
+    uint64_t total_redrawn = 0;
+    double total_us = 0.0;
+    double max_us = 0.0;
+
+    printf("%8s %10s %8s %8s\n", "frame", "us", "cmds", "redrawn");
+    while (drawn < frame_limit && UIR_replay_next(&replay, &frame, cmds, MAX_CMDS)) {
+        if (!uir) {
+            uir = UIR_new(frame.width, frame.height, memory, sizeof(memory));
+            if (!uir) {
+                printf("memory too small\n");
+                return 1;
+            }
+            uir->scratch = scratch;
+            uir->scratch_size = sizeof(scratch);
+        } else {
+            UIR_resize(uir, frame.width, frame.height);
+        }
+        if (uir->error_flags & UIR_ERROR_NO_MEM) {
+            printf("frame %u: %ux%u doesn't fit\n", frame_index, frame.width, frame.height);
+            return 1;
+        }
+        uir->clear_colour = frame.clear_colour;
+        uir->debug_flags = frame.debug_flags;
+
+        // frames before first_frame are drawn untimed, so the first timed frame is incremental
+        double start = now_us();
+        uint32_t redrawn = UIR_draw(uir, cmds, frame.cmd_count);
+        double us = now_us() - start;
+
+        if (frame_index++ < first_frame)
+            continue;
+
+        printf("%8u %10.1f %8u %8u\n", frame_index - 1, us, frame.cmd_count, redrawn);
+        drawn++;
+        total_us += us;
+        total_cmds += frame.cmd_count;
+        total_redrawn += redrawn;
+        if (us > max_us)
+            max_us = us;
+    }
+
+    if (frame.cmd_count > MAX_CMDS)
+        printf("frame %u has %u commands, more than %u\n", frame_index, frame.cmd_count, MAX_CMDS);
+
+    if (drawn) {
+        printf("%u frames: %.1f us total, %.1f us mean, %.1f us max, %.1f cmds, %.1f tiles redrawn per frame\n",
+            drawn, total_us, total_us / drawn, max_us,
+            (double)total_cmds / drawn, (double)total_redrawn / drawn
+        );
+    }
+
+    munmap((void*)(uintptr_t)data, size);
+    close(fd);
+    return 0;
+}
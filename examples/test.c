@@ -3,19 +3,60 @@
 #include <unistd.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #include "../src/uir.h"
+#include "../src/uir_thread.h"
+#include "../src/uir_trace.h"
+#include "../src/uir_record.h"
+#include "../src/uir_tiled.h"
+#include "../src/uir_glyph.h"
 
 #define W 1280
 #define H 720
 
 unsigned char memory[2000*2000*4];
 unsigned char image[W*H*4];
+unsigned char image_unbinned[W*H*4];
+unsigned char scratch[1 << 16];
 unsigned char image_rgb[W*H*3];
 unsigned char image_bgra[W*H*4];
 
 uint8_t glyph_rgba[24*24*4];
 
+uint8_t video[64*64*4];
+uint32_t video_blocks[16];
+unsigned char small_memory[1 << 16];
+unsigned char async_memory[2000*2000*4];
+UIR_DrawCmd async_drawcmds[UIR_RENDER_THREAD_FRAMES * 32];
+unsigned char virtual_memory[3 << 20];
+unsigned char virtual_image[640*360*4];
+UIR_DrawCmd grouped_drawcmds[32];
+UIR_DrawCmd plain_drawcmds[32];
+unsigned char stream_memory[1 << 14];
+unsigned char batch_memory[3][1 << 16];
+UIR_DrawCmd batch_drawcmds[4][32];
+unsigned char recorder_memory[1 << 12];
+unsigned char capture[1 << 20];
+UIR_DrawCmd replay_drawcmds[32];
+uint8_t format_source[32*32*4];
+uint8_t format_expected[32*32*4];
+RGBA format_palette[256];
+unsigned char format_image[2][64*64*4];
+uint8_t tiled_source[100*70*4];
+unsigned char compressed_memory[2][1 << 20];
+unsigned char thumbnail_memory[W/UIR_TILE_SIZE * H/UIR_TILE_SIZE * 80];
+uint8_t test_font[1024];
+unsigned char glyph_memory[1 << 14];
+
+UIR_Point chart[200];
+UIR_Point blob[] = {
+    { 700, 100 },
+    { 800, 50 }, { 900, 200 },
+    { 800, 250 }, { 750, 150 }, { 700, 250 },
+};
+uint8_t blob_verbs[] = { UIR_PATH_MOVE, UIR_PATH_QUAD, UIR_PATH_CUBIC, UIR_PATH_CLOSE };
+
 UIR_DrawCmd drawcmds[] = {
     { .shape = {
         .type = UIR_DRAW_SHAPE_RECT,
@@ -37,8 +78,153 @@ UIR_DrawCmd drawcmds[] = {
         .data_stride = 24*4,
         .scale = 2.f,
     }},
+    { .shadow = {
+        .type = UIR_DRAW_SHAPE_SHADOW,
+        .colour = {0, 0, 0, 160},
+        .shape_rect = { 960, 60, 1260, 260 },
+        .corner_radius = 20,
+        .blur_radius = 8,
+    }},
+    { .shadow = {
+        .type = UIR_DRAW_SHAPE_SHADOW,
+        .colour = {0, 0, 0, 255},
+        .shape_rect = { 100, 450, 350, 650 },
+        .blur_radius = 12,
+    }},
+    { .shape = {
+        .type = UIR_DRAW_SHAPE_RECT,
+        .rect = { 950, 50, 1250, 250 },
+        .outline_colour = {0, 0, 0, 255},
+        .outline_radius = 2,
+        .corner_radius = 20,
+        .fill_gradient = {
+            .type = UIR_GRADIENT_LINEAR,
+            .p0 = { 950, 50 },
+            .p1 = { 1250, 250 },
+            .stop_count = 3,
+            .stop_offsets = { 0.f, 0.5f, 1.f },
+            .stop_colours = { {255, 255, 0, 255}, {0, 200, 200, 255}, {0, 0, 128, 255} },
+        },
+    }},
+    { .shape = {
+        .type = UIR_DRAW_SHAPE_CIRCLE,
+        .rect = { 1000, 300, 1200, 500 },
+        .fill_gradient = {
+            .type = UIR_GRADIENT_RADIAL,
+            .p0 = { 1100, 400 },
+            .p1 = { 1200, 400 },
+            .stop_count = 2,
+            .stop_offsets = { 0.f, 1.f },
+            .stop_colours = { {255, 255, 255, 255}, {0, 0, 0, 64} },
+        },
+    }},
+    { .path = {
+        .type = UIR_DRAW_PATH_FILL,
+        .colour = {200, 50, 200, 255},
+        .points = blob,
+        .point_count = sizeof(blob)/sizeof(blob[0]),
+        .verbs = blob_verbs,
+        .verb_count = sizeof(blob_verbs)/sizeof(blob_verbs[0]),
+    }},
+    { .path = {
+        .type = UIR_DRAW_PATH_STROKE,
+        .colour = {0, 0, 0, 255},
+        .stroke_width = 2.f,
+        .points = chart,
+        .point_count = sizeof(chart)/sizeof(chart[0]),
+    }},
 };
 
+static void put16(uint8_t *p, uint32_t v) { p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t)v; }
+static void put32(uint8_t *p, uint32_t v) { put16(p, v >> 16); put16(p + 2, v); }
+
+// A TrueType font of 4 glyphs, 1000 units from descent to ascent: .notdef, 'A' a 500 unit square,
+// 'I' a 100 x 800 unit bar, and an empty space. Returns its size in test_font.
+static uint32_t build_test_font(void) {
+    static const char tags[7][5] = { "cmap", "glyf", "head", "hhea", "hmtx", "loca", "maxp" };
+    uint32_t offsets[7];
+    uint32_t at = 12 + 7*16;
+
+    // cmap: one Windows Unicode record, with a byte encoding subtable
+    offsets[0] = at;
+    put16(&test_font[at + 2], 1);
+    put16(&test_font[at + 4], 3);
+    put16(&test_font[at + 6], 1);
+    put32(&test_font[at + 8], 12);
+    put16(&test_font[at + 14], 262);
+    test_font[at + 18 + 'A'] = 1;
+    test_font[at + 18 + 'I'] = 2;
+    test_font[at + 18 + ' '] = 3;
+    at += 12 + 262 + 2;
+
+    // glyf: one contour of 4 points on the curve, with 16 bit deltas
+    offsets[1] = at;
+    uint32_t glyph_starts[5] = { 0, 0, 36, 72, 72 };
+    int32_t sizes[2][2] = { { 500, 500 }, { 100, 800 } };
+    for (uint32_t g = 0; g < 2; ++g) {
+        uint8_t *glyph = &test_font[at + glyph_starts[g + 1]];
+        int32_t w = sizes[g][0], h = sizes[g][1];
+        int32_t dx[4] = { 0, w, 0, -w };
+        int32_t dy[4] = { 0, 0, h, 0 };
+        put16(glyph, 1);
+        put16(glyph + 6, (uint32_t)w);
+        put16(glyph + 8, (uint32_t)h);
+        put16(glyph + 10, 3);
+        for (uint32_t i = 0; i < 4; ++i) {
+            glyph[14 + i] = 0x01;
+            put16(glyph + 18 + i*2, (uint32_t)dx[i] & 0xffff);
+            put16(glyph + 26 + i*2, (uint32_t)dy[i] & 0xffff);
+        }
+    }
+    at += 72;
+
+    // head, with short loca offsets
+    offsets[2] = at;
+    put32(&test_font[at], 0x00010000);
+    put16(&test_font[at + 18], 1000);
+    at += 56;
+
+    // hhea
+    offsets[3] = at;
+    put16(&test_font[at + 4], 800);
+    put16(&test_font[at + 6], (uint32_t)-200 & 0xffff);
+    put16(&test_font[at + 34], 4);
+    at += 36;
+
+    // hmtx: every glyph advances 600 units
+    offsets[4] = at;
+    for (uint32_t g = 0; g < 4; ++g)
+        put16(&test_font[at + g*4], 600);
+    at += 16;
+
+    // loca
+    offsets[5] = at;
+    for (uint32_t g = 0; g < 5; ++g)
+        put16(&test_font[at + g*2], glyph_starts[g] / 2);
+    at += 12;
+
+    // maxp
+    offsets[6] = at;
+    put32(&test_font[at], 0x00005000);
+    put16(&test_font[at + 4], 4);
+    at += 8;
+
+    put32(test_font, 0x00010000);
+    put16(&test_font[4], 7);
+    for (uint32_t t = 0; t < 7; ++t) {
+        memcpy(&test_font[12 + t*16], tags[t], 4);
+        put32(&test_font[12 + t*16 + 8], offsets[t]);
+        put32(&test_font[12 + t*16 + 12], (t + 1 < 7 ? offsets[t + 1] : at) - offsets[t]);
+    }
+    return at;
+}
+
+static uint64_t test_clock(void *user_data) {
+    (void)user_data;
+    static uint64_t time = 0;
+    return time += 1000;
+}
+
 int main(void) {
     // write gradient glyph_rgba
     for (uint32_t y = 0; y < 24; ++y) {
@@ -51,6 +237,11 @@ int main(void) {
         }
     }
     
+    for (uint32_t i = 0; i < sizeof(chart)/sizeof(chart[0]); ++i) {
+        chart[i].x = 500.f + (float)i * 3.5f;
+        chart[i].y = 500.f + sinf((float)i * 0.1f) * 100.f;
+    }
+
     UIR *uir = UIR_new(W, H, memory, sizeof(memory));
     if (!uir || uir->error_flags) {
         printf("err\n");
@@ -59,7 +250,19 @@ int main(void) {
 
     uir->clear_colour = (RGBA) { 255, 100, 100, 255 };
     UIR_draw(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]));
+    UIR_write_buffer_rgba(uir, image_unbinned, W*4);
+
+    // binned paths must match unbinned paths
+    memset(memory, 0, sizeof(memory));
+    uir = UIR_new(W, H, memory, sizeof(memory));
+    uir->clear_colour = (RGBA) { 255, 100, 100, 255 };
+    uir->scratch = scratch;
+    uir->scratch_size = sizeof(scratch);
+    UIR_draw(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]));
     UIR_write_buffer_rgba(uir, image, W*4);
+    for (size_t i = 0; i < sizeof(image); ++i)
+        assert(abs(image[i] - image_unbinned[i]) <= 1);
+
     UIR_write_buffer_bgra(uir, image_bgra, W*4);
     UIR_write_buffer_rgb(uir, image_rgb, W*3);
     
@@ -87,4 +290,872 @@ int main(void) {
     for (size_t i = 0; i < W*H*3; i++)
         fputc(image_rgb[i], f);
     fclose(f);
+
+    // image handles only redraw the tiles showing changed pixels
+    {
+        UIR_Image handle;
+        UIR_image_init(&handle, video, 64*4, 64, 64, video_blocks);
+        assert(UIR_image_block_count(64, 64) == sizeof(video_blocks)/sizeof(video_blocks[0]));
+
+        UIR_DrawCmd video_cmd = { .image = {
+            .type = UIR_DRAW_IMAGE_RGBA,
+            .rect = { 0, 0, 64, 64 },
+            .data = video,
+            .data_stride = 64*4,
+            .scale = 1,
+            .handle = &handle,
+        }};
+
+        UIR *small = UIR_new(64, 64, small_memory, sizeof(small_memory));
+        assert(UIR_draw(small, &video_cmd, 1) == 16);
+        assert(UIR_draw(small, &video_cmd, 1) == 0);
+
+        video[(20*64 + 40)*4] = 255;
+        UIR_image_mark_dirty(&handle, 40, 20, 41, 21);
+        assert(UIR_draw(small, &video_cmd, 1) == 1);
+        assert(small->tiles[1*4 + 2][4*UIR_TILE_SIZE + 8].r == 255);
+
+        // without blocks, the whole image is redrawn
+        handle.block_generations = NULL;
+        UIR_image_mark_dirty(&handle, 0, 0, 1, 1);
+        assert(UIR_draw(small, &video_cmd, 1) == 16);
+    }
+
+    // gradients shade no stops past UIR_GRADIENT_MAX_STOPS
+    {
+        UIR_DrawCmd gradient_cmd = { .shape = {
+            .type = UIR_DRAW_SHAPE_RECT,
+            .rect = { 0, 0, 64, 64 },
+            .fill_gradient = {
+                .type = UIR_GRADIENT_LINEAR,
+                .p0 = { 0, 0 },
+                .p1 = { 64, 0 },
+                .stop_count = UIR_GRADIENT_MAX_STOPS,
+                .stop_offsets = { 0.f, 0.3f, 0.6f, 0.9f },
+                .stop_colours = { {255, 0, 0, 255}, {0, 255, 0, 255}, {0, 0, 255, 255}, {255, 255, 255, 255} },
+            },
+        }};
+
+        memset(small_memory, 0, sizeof(small_memory));
+        memset(batch_memory[0], 0, sizeof(batch_memory[0]));
+        UIR *expected = UIR_new(64, 64, small_memory, sizeof(small_memory));
+        UIR *clamped = UIR_new(64, 64, batch_memory[0], sizeof(batch_memory[0]));
+        assert(UIR_draw(expected, &gradient_cmd, 1) == 16);
+        UIR_write_buffer_rgba(expected, format_image[0], 64*4);
+
+        gradient_cmd.shape.fill_gradient.stop_count = 1000;
+        assert(UIR_draw(clamped, &gradient_cmd, 1) == 16);
+        UIR_write_buffer_rgba(clamped, format_image[1], 64*4);
+        assert(memcmp(format_image[0], format_image[1], sizeof(format_image[0])) == 0);
+    }
+
+    // the render thread draws the latest published frame
+    {
+        uint32_t drawcmd_count = sizeof(drawcmds)/sizeof(drawcmds[0]);
+        UIR *async = UIR_new(W, H, async_memory, sizeof(async_memory));
+        async->clear_colour = uir->clear_colour;
+        async->scratch = scratch;
+        async->scratch_size = sizeof(scratch);
+
+        UIR_RenderThread rt = { 0 };
+        assert(UIR_render_thread_start(&rt, async, async_drawcmds, 32));
+
+        uint64_t frame_id = 0;
+        for (uint32_t i = 0; i < 8; ++i) {
+            UIR_DrawCmd *cmds = UIR_render_thread_commands(&rt);
+            memcpy(cmds, drawcmds, sizeof(drawcmds));
+            cmds[0].shape.rect.x0 -= (float)(7 - i);
+            frame_id = UIR_render_thread_publish(&rt, drawcmd_count);
+        }
+        assert(UIR_render_thread_wait(&rt, frame_id, NULL) == frame_id);
+        UIR_render_thread_stop(&rt);
+
+        UIR_write_buffer_rgba(async, image_unbinned, W*4);
+        assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+    }
+
+    // tracing emits a span per phase and per sampled tile, and heatmaps tint every tile
+    {
+        UIR_DrawCmd rect_cmd = { .shape = {
+            .type = UIR_DRAW_SHAPE_RECT,
+            .fill_colour = {100, 100, 255, 255},
+            .rect = { 8, 8, 40, 40 },
+        }};
+
+        memset(small_memory, 0, sizeof(small_memory));
+        UIR *small = UIR_new(64, 64, small_memory, sizeof(small_memory));
+
+        FILE *trace_out = tmpfile();
+        UIR_TraceFile trace_file;
+        UIR_trace_file_begin(&trace_file, trace_out, 4);
+        small->trace = &trace_file.trace;
+
+        uint32_t events = trace_file.event_count;
+        assert(UIR_draw(small, &rect_cmd, 1) == 16);
+        assert(trace_file.event_count == events + 3 + 16/4);
+        UIR_trace_file_end(&trace_file);
+        fclose(trace_out);
+        small->trace = NULL;
+
+        RGBA before = small->tiles[0][0];
+        small->debug_flags = UIR_DEBUG_HEATMAP_OVERDRAW;
+        assert(UIR_draw(small, &rect_cmd, 1) == 16);
+        assert(memcmp(&small->tiles[0][0], &before, sizeof(before)) != 0);
+        small->debug_flags = 0;
+        assert(UIR_draw(small, &rect_cmd, 1) == 16);
+        assert(memcmp(&small->tiles[0][0], &before, sizeof(before)) == 0);
+    }
+
+    // virtual canvases page tiles through a pool, and keep offscreen tiles until they are evicted
+    {
+        uint32_t drawcmd_count = sizeof(drawcmds)/sizeof(drawcmds[0]);
+        size_t virtual_size = UIR_virtual_memory_size(640, 360, 2000);
+        assert(virtual_size <= sizeof(virtual_memory));
+
+        UIR *canvas = UIR_new_virtual(640, 360, virtual_memory, virtual_size);
+        assert(canvas && !canvas->error_flags && canvas->tile_count >= 2000);
+        canvas->clear_colour = uir->clear_colour;
+        canvas->scratch = scratch;
+        canvas->scratch_size = sizeof(scratch);
+
+        uint32_t grid_tile_count = canvas->width_in_tiles * canvas->height_in_tiles;
+        UIR_set_viewport(canvas, 5, 3);
+        assert(UIR_draw(canvas, drawcmds, drawcmd_count) == grid_tile_count);
+
+        UIR_write_buffer_rgba(canvas, virtual_image, 640*4);
+        for (uint32_t y = 0; y < 360; ++y)
+            assert(memcmp(&virtual_image[y*640*4], &image[((y + 3)*W + 5)*4], 640*4) == 0);
+
+        // scrolling one tile right only draws the column that came into view, and scrolling back draws nothing
+        UIR_set_viewport(canvas, 5 + UIR_TILE_SIZE, 3);
+        assert(UIR_draw(canvas, drawcmds, drawcmd_count) == canvas->height_in_tiles);
+        UIR_set_viewport(canvas, 5, 3);
+        assert(UIR_draw(canvas, drawcmds, drawcmd_count) == 0);
+
+        // far away, the same commands relative to the anchor draw the same pixels
+        int64_t far = -((int64_t)1 << 40);
+        UIR_set_anchor(canvas, far, far);
+        UIR_set_viewport(canvas, far + 5, far + 3);
+        assert(UIR_draw(canvas, drawcmds, drawcmd_count) == grid_tile_count);
+        UIR_write_buffer_rgba(canvas, virtual_image, 640*4);
+        for (uint32_t y = 0; y < 360; ++y)
+            assert(memcmp(&virtual_image[y*640*4], &image[((y + 3)*W + 5)*4], 640*4) == 0);
+
+        // the pool holds both views, so coming back redraws nothing
+        UIR_set_anchor(canvas, 0, 0);
+        UIR_set_viewport(canvas, 5, 3);
+        assert(UIR_draw(canvas, drawcmds, drawcmd_count) == 0);
+    }
+
+    // the glyph cache packs glyphs into shelves, keeps those used this frame, and evicts the least
+    // recently used shelf, or blank glyphs, once the atlas or glyphs run out
+    {
+        assert(build_test_font() <= sizeof(test_font));
+        stbtt_fontinfo font;
+        assert(stbtt_InitFont(&font, test_font, 0));
+
+        assert(UIR_glyph_cache_memory_size(64, 64, 16) <= sizeof(glyph_memory));
+        UIR_GlyphCache *cache = UIR_glyph_cache_new(64, 64, 16, glyph_memory, sizeof(glyph_memory));
+        assert(cache);
+
+        // a 500 unit square at 20 px is 10 px, covered in full inside
+        UIR_Glyph *square = UIR_glyph_cache_get(cache, &font, 20.f, 'A');
+        assert(square && square->width == 10 && square->height == 10 && square->offset_y == -10.f);
+        assert(square->advance == 12.f);
+        assert(cache->atlas.data[(square->y + 5) * cache->atlas.data_stride + square->x + 5] == 255);
+        assert(UIR_glyph_cache_get(cache, &font, 20.f, 'A') == square && cache->rasterized_count == 1);
+
+        // a bar of similar height shares the square's shelf, and a blank glyph takes no atlas space
+        UIR_Glyph *bar = UIR_glyph_cache_get(cache, &font, 12.5f, 'I');
+        assert(bar && bar->y == square->y && bar->x == square->x + square->width + 1);
+        UIR_Glyph *space = UIR_glyph_cache_get(cache, &font, 20.f, ' ');
+        assert(space && !space->width && !space->height && space->advance == 12.f);
+        assert(cache->rasterized_count == 2);
+
+        // glyphs used this frame are never evicted, so larger squares run out of atlas space
+        uint32_t square_x = square->x, square_y = square->y;
+        uint32_t fitted = 0;
+        float size = 40.f;
+        while (UIR_glyph_cache_get(cache, &font, size, 'A')) {
+            fitted++;
+            size += 1.f;
+        }
+        assert(fitted > 0 && fitted < 8 && !cache->evicted_count);
+        assert(square->x == square_x && square->y == square_y);
+
+        // next frame, the least recently used shelf makes room, but not the one used again
+        UIR_glyph_cache_next_frame(cache);
+        assert(UIR_glyph_cache_get(cache, &font, 20.f, 'A') == square);
+        UIR_glyph_cache_next_frame(cache);
+        assert(UIR_glyph_cache_get(cache, &font, size, 'A') && cache->evicted_count > 0);
+        uint32_t rasterized = cache->rasterized_count;
+        assert(UIR_glyph_cache_get(cache, &font, 20.f, 'A') == square && cache->rasterized_count == rasterized);
+        assert(square->x == square_x && square->y == square_y);
+
+        // a space at every size of a zoom never takes the last glyph from the squares
+        cache = UIR_glyph_cache_new(64, 64, 8, glyph_memory, sizeof(glyph_memory));
+        assert(cache);
+        for (uint32_t frame = 0; frame < 100; ++frame) {
+            assert(UIR_glyph_cache_get(cache, &font, 8.f + (float)frame * 0.5f, ' '));
+            assert(UIR_glyph_cache_get(cache, &font, 20.f, 'A'));
+            UIR_glyph_cache_next_frame(cache);
+        }
+        assert(cache->rasterized_count == 1);
+    }
+
+    // unchanged groups are hashed once, and stand in for their commands
+    {
+        uint32_t drawcmd_count = sizeof(drawcmds)/sizeof(drawcmds[0]);
+        UIR_DrawCmd overlay = { .shape = {
+            .type = UIR_DRAW_SHAPE_CIRCLE,
+            .fill_colour = {0, 0, 100, 100},
+            .rect = { 600, 40, 760, 200 },
+        }};
+
+        memset(async_memory, 0, sizeof(async_memory));
+        UIR *grouped = UIR_new(W, H, async_memory, sizeof(async_memory));
+        grouped->clear_colour = uir->clear_colour;
+        grouped->scratch = scratch;
+        grouped->scratch_size = sizeof(scratch);
+
+        grouped_drawcmds[0] = (UIR_DrawCmd) { .group = {
+            .type = UIR_DRAW_GROUP,
+            .cmd_count = drawcmd_count,
+        }};
+        memcpy(&grouped_drawcmds[1], drawcmds, sizeof(drawcmds));
+        assert(UIR_draw(grouped, grouped_drawcmds, 1 + drawcmd_count) == W/UIR_TILE_SIZE * H/UIR_TILE_SIZE);
+        assert(grouped_drawcmds[0].group.hash != 0);
+        UIR_write_buffer_rgba(grouped, image_unbinned, W*4);
+        assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+        assert(UIR_draw(grouped, grouped_drawcmds, 1 + drawcmd_count) == 0);
+
+        // edits are only seen once the hash is cleared
+        grouped_drawcmds[1].shape.fill_colour.r ^= 1;
+        assert(UIR_draw(grouped, grouped_drawcmds, 1 + drawcmd_count) == 0);
+        grouped_drawcmds[1].shape.fill_colour.r ^= 1;
+        grouped_drawcmds[0].group.hash = 0;
+        assert(UIR_draw(grouped, grouped_drawcmds, 1 + drawcmd_count) == 0);
+
+        // tiles redrawn for other reasons prepare the group's commands when they draw them.
+        // The overlay touches its 11x11 bounding box tiles but for 21 in the corners.
+        memcpy(&grouped_drawcmds[1], drawcmds, sizeof(drawcmds));
+        grouped_drawcmds[1 + drawcmd_count] = overlay;
+        assert(UIR_draw(grouped, grouped_drawcmds, 2 + drawcmd_count) == 11*11 - 21);
+
+        memcpy(plain_drawcmds, drawcmds, sizeof(drawcmds));
+        plain_drawcmds[drawcmd_count] = overlay;
+        UIR_draw(uir, plain_drawcmds, 1 + drawcmd_count);
+        UIR_write_buffer_rgba(uir, image, W*4);
+        UIR_write_buffer_rgba(grouped, image_unbinned, W*4);
+        assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+
+        // groups hashed by the app still redraw the tiles of image handles whose pixels changed
+        UIR_Image handle;
+        UIR_image_init(&handle, video, 64*4, 64, 64, video_blocks);
+        UIR_DrawCmd hashed[2] = {
+            { .group = { .type = UIR_DRAW_GROUP, .rect = { 0, 0, 64, 64 }, .cmd_count = 1, .hash = 1234 } },
+            { .image = {
+                .type = UIR_DRAW_IMAGE_RGBA,
+                .rect = { 0, 0, 64, 64 },
+                .data = video,
+                .data_stride = 64*4,
+                .scale = 1,
+                .handle = &handle,
+            }},
+        };
+        memset(small_memory, 0, sizeof(small_memory));
+        UIR *small = UIR_new(64, 64, small_memory, sizeof(small_memory));
+        assert(UIR_draw(small, hashed, 2) == 16);
+        assert(hashed[0].group.live && hashed[0].group.hash == 1234);
+        assert(UIR_draw(small, hashed, 2) == 0);
+
+        video[(40*64 + 20)*4 + 1] = 255;
+        UIR_image_mark_dirty(&handle, 20, 40, 21, 41);
+        assert(UIR_draw(small, hashed, 2) == 1);
+        assert(small->tiles[2*4 + 1][8*UIR_TILE_SIZE + 4].g == 255);
+    }
+
+    // command streams draw the same pixels as command arrays, in less memory
+    {
+        uint32_t plain_count = 1 + sizeof(drawcmds)/sizeof(drawcmds[0]);
+        size_t payload_size = plain_count * sizeof(UIR_DrawCmd);
+        assert(UIR_cmd_stream_memory_size(plain_count, payload_size) <= sizeof(stream_memory));
+
+        UIR_CmdStream *stream = UIR_cmd_stream_new(plain_count, payload_size, stream_memory, sizeof(stream_memory));
+        assert(stream);
+        assert(UIR_cmd_stream_push_array(stream, plain_drawcmds, plain_count) == plain_count);
+        assert(stream->offsets[stream->count] < payload_size);
+
+        memset(async_memory, 0, sizeof(async_memory));
+        UIR *streamed = UIR_new(W, H, async_memory, sizeof(async_memory));
+        streamed->clear_colour = uir->clear_colour;
+        streamed->scratch = scratch;
+        streamed->scratch_size = sizeof(scratch);
+        assert(UIR_draw_stream(streamed, stream) == W/UIR_TILE_SIZE * H/UIR_TILE_SIZE);
+        UIR_write_buffer_rgba(streamed, image_unbinned, W*4);
+        assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+        assert(UIR_draw_stream(streamed, stream) == 0);
+
+        // pushing the same commands again redraws nothing, and a full stream takes no more
+        UIR_cmd_stream_clear(stream);
+        assert(UIR_cmd_stream_push_array(stream, plain_drawcmds, plain_count) == plain_count);
+        assert(UIR_draw_stream(streamed, stream) == 0);
+        assert(!stream->error_flags);
+        assert(!UIR_cmd_stream_push(stream, &plain_drawcmds[0]));
+        assert(stream->error_flags & UIR_ERROR_NO_MEM);
+
+        // groups can't be pushed
+        UIR_cmd_stream_clear(stream);
+        stream->error_flags = 0;
+        assert(!UIR_cmd_stream_push(stream, &grouped_drawcmds[0]) && !stream->error_flags);
+    }
+
+    // batches draw panels of any size on a worker pool, as UIR_draw would
+    {
+        uint32_t plain_count = 1 + sizeof(drawcmds)/sizeof(drawcmds[0]);
+        uint32_t sizes[4][2] = { { W, H }, { 64, 64 }, { 100, 40 }, { 17, 90 } };
+
+        UIR_BatchPanel panels[4];
+        for (uint32_t i = 0; i < 4; ++i) {
+            unsigned char *panel_memory = i ? batch_memory[i - 1] : async_memory;
+            size_t panel_memory_size = i ? sizeof(batch_memory[0]) : sizeof(async_memory);
+            memset(panel_memory, 0, panel_memory_size);
+            memcpy(batch_drawcmds[i], plain_drawcmds, plain_count * sizeof(UIR_DrawCmd));
+
+            panels[i] = (UIR_BatchPanel) {
+                .uir = UIR_new(sizes[i][0], sizes[i][1], panel_memory, panel_memory_size),
+                .cmds = batch_drawcmds[i],
+                .cmd_count = plain_count,
+            };
+            assert(panels[i].uir && !panels[i].uir->error_flags);
+            panels[i].uir->clear_colour = uir->clear_colour;
+        }
+        panels[0].uir->scratch = scratch;
+        panels[0].uir->scratch_size = sizeof(scratch);
+
+        UIR_WorkerPool pool;
+        assert(UIR_worker_pool_start(&pool, 3));
+        uint32_t tile_total = 0;
+        for (uint32_t i = 0; i < 4; ++i)
+            tile_total += panels[i].uir->width_in_tiles * panels[i].uir->height_in_tiles;
+        assert(UIR_draw_batch(&pool, panels, 4) == tile_total);
+
+        for (uint32_t i = 0; i < 4; ++i) {
+            UIR_write_buffer_rgba(panels[i].uir, image_unbinned, sizes[i][0]*4);
+            for (uint32_t y = 0; y < sizes[i][1]; ++y)
+                assert(memcmp(&image_unbinned[y*sizes[i][0]*4], &image[y*W*4], sizes[i][0]*4) == 0);
+        }
+
+        // only the tiles a moved command touches are redrawn
+        assert(UIR_draw_batch(&pool, panels, 4) == 0);
+        batch_drawcmds[0][0].shape.rect.x0 += 16;
+        assert(UIR_draw_batch(&pool, panels, 4) == panels[0].redrawn && panels[0].redrawn > 0);
+        assert(!panels[1].redrawn && !panels[2].redrawn && !panels[3].redrawn);
+
+        // a compressed panel only drops the copies of the tiles it redraws, before the workers start
+        UIR *compressed = panels[0].uir;
+        size_t size = UIR_compressed_size(compressed);
+        assert(size && size <= sizeof(compressed_memory[0]));
+        assert(UIR_compress_tiles(compressed, compressed_memory[0], size));
+        memset(compressed->tiles, 0, (size_t)compressed->tile_count * sizeof(UIR_Tile));
+        batch_drawcmds[0][0].shape.rect.x0 -= 16;
+        assert(UIR_draw_batch(&pool, panels, 4) == panels[0].redrawn && panels[0].redrawn > 0);
+        assert(compressed->compressed_count == compressed->tile_count - panels[0].redrawn);
+        UIR_write_buffer_rgba(compressed, image_unbinned, W*4);
+        assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+        UIR_worker_pool_stop(&pool);
+    }
+
+    // captures replay the same pixels, storing repeated images and paths once
+    {
+        uint32_t plain_count = 1 + sizeof(drawcmds)/sizeof(drawcmds[0]);
+        FILE *file = tmpfile();
+        assert(file);
+
+        memset(async_memory, 0, sizeof(async_memory));
+        UIR *recorded = UIR_new(W, H, async_memory, sizeof(async_memory));
+        recorded->clear_colour = uir->clear_colour;
+        recorded->scratch = scratch;
+        recorded->scratch_size = sizeof(scratch);
+
+        UIR_Recorder recorder;
+        assert(UIR_recorder_memory_size(64) <= sizeof(recorder_memory));
+        assert(UIR_recorder_begin(&recorder, file, 64, recorder_memory, sizeof(recorder_memory)));
+        memcpy(plain_drawcmds, drawcmds, sizeof(drawcmds));
+        UIR_record_draw(&recorder, recorded, plain_drawcmds, plain_count);
+        UIR_record_draw(&recorder, recorded, plain_drawcmds, plain_count);
+        plain_drawcmds[0].shape.rect.x0 += 16;
+        uint32_t moved_redrawn = UIR_record_draw(&recorder, recorded, plain_drawcmds, plain_count);
+        plain_drawcmds[0].shape.rect.x0 -= 16;
+        UIR_recorder_end(&recorder);
+        assert(!recorder.error_flags && recorder.frame_count == 3);
+        assert(recorder.blob_bytes_saved == 2 * recorder.blob_bytes);
+
+        long capture_size = ftell(file);
+        assert(capture_size > 0 && (size_t)capture_size <= sizeof(capture));
+        rewind(file);
+        assert(fread(capture, 1, (size_t)capture_size, file) == (size_t)capture_size);
+        fclose(file);
+
+        UIR_Replay replay;
+        assert(UIR_replay_open(&replay, capture, (size_t)capture_size));
+        assert(replay.frame_count == 3 && replay.max_cmd_count == plain_count);
+
+        memset(async_memory, 0, sizeof(async_memory));
+        UIR *replayed = NULL;
+        UIR_ReplayFrame frame;
+        uint32_t expected_redrawn[3] = { W/UIR_TILE_SIZE * H/UIR_TILE_SIZE, 0, moved_redrawn };
+        for (uint32_t i = 0; i < 3; ++i) {
+            assert(UIR_replay_next(&replay, &frame, replay_drawcmds, plain_count));
+            assert(frame.width == W && frame.height == H && frame.cmd_count == plain_count);
+            if (!replayed) {
+                replayed = UIR_new(frame.width, frame.height, async_memory, sizeof(async_memory));
+                replayed->scratch = scratch;
+                replayed->scratch_size = sizeof(scratch);
+            }
+            replayed->clear_colour = frame.clear_colour;
+            assert(UIR_draw(replayed, replay_drawcmds, frame.cmd_count) == expected_redrawn[i]);
+            if (i == 0) {
+                UIR_write_buffer_rgba(replayed, image_unbinned, W*4);
+                assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+            }
+        }
+        assert(!UIR_replay_next(&replay, &frame, replay_drawcmds, plain_count));
+
+        // an image command showing more rows than its pixels in the capture is rejected
+        for (size_t offset = 0; offset + sizeof(UIR_DrawCmd) <= (size_t)capture_size; offset += 8) {
+            UIR_DrawCmd cmd;
+            memcpy(&cmd, capture + offset, sizeof(cmd));
+            if (cmd.common.type == UIR_DRAW_IMAGE_RGBA && memcmp(&cmd.image.rect, &drawcmds[2].image.rect, sizeof(UIR_Rect)) == 0) {
+                cmd.image.rect.y1 += 10000.f;
+                memcpy(capture + offset, &cmd, sizeof(cmd));
+                break;
+            }
+        }
+        assert(UIR_replay_open(&replay, capture, (size_t)capture_size));
+        assert(!UIR_replay_next(&replay, &frame, replay_drawcmds, plain_count));
+    }
+
+    // progressive draws spread a full redraw over calls, nearest the focus first, and lose no tiles
+    {
+        uint32_t plain_count = 1 + sizeof(drawcmds)/sizeof(drawcmds[0]);
+        uint32_t tile_total = W/UIR_TILE_SIZE * H/UIR_TILE_SIZE;
+        memset(async_memory, 0, sizeof(async_memory));
+        UIR *progressive = UIR_new(W, H, async_memory, sizeof(async_memory));
+        progressive->clear_colour = uir->clear_colour;
+        progressive->scratch = scratch;
+        progressive->scratch_size = sizeof(scratch);
+
+        UIR_DrawBudget budget = {
+            .max_tiles = 100,
+            .focus = { 1000, 600, 1000, 600 },
+        };
+        uint32_t remaining;
+        memcpy(plain_drawcmds, drawcmds, sizeof(drawcmds));
+        assert(UIR_draw_progressive(progressive, plain_drawcmds, plain_count, &budget, &remaining) == 100);
+        assert(remaining == tile_total - 100);
+        UIR_TileInfo *focus_tile = &progressive->tile_info[600/UIR_TILE_SIZE * progressive->width_in_tiles + 1000/UIR_TILE_SIZE];
+        UIR_TileInfo *far_tile = &progressive->tile_info[0];
+        assert(focus_tile->hash_old == focus_tile->hash_new && far_tile->hash_old != far_tile->hash_new);
+
+        // the commands change before the first frame is finished
+        plain_drawcmds[0].shape.rect.x0 += 16;
+        uint32_t calls = 1;
+        while (remaining) {
+            assert(UIR_draw_progressive(progressive, plain_drawcmds, plain_count, &budget, &remaining) <= 100);
+            calls++;
+        }
+        assert(calls == (tile_total + 99) / 100 || calls == (tile_total + 99) / 100 + 1);
+        assert(UIR_draw_progressive(progressive, plain_drawcmds, plain_count, &budget, &remaining) == 0 && !remaining);
+
+        UIR_draw(uir, plain_drawcmds, plain_count);
+        UIR_write_buffer_rgba(uir, image, W*4);
+        UIR_write_buffer_rgba(progressive, image_unbinned, W*4);
+        assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+
+        // a deadline that has passed still draws a tile
+        budget = (UIR_DrawBudget) { .now = test_clock, .deadline = 1 };
+        progressive->clear_colour.g ^= 1;
+        assert(UIR_draw_progressive(progressive, plain_drawcmds, plain_count, &budget, &remaining) == 1);
+        assert(remaining == tile_total - 1);
+
+        // in reference mode every tile counts as changed, so the budget is ignored and calls finish
+        budget = (UIR_DrawBudget) { .max_tiles = 100 };
+        progressive->debug_flags = UIR_DEBUG_REFERENCE;
+        assert(UIR_draw_progressive(progressive, plain_drawcmds, plain_count, &budget, &remaining) == tile_total);
+        assert(!remaining);
+        progressive->debug_flags = 0;
+    }
+
+    // shapes only dirty the tiles they touch, not the corners or holes of their bounding boxes
+    {
+        UIR_DrawCmd ring = { .shape = {
+            .type = UIR_DRAW_SHAPE_CIRCLE,
+            .outline_colour = {255, 255, 255, 255},
+            .outline_radius = 2,
+            .rect = { 0, 0, 640, 640 },
+        }};
+        memset(async_memory, 0, sizeof(async_memory));
+        UIR *rings = UIR_new(W, H, async_memory, sizeof(async_memory));
+        UIR_draw(rings, &ring, 1);
+
+        ring.shape.outline_colour.g = 0;
+        uint32_t redrawn = UIR_draw(rings, &ring, 1);
+        assert(redrawn > 0 && redrawn < 40*40 / 4);
+
+        // the same pixels as drawing every tile with the plain kernels
+        ring.shape.outline_colour.g = 255;
+        UIR_draw(rings, &ring, 1);
+        UIR_write_buffer_rgba(rings, image, W*4);
+        rings->debug_flags = UIR_DEBUG_REFERENCE;
+        UIR_draw(rings, &ring, 1);
+        UIR_write_buffer_rgba(rings, image_unbinned, W*4);
+        assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+    }
+
+    // every image format draws the same pixels as its premultiplied RGBA equivalent
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint8_t a = (uint8_t)(i * 7);
+            format_palette[i] = (RGBA) { (uint8_t)(i * a / 255), (uint8_t)((255 - i) * a / 255), 0, a };
+        }
+
+        UIR *formats = UIR_new(64, 64, small_memory, sizeof(small_memory));
+        for (uint32_t format = UIR_IMAGE_FORMAT_RGBA; format <= UIR_IMAGE_FORMAT_INDEXED; ++format) {
+            uint32_t bpp = format == UIR_IMAGE_FORMAT_RGB ? 3 : format == UIR_IMAGE_FORMAT_INDEXED ? 1 : 4;
+            for (uint32_t i = 0; i < 32*32; ++i) {
+                uint8_t r = (uint8_t)(i * 5), g = (uint8_t)(i * 3), b = (uint8_t)(i >> 2), a = (uint8_t)(i * 11);
+                uint8_t pr = (uint8_t)((r * a + 127) / 255), pg = (uint8_t)((g * a + 127) / 255), pb = (uint8_t)((b * a + 127) / 255);
+                uint8_t *src = &format_source[i * bpp];
+                RGBA expected = { pr, pg, pb, a };
+                switch (format) {
+                    case UIR_IMAGE_FORMAT_RGBA: memcpy(src, &expected, 4); break;
+                    case UIR_IMAGE_FORMAT_BGRA: src[0] = pb; src[1] = pg; src[2] = pr; src[3] = a; break;
+                    case UIR_IMAGE_FORMAT_RGBA_STRAIGHT: src[0] = r; src[1] = g; src[2] = b; src[3] = a; break;
+                    case UIR_IMAGE_FORMAT_BGRA_STRAIGHT: src[0] = b; src[1] = g; src[2] = r; src[3] = a; break;
+                    case UIR_IMAGE_FORMAT_RGB: src[0] = r; src[1] = g; src[2] = b; expected = (RGBA) { r, g, b, 255 }; break;
+                    case UIR_IMAGE_FORMAT_INDEXED: src[0] = (uint8_t)i; expected = format_palette[i & 255]; break;
+                }
+                memcpy(&format_expected[i*4], &expected, 4);
+            }
+
+            // aligned and scaled, with and without a tint
+            for (uint32_t variant = 0; variant < 4; ++variant) {
+                UIR_DrawCmd cmd = { .image = {
+                    .type = UIR_DRAW_IMAGE_RGBA,
+                    .rect = { 3, 5, 3 + 32 * 1.75f, 5 + 32 * 1.75f },
+                    .tint_colour = variant & 1 ? (RGBA) { 40, 30, 20, 128 } : (RGBA) {0},
+                    .data = format_expected,
+                    .data_stride = 32*4,
+                    .scale = 1.75f,
+                }};
+                if (variant & 2) {
+                    cmd.image.rect = (UIR_Rect) { 3, 5, 35, 37 };
+                    cmd.image.scale = 1;
+                }
+                UIR_draw(formats, &cmd, 1);
+                UIR_write_buffer_rgba(formats, format_image[0], 64*4);
+
+                cmd.image.data = format_source;
+                cmd.image.data_stride = 32 * bpp;
+                cmd.image.format = format;
+                cmd.image.palette = format_palette;
+                UIR_draw(formats, &cmd, 1);
+                UIR_write_buffer_rgba(formats, format_image[1], 64*4);
+                assert(memcmp(format_image[0], format_image[1], sizeof(format_image[0])) == 0);
+            }
+        }
+    }
+
+    // consumers copying at different rates each get the tiles changed since their last copy
+    {
+        memset(small_memory, 0, sizeof(small_memory));
+        UIR *panel = UIR_new(64, 64, small_memory, sizeof(small_memory));
+        UIR_DrawCmd dot = { .shape = {
+            .type = UIR_DRAW_SHAPE_RECT,
+            .fill_colour = {255, 255, 255, 255},
+            .rect = { 2, 2, 6, 6 },
+        }};
+        uint32_t changed[16];
+        UIR_draw(panel, &dot, 1);
+        assert(UIR_tiles_changed_since(panel, 0, changed, 16) == 16);
+        uint32_t fast = panel->generation;
+        uint32_t slow = panel->generation;
+
+        // the dot moves a tile to the right per draw
+        for (uint32_t i = 1; i < 4; ++i) {
+            dot.shape.rect.x0 += 16;
+            dot.shape.rect.x1 += 16;
+            UIR_draw(panel, &dot, 1);
+            assert(UIR_tiles_changed_since(panel, fast, changed, 16) == 2 && changed[0] == i - 1 && changed[1] == i);
+            fast = panel->generation;
+        }
+        UIR_draw(panel, &dot, 1);
+        assert(UIR_tiles_changed_since(panel, fast, changed, 16) == 0);
+
+        // the slow consumer skipped every draw, and gets every tile the dot passed
+        assert(UIR_tiles_changed_since(panel, slow, changed, 2) == 4 && changed[0] == 0 && changed[1] == 1);
+
+        UIR_resize(panel, 48, 64);
+        assert(UIR_tiles_changed_since(panel, panel->generation, changed, 16) == 12);
+    }
+
+    // builders hash commands as they are pushed, and draw what UIR_draw draws
+    {
+        uint32_t count = sizeof(drawcmds)/sizeof(drawcmds[0]);
+        memset(async_memory, 0, sizeof(async_memory));
+        UIR *built = UIR_new(W, H, async_memory, sizeof(async_memory));
+        built->clear_colour = uir->clear_colour;
+        built->scratch = scratch;
+        built->scratch_size = sizeof(scratch);
+
+        UIR_Builder builder;
+        UIR_builder_begin(&builder, built, plain_drawcmds, count + 1);
+        for (uint32_t i = 0; i < count; ++i)
+            assert(UIR_builder_push(&builder, &drawcmds[i]));
+        UIR_DrawCmd group = { .group = { .type = UIR_DRAW_GROUP } };
+        assert(!UIR_builder_push(&builder, &group) && !builder.error_flags);
+        assert(UIR_builder_draw(&builder) == W/UIR_TILE_SIZE * H/UIR_TILE_SIZE);
+        assert(UIR_builder_draw(&builder) == 0);
+
+        UIR_draw(uir, drawcmds, count);
+        UIR_write_buffer_rgba(uir, image, W*4);
+        UIR_write_buffer_rgba(built, image_unbinned, W*4);
+        assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+
+        // an unchanged frame redraws nothing, and a moved rect only its tiles
+        UIR_builder_begin(&builder, built, plain_drawcmds, count + 1);
+        for (uint32_t i = 0; i < count; ++i)
+            UIR_builder_push(&builder, &drawcmds[i]);
+        assert(UIR_builder_draw(&builder) == 0);
+
+        UIR_builder_begin(&builder, built, plain_drawcmds, count + 1);
+        for (uint32_t i = 0; i < count; ++i)
+            UIR_builder_push(&builder, &drawcmds[i]);
+        assert(UIR_push_rect(&builder, (UIR_Rect) { 4, 4, 12, 12 }, (RGBA) {255, 255, 255, 255}, (RGBA) {0}, 0, 0));
+        assert(!UIR_push_circle(&builder, (UIR_Rect) { 4, 4, 12, 12 }, (RGBA) {255, 255, 255, 255}, (RGBA) {0}, 0));
+        assert(builder.error_flags & UIR_ERROR_NO_MEM);
+        assert(UIR_builder_draw(&builder) == 1);
+    }
+
+    // packed panels draw the pixels of RGBA panels, converted, in a fraction of the memory
+    {
+        size_t rgba_size = UIR_minimum_memory_size(W, H);
+        assert(UIR_packed_memory_size(W, H, UIR_TILE_FORMAT_L8) * 3 < rgba_size);
+        assert(UIR_packed_memory_size(W, H, UIR_TILE_FORMAT_MONO) * 20 < rgba_size);
+
+        uint32_t count = sizeof(drawcmds)/sizeof(drawcmds[0]);
+        uir->dither = UIR_DITHER_ORDERED;
+        UIR_draw(uir, drawcmds, count);
+        for (uint32_t format = UIR_TILE_FORMAT_L8; format <= UIR_TILE_FORMAT_MONO; ++format) {
+            memset(async_memory, 0, sizeof(async_memory));
+            UIR *packed = UIR_new_packed(W, H, format, async_memory, UIR_packed_memory_size(W, H, format));
+            assert(packed && !packed->error_flags && !packed->tiles);
+            packed->clear_colour = uir->clear_colour;
+            packed->scratch = scratch;
+            packed->scratch_size = sizeof(scratch);
+            UIR_draw(packed, drawcmds, count);
+
+            if (format == UIR_TILE_FORMAT_L8) {
+                UIR_write_buffer_l8(uir, image, W);
+                UIR_write_buffer_l8(packed, image_unbinned, W);
+                assert(memcmp(image, image_unbinned, W*H) == 0);
+            }
+            UIR_write_buffer_mono(uir, image, W/8);
+            UIR_write_buffer_mono(packed, image_unbinned, W/8);
+            assert(memcmp(image, image_unbinned, W/8*H) == 0);
+
+            // a moved dot refreshes the tiles it left and entered, and the rect pixels match the panel's
+            uint32_t generation = packed->generation;
+            UIR_DrawCmd dot = { .shape = {
+                .type = UIR_DRAW_SHAPE_RECT,
+                .fill_colour = {0, 0, 0, 255},
+                .rect = { 100, 100, 110, 110 },
+            }};
+            memcpy(plain_drawcmds, drawcmds, sizeof(drawcmds));
+            plain_drawcmds[count] = dot;
+            UIR_draw(packed, plain_drawcmds, count + 1);
+            UIR_PixelRect rects[4];
+            assert(UIR_changed_rects_since(packed, generation, rects, 4) == 1);
+            assert(rects[0].x0 == 96 && rects[0].y0 == 96 && rects[0].x1 == 112 && rects[0].y1 == 112);
+
+            generation = packed->generation;
+            plain_drawcmds[count].shape.rect = (UIR_Rect) { 500, 100, 510, 110 };
+            UIR_draw(packed, plain_drawcmds, count + 1);
+            assert(UIR_changed_rects_since(packed, generation, rects, 4) == 2);
+            assert(UIR_changed_rects_since(packed, generation, rects, 1) == 1);
+            assert(rects[0].x0 == 96 && rects[0].x1 == 512 && rects[0].y1 == 112);
+
+            UIR_write_buffer_mono(packed, image, W/8);
+            UIR_write_rect_mono(packed, &rects[0], image_unbinned, W/8);
+            for (uint32_t y = rects[0].y0; y < rects[0].y1; ++y)
+                assert(memcmp(&image[y*W/8 + rects[0].x0/8], &image_unbinned[(y - rects[0].y0)*W/8], (rects[0].x1 - rects[0].x0)/8) == 0);
+        }
+
+        // diffusion keeps the average of flat grays
+        memset(small_memory, 0, sizeof(small_memory));
+        UIR *mono = UIR_new_packed(64, 64, UIR_TILE_FORMAT_MONO, small_memory, sizeof(small_memory));
+        mono->dither = UIR_DITHER_DIFFUSION;
+        mono->clear_colour = (RGBA) { 64, 64, 64, 255 };
+        UIR_draw(mono, NULL, 0);
+        UIR_write_buffer_mono(mono, image, 8);
+        uint32_t lit = 0;
+        for (uint32_t i = 0; i < 64*8; ++i) {
+            for (uint8_t bits = image[i]; bits; bits &= (uint8_t)(bits - 1))
+                lit++;
+        }
+        assert(lit > 64*64/4 - 16 && lit < 64*64/4 + 16);
+    }
+
+    // tiled images draw the tiles in view, from the level nearest the drawn size
+    {
+        for (uint32_t i = 0; i < 100*70; ++i) {
+            tiled_source[i*4 + 0] = (uint8_t)(i * 5);
+            tiled_source[i*4 + 1] = (uint8_t)(i * 3);
+            tiled_source[i*4 + 2] = (uint8_t)(i >> 3);
+            tiled_source[i*4 + 3] = 255;
+        }
+        FILE *file = tmpfile();
+        assert(file);
+        assert(UIR_tiled_image_write(file, tiled_source, 100, 70, 100*4, UIR_IMAGE_FORMAT_RGBA, 32));
+        long tiled_size = ftell(file);
+        assert(tiled_size > 0 && (size_t)tiled_size <= sizeof(capture));
+        rewind(file);
+        assert(fread(capture, 1, (size_t)tiled_size, file) == (size_t)tiled_size);
+        fclose(file);
+
+        UIR_TiledImage tiled;
+        assert(!UIR_tiled_image_open(&tiled, capture, (size_t)tiled_size - 1));
+        assert(UIR_tiled_image_open(&tiled, capture, (size_t)tiled_size));
+        assert(tiled.level_count == 3 && tiled.flags == UIR_IMAGE_OPAQUE);
+        assert(tiled.levels[1].width == 50 && tiled.levels[1].height == 35 && tiled.levels[2].height == 18);
+        const uint8_t *level_pixel = tiled.levels[1].tiles;
+        uint32_t box = (uint32_t)tiled_source[0] + tiled_source[4] + tiled_source[400] + tiled_source[404];
+        assert(level_pixel[0] == (box + 2) / 4);
+
+        // at full size, the tiles draw the pixels of the whole image
+        memset(async_memory, 0, sizeof(async_memory));
+        UIR *panel = UIR_new(128, 96, async_memory, sizeof(async_memory));
+        UIR_Rect full = { 8, 8, 108, 78 };
+        UIR_Rect view = { 0, 0, 128, 96 };
+        UIR_DrawCmd whole = { .image = {
+            .type = UIR_DRAW_IMAGE_RGBA,
+            .rect = full,
+            .data = tiled_source,
+            .data_stride = 100*4,
+            .scale = 1,
+            .flags = UIR_IMAGE_OPAQUE,
+        }};
+        UIR_draw(panel, &whole, 1);
+        UIR_write_buffer_rgba(panel, image, 128*4);
+        assert(UIR_tiled_image_cmds(&tiled, full, view, plain_drawcmds, 32) == 12);
+        UIR_draw(panel, plain_drawcmds, 12);
+        UIR_write_buffer_rgba(panel, image_unbinned, 128*4);
+        assert(memcmp(image, image_unbinned, 128*96*4) == 0);
+
+        // a wider rect keeps the aspect ratio, drawing the same tiles
+        UIR_Rect wide = { 8, 8, 208, 78 };
+        assert(UIR_tiled_image_cmds(&tiled, wide, view, plain_drawcmds, 32) == 12);
+        for (uint32_t i = 0; i < 12; ++i)
+            assert(plain_drawcmds[i].image.scale == 1.f && plain_drawcmds[i].image.rect.x1 <= full.x1);
+        UIR_draw(panel, plain_drawcmds, 12);
+        UIR_write_buffer_rgba(panel, image_unbinned, 128*4);
+        assert(memcmp(image, image_unbinned, 128*96*4) == 0);
+
+        // smaller draws use smaller levels, and views only get the tiles they show
+        UIR_Rect half = { 8, 8, 58, 43 };
+        assert(UIR_tiled_image_level(&tiled, half) == 1);
+        assert(UIR_tiled_image_cmds(&tiled, half, view, plain_drawcmds, 32) == 4);
+        assert(UIR_tiled_image_level(&tiled, (UIR_Rect) { 0, 0, 25, 18 }) == 2);
+        assert(UIR_tiled_image_cmds(&tiled, full, (UIR_Rect) { 0, 0, 20, 20 }, plain_drawcmds, 32) == 1);
+        assert(plain_drawcmds[0].image.data == tiled.levels[0].tiles);
+        assert(UIR_tiled_image_cmds(&tiled, full, (UIR_Rect) { 41, 41, 73, 73 }, plain_drawcmds, 2) == 4);
+        UIR_tiled_image_prefetch(&tiled, full, (UIR_Rect) { 41, 41, 73, 73 });
+    }
+
+    // thumbnails box filter the tiles redrawn since their last update to the pixels of a full downscale
+    {
+        uint32_t count = sizeof(drawcmds)/sizeof(drawcmds[0]);
+        memset(async_memory, 0, sizeof(async_memory));
+        UIR *panel = UIR_new(W, H, async_memory, sizeof(async_memory));
+        panel->clear_colour = uir->clear_colour;
+        panel->scratch = scratch;
+        panel->scratch_size = sizeof(scratch);
+        memcpy(plain_drawcmds, drawcmds, sizeof(drawcmds));
+        UIR_draw(panel, plain_drawcmds, count);
+
+        UIR_Thumbnail thumbnail;
+        assert(UIR_thumbnail_memory_size(W, H) <= sizeof(thumbnail_memory));
+        assert(!UIR_thumbnail_init(&thumbnail, panel, thumbnail_memory, UIR_thumbnail_memory_size(W, H) - 1));
+        assert(UIR_thumbnail_init(&thumbnail, panel, thumbnail_memory, sizeof(thumbnail_memory)));
+        assert(thumbnail.level_widths[0] == W/4 && thumbnail.level_heights[1] == H/8);
+        assert(UIR_thumbnail_update(&thumbnail, panel) == 0);
+
+        plain_drawcmds[0].shape.rect.x0 += 16;
+        uint32_t redrawn = UIR_draw(panel, plain_drawcmds, count);
+        assert(redrawn > 0 && UIR_thumbnail_update(&thumbnail, panel) == redrawn);
+
+        UIR_write_buffer_rgba(panel, image, W*4);
+        for (uint32_t level = 0; level < UIR_THUMBNAIL_LEVELS; ++level) {
+            uint32_t box = 4u << level;
+            for (uint32_t y = 0; y < H / box; ++y) {
+                for (uint32_t x = 0; x < W / box; ++x) {
+                    uint32_t sums[4] = { 0 };
+                    for (uint32_t sy = 0; sy < box; ++sy)
+                        for (uint32_t sx = 0; sx < box; ++sx)
+                            for (uint32_t c = 0; c < 4; ++c)
+                                sums[c] += image[((y*box + sy)*W + x*box + sx)*4 + c];
+                    const uint8_t *px = &thumbnail.levels[level][y * thumbnail.level_widths[level] + x].r;
+                    for (uint32_t c = 0; c < 4; ++c)
+                        assert(px[c] == (sums[c] + box*box/2) / (box*box));
+                }
+            }
+        }
+    }
+
+    // idle panels compress their tiles, decompress each when it is read, and drop it when it is redrawn
+    {
+        uint32_t count = sizeof(drawcmds)/sizeof(drawcmds[0]);
+        size_t panel_size = UIR_minimum_memory_size(W, H);
+        assert(panel_size * 2 <= sizeof(async_memory));
+        memset(async_memory, 0, sizeof(async_memory));
+        UIR *panel = UIR_new(W, H, async_memory, panel_size);
+        UIR *expected = UIR_new(W, H, async_memory + panel_size, panel_size);
+        panel->clear_colour = expected->clear_colour = uir->clear_colour;
+        panel->scratch = expected->scratch = scratch;
+        panel->scratch_size = expected->scratch_size = sizeof(scratch);
+        memcpy(plain_drawcmds, drawcmds, sizeof(drawcmds));
+        UIR_draw(panel, plain_drawcmds, count);
+        UIR_write_buffer_rgba(panel, image, W*4);
+
+        size_t tiles_size = panel->tile_count * sizeof(UIR_Tile);
+        size_t size = UIR_compressed_size(panel);
+        assert(size * 4 < tiles_size && size <= sizeof(compressed_memory[0]));
+        assert(!UIR_compress_tiles(panel, compressed_memory[0], size - 1) && !panel->compressed);
+        assert(UIR_compress_tiles(panel, compressed_memory[0], size));
+        assert(panel->compressed_count == panel->tile_count);
+
+        // as if the pages of the tile store were released
+        memset(panel->tiles, 0, tiles_size);
+        UIR_write_buffer_rgba(panel, image_unbinned, W*4);
+        assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+        assert(panel->compressed_count == 0 && !panel->compressed);
+
+        assert(UIR_compress_tiles(panel, compressed_memory[0], size));
+        memset(panel->tiles, 0, tiles_size);
+        plain_drawcmds[0].shape.rect.x0 += 16;
+        uint32_t redrawn = UIR_draw(panel, plain_drawcmds, count);
+        assert(redrawn > 0 && panel->compressed_count == panel->tile_count - redrawn);
+
+        // tiles still compressed are copied into the new block, not read from the store
+        size = UIR_compressed_size(panel);
+        assert(UIR_compress_tiles(panel, compressed_memory[1], size));
+        memset(compressed_memory[0], 0, sizeof(compressed_memory[0]));
+        memset(panel->tiles, 0, tiles_size);
+
+        UIR_draw(expected, plain_drawcmds, count);
+        UIR_write_buffer_rgba(expected, image, W*4);
+        UIR_write_buffer_rgba(panel, image_unbinned, W*4);
+        assert(memcmp(image, image_unbinned, sizeof(image)) == 0);
+    }
 }
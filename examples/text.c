@@ -4,7 +4,7 @@
 #include <string.h>
 
 #include "../src/uir.h"
-#include "../vendor/stb_truetype.h"
+#include "../src/uir_glyph.h"
 
 #define W 1280
 #define H 720
@@ -13,11 +13,11 @@ unsigned char memory[2000*2000*4];
 unsigned char image[W*H*4];
 
 uint32_t drawcmd_count;
-UIR_DrawCmd drawcmds[16];
+UIR_DrawCmd drawcmds[64];
 
 unsigned char ttf[1<<20];
-unsigned char bitmap[512*512];
-stbtt_bakedchar chardata[96];
+unsigned char glyph_memory[1<<20];
+unsigned char zoom_memory[1<<20];
 
 typedef struct timespec TimeSpec;
 typedef struct {
@@ -52,31 +52,53 @@ int main(void) {
     }
     
     fread(ttf, 1, 1<<20, fopen("Vera.ttf", "rb"));
-    stbtt_BakeFontBitmap(ttf, 0, 32.f, bitmap, 512,512, 32,96, chardata);
-    
-    char text[] = {'H', 'e', 'l', 'l', 'o', ' ', 'W', 'o', 'r', 'l', 'd', '!'};
-    float x = 50.f;
-    float y = 100.f;
-    for (uint32_t i = 0; i < sizeof(text); ++i) {
-        char c = text[i];
-        stbtt_aligned_quad q;
-        stbtt_GetBakedQuad(chardata, 512,512, c-32, &x,&y,&q,1);
-        
-        drawcmds[drawcmd_count++] = (UIR_DrawCmd) { .image = {
-            .type = UIR_DRAW_IMAGE_A,
-            .tint_colour = { 255, 255, 255, 255 },
-            .rect = { q.x0, q.y0, q.x1, q.y1 },
-            .data = &bitmap[(uint32_t)(q.t0 * 512*512 + q.s0 * 512)],
-            .data_stride = 512,
-            .scale = 1,
-        }};
+    stbtt_fontinfo font;
+    stbtt_InitFont(&font, ttf, stbtt_GetFontOffsetForIndex(ttf, 0));
+
+    UIR_GlyphCache *glyphs = UIR_glyph_cache_new(512, 512, 256, glyph_memory, sizeof(glyph_memory));
+    if (!glyphs) {
+        printf("err\n");
+        exit(1);
+    }
+
+    // glyphs are rasterized as they are first used, at any size
+    Timer t = timer_start();
+    const char text[] = "Hello World!";
+    float sizes[] = { 32.f, 17.5f, 64.f };
+    float y = 50.f;
+    for (uint32_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s) {
+        float x = 50.f;
+        y += sizes[s] * 1.25f;
+        for (uint32_t i = 0; text[i]; ++i) {
+            UIR_Glyph *glyph = UIR_glyph_cache_get(glyphs, &font, sizes[s], (uint32_t)text[i]);
+            if (!glyph)
+                continue;
+
+            drawcmds[drawcmd_count++] = UIR_glyph_draw_cmd(glyphs, glyph, x, y, (RGBA) { 255, 255, 255, 255 });
+            x += glyph->advance;
+        }
+    }
+    double elapsed = timer_elapsed_us(&t);
+    printf("layout: %f (%u glyphs rasterized)\n", elapsed, glyphs->rasterized_count);
+
+    // zooming out through many sizes, with a blank glyph at each, never runs out of glyphs
+    UIR_GlyphCache *zoom = UIR_glyph_cache_new(512, 512, 8, zoom_memory, sizeof(zoom_memory));
+    uint32_t missing = 0;
+    for (uint32_t frame = 0; zoom && frame < 200; ++frame) {
+        float size = 108.f - (float)frame * 0.5f;
+        missing += !UIR_glyph_cache_get(zoom, &font, size, ' ');
+        missing += !UIR_glyph_cache_get(zoom, &font, size, 'H');
+        UIR_glyph_cache_next_frame(zoom);
     }
+    printf("zoom: %u glyphs missing\n", missing);
+    if (!zoom || missing)
+        exit(1);
     
     uir->clear_colour = (RGBA) { 255, 100, 100, 255 };
 
-    Timer t = timer_start();
-    UIR_draw(uir, drawcmds, sizeof(drawcmds)/sizeof(drawcmds[0]));
-    double elapsed = timer_elapsed_us(&t); 
+    t = timer_start();
+    UIR_draw(uir, drawcmds, drawcmd_count);
+    elapsed = timer_elapsed_us(&t); 
     printf("draw: %f\n", elapsed);
     UIR_write_buffer_rgba(uir, image, W*4);
 
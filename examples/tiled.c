@@ -0,0 +1,131 @@
+#define _DEFAULT_SOURCE // for mincore
+
+#include <stdio.h>
+#include <time.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../src/uir.h"
+#include "../src/uir_tiled.h"
+
+// Writes a generated image as a tiled file, maps it, and pans and zooms a panel across it,
+// printing how much of the mapping is resident after each frame.
+//
+// usage: tiled file [image_size]
+
+#define W 640
+#define H 480
+#define MAX_CMDS 256
+
+unsigned char memory[W * H * 5];
+UIR_DrawCmd cmds[MAX_CMDS];
+
+static double now_us(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec * 1000000.0 + (double)t.tv_nsec / 1000.0;
+}
+
+static size_t resident_kb(const unsigned char *data, size_t size) {
+    static unsigned char pages[1 << 20];
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t count = (size + page_size - 1) / page_size;
+    if (count > sizeof(pages) || mincore((void*)(uintptr_t)data, size, pages) != 0)
+        return 0;
+    size_t resident = 0;
+    for (size_t i = 0; i < count; ++i)
+        resident += pages[i] & 1;
+    return resident * page_size / 1024;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: tiled file [image_size]\n");
+        return 1;
+    }
+    uint32_t side = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 4096;
+
+    {
+        uint8_t *pixels = malloc((size_t)side * side * 4);
+        FILE *file = fopen(argv[1], "wb");
+        if (!pixels || !file) {
+            printf("can't write %s\n", argv[1]);
+            return 1;
+        }
+        for (uint32_t y = 0; y < side; ++y) {
+            for (uint32_t x = 0; x < side; ++x) {
+                uint8_t *px = &pixels[((size_t)y * side + x) * 4];
+                px[0] = (uint8_t)(x ^ y);
+                px[1] = (uint8_t)(x >> 4);
+                px[2] = (uint8_t)(y >> 4);
+                px[3] = 255;
+            }
+        }
+        bool written = UIR_tiled_image_write(file, pixels, side, side, side * 4, UIR_IMAGE_FORMAT_RGBA, 256);
+        free(pixels);
+        if (fclose(file) != 0 || !written) {
+            printf("can't write %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+        printf("can't open %s\n", argv[1]);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    const unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        printf("can't map %s\n", argv[1]);
+        return 1;
+    }
+    // drop the pages left cached by writing, so residency starts from nothing
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    UIR_TiledImage image;
+    if (!UIR_tiled_image_open(&image, data, size)) {
+        printf("%s isn't a tiled image\n", argv[1]);
+        return 1;
+    }
+    printf("%ux%u, %u levels, %zu KB\n", side, side, image.level_count, size / 1024);
+
+    UIR *uir = UIR_new(W, H, memory, sizeof(memory));
+    if (!uir) {
+        printf("memory too small\n");
+        return 1;
+    }
+
+    UIR_Rect view = { 0, 0, W, H };
+    printf("%8s %8s %10s %8s %8s %12s\n", "frame", "level", "us", "cmds", "redrawn", "resident KB");
+    for (uint32_t frame = 0; frame < 36; ++frame) {
+        // pan diagonally at full size, then zoom out until the whole image fits
+        float zoom = frame < 32 ? 1.f : 1.f / (float)(1u << (frame - 31));
+        float pan = frame < 32 ? (float)frame * (float)(side - W) / 32.f : 0.f;
+        float next_pan = (float)(frame + 1) * (float)(side - W) / 32.f;
+        UIR_Rect rect = { -pan, -pan, -pan + (float)side * zoom, -pan + (float)side * zoom };
+        UIR_Rect next = { -next_pan, -next_pan, -next_pan + (float)side, -next_pan + (float)side };
+
+        double start = now_us();
+        if (frame + 1 < 32)
+            UIR_tiled_image_prefetch(&image, next, view);
+        uint32_t count = UIR_tiled_image_cmds(&image, rect, view, cmds, MAX_CMDS);
+        if (count > MAX_CMDS)
+            count = MAX_CMDS;
+        uint32_t redrawn = UIR_draw(uir, cmds, count);
+        double us = now_us() - start;
+
+        printf("%8u %8u %10.1f %8u %8u %12zu\n",
+            frame, UIR_tiled_image_level(&image, rect), us, count, redrawn, resident_kb(data, size)
+        );
+    }
+
+    munmap((void*)(uintptr_t)data, size);
+    close(fd);
+    return 0;
+}
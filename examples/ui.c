@@ -6,7 +6,7 @@
 #include <stdio.h>
 
 #include "../src/uir.h"
-#include "../vendor/stb_truetype.h"
+#include "../src/uir_glyph.h"
 #include "../vendor/RGFW.h"
 
 #define W 1280
@@ -18,8 +18,9 @@ uint32_t drawcmd_count;
 UIR_DrawCmd drawcmds[256];
 
 unsigned char ttf[1<<20];
-unsigned char bitmap[512*512];
-stbtt_bakedchar chardata[96];
+unsigned char glyph_memory[1<<20];
+stbtt_fontinfo font;
+UIR_GlyphCache *glyphs;
 
 void draw_button(UIR_Rect *rect, float mouse_x, float mouse_y, const char *text) {
     drawcmds[drawcmd_count] = (UIR_DrawCmd) { .shape = {
@@ -44,18 +45,12 @@ void draw_button(UIR_Rect *rect, float mouse_x, float mouse_y, const char *text)
     float x = rect->x0 + 10.f;
     float y = rect->y1 - 15.f;
     for (; *text; text++) {
-        char c = *text;
-        stbtt_aligned_quad q;
-        stbtt_GetBakedQuad(chardata, 512,512, c-32, &x,&y,&q,1);
-
-        drawcmds[drawcmd_count++] = (UIR_DrawCmd) { .image = {
-            .type = UIR_DRAW_IMAGE_A,
-            .tint_colour = { 255, 255, 255, 255 },
-            .rect = { q.x0, q.y0, q.x1, q.y1 },
-            .data = &bitmap[(uint32_t)(q.t0 * 512*512 + q.s0 * 512)],
-            .data_stride = 512,
-            .scale = 1,
-        }};
+        UIR_Glyph *glyph = UIR_glyph_cache_get(glyphs, &font, 32.f, (uint32_t)*text);
+        if (!glyph)
+            continue;
+
+        drawcmds[drawcmd_count++] = UIR_glyph_draw_cmd(glyphs, glyph, x, y, (RGBA) { 255, 255, 255, 255 });
+        x += glyph->advance;
     }
 
     rect->y0 += 60.f;
@@ -64,6 +59,7 @@ void draw_button(UIR_Rect *rect, float mouse_x, float mouse_y, const char *text)
 
 bool draw(UIR *uir, float mouse_x, float mouse_y) {
     drawcmd_count = 0;
+    UIR_glyph_cache_next_frame(glyphs);
 
     UIR_Rect rect = { 20, 20, 200, 70 };
 
@@ -95,7 +91,12 @@ int main(void) {
     // Load font
 
     fread(ttf, 1, 1<<20, fopen("Vera.ttf", "rb"));
-    stbtt_BakeFontBitmap(ttf, 0, 32.f, bitmap, 512,512, 32,96, chardata);
+    stbtt_InitFont(&font, ttf, stbtt_GetFontOffsetForIndex(ttf, 0));
+    glyphs = UIR_glyph_cache_new(512, 512, 256, glyph_memory, sizeof(glyph_memory));
+    if (!glyphs) {
+        printf("err\n");
+        exit(1);
+    }
     
     // --------------------------
     // Setup window
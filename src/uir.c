@@ -5,10 +5,36 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <stddef.h>
+#include <float.h>
 
 #define ALIGN_UP(p, align) (void*)(((uintptr_t)(p) + ((uintptr_t)align) - 1) & ~(((uintptr_t)align) - 1))
 #define ALIGN_DOWN(p, align) (void*)((uintptr_t)(p) & ~((align)-1))
 
+#if defined(__GNUC__)
+    #define UIR_FORCE_INLINE static inline __attribute__((always_inline))
+#else
+    #define UIR_FORCE_INLINE static inline
+#endif
+
+typedef struct UIR_Arena {
+    unsigned char *ptr;
+    unsigned char *end;
+} UIR_Arena;
+
+// Returns NULL if the arena is out of memory.
+static void *UIR_arena_alloc(
+    UIR_Arena *arena,
+    size_t size,
+    size_t align
+) {
+    unsigned char *p = ALIGN_UP(arena->ptr, align);
+    if (p > arena->end || (size_t)(arena->end - p) < size)
+        return NULL;
+    arena->ptr = p + size;
+    return p;
+}
+
 static void UIR_check_tiles_fit(UIR *uir) {
     uint32_t required_tile_count = uir->width_in_tiles * uir->height_in_tiles;
     if (required_tile_count > uir->tile_count)
@@ -50,15 +76,160 @@ static UIR_Hash UIR_hash(
     return h;
 }
 
+// Hashes the stops in use, and none of the unused ones.
+static UIR_Hash UIR_hash_gradient(
+    UIR_Gradient *gradient
+) {
+    uint32_t stop_count = gradient->stop_count < UIR_GRADIENT_MAX_STOPS ? gradient->stop_count : UIR_GRADIENT_MAX_STOPS;
+    UIR_Hash h = UIR_hash((unsigned char*)gradient, offsetof(UIR_Gradient, stop_offsets));
+    h ^= UIR_murmur32_scramble(UIR_hash((unsigned char*)gradient->stop_offsets, stop_count * sizeof(float)));
+    h ^= UIR_hash((unsigned char*)gradient->stop_colours, stop_count * sizeof(RGBA)) * 3;
+    return h;
+}
+
+// Only hashes the fields of the command's type, skipping padding and unused gradient stops.
 static UIR_Hash UIR_hash_draw_cmd(
     UIR_DrawCmd *cmd
 ) {
-    return UIR_hash((unsigned char*)cmd, sizeof(*cmd));
+    switch (cmd->common.type) {
+        case UIR_DRAW_SHAPE_RECT:
+        case UIR_DRAW_SHAPE_CIRCLE: {
+            UIR_DrawCmd_Shape *shape = &cmd->shape;
+            UIR_Hash h = UIR_hash((unsigned char*)shape, offsetof(UIR_DrawCmd_Shape, fill_gradient));
+            if (shape->fill_gradient.type != UIR_GRADIENT_NONE)
+                h ^= UIR_murmur32_scramble(UIR_hash_gradient(&shape->fill_gradient));
+            return h;
+        }
+
+        case UIR_DRAW_IMAGE_A:
+        case UIR_DRAW_IMAGE_RGBA: {
+            UIR_DrawCmd_Image *image = &cmd->image;
+            UIR_Hash h = UIR_hash((unsigned char*)image, offsetof(UIR_DrawCmd_Image, format) + sizeof(image->format));
+            h ^= UIR_murmur32_scramble(UIR_hash((unsigned char*)&image->palette, sizeof(image->palette)));
+            h ^= UIR_murmur32_scramble(UIR_hash((unsigned char*)&image->handle, sizeof(image->handle))) * 3;
+            return h;
+        }
+
+        case UIR_DRAW_SHAPE_SHADOW:
+            return UIR_hash((unsigned char*)&cmd->shadow, sizeof(cmd->shadow));
+
+        case UIR_DRAW_PATH_STROKE:
+        case UIR_DRAW_PATH_FILL: {
+            // Hash the path geometry by value, so pointers can be reused between frames.
+            UIR_DrawCmd_Path *path = &cmd->path;
+            UIR_Hash h = UIR_hash((unsigned char*)path, offsetof(UIR_DrawCmd_Path, points));
+            h ^= UIR_murmur32_scramble(UIR_hash((unsigned char*)path->points, path->point_count * sizeof(UIR_Point)));
+            if (path->verbs)
+                h ^= UIR_hash(path->verbs, path->verb_count);
+            return h;
+        }
+
+        default:
+            return UIR_hash((unsigned char*)&cmd->common, sizeof(cmd->common));
+    }
+}
+
+static inline bool UIR_draw_cmd_is_shape(uint32_t type) {
+    return type == UIR_DRAW_SHAPE_RECT || type == UIR_DRAW_SHAPE_CIRCLE;
+}
+
+static inline bool UIR_draw_cmd_is_image(uint32_t type) {
+    return type == UIR_DRAW_IMAGE_A || type == UIR_DRAW_IMAGE_RGBA;
+}
+
+static inline uint32_t UIR_image_bytes_per_pixel(
+    UIR_DrawCmd_Image *image
+) {
+    if (image->type == UIR_DRAW_IMAGE_A)
+        return 1;
+    switch (image->format) {
+        case UIR_IMAGE_FORMAT_RGB: return 3;
+        case UIR_IMAGE_FORMAT_INDEXED: return 1;
+        default: return 4;
+    }
+}
+
+size_t UIR_image_block_count(
+    uint32_t width,
+    uint32_t height
+) {
+    size_t blocks_x = (width + UIR_IMAGE_BLOCK_SIZE - 1) / UIR_IMAGE_BLOCK_SIZE;
+    size_t blocks_y = (height + UIR_IMAGE_BLOCK_SIZE - 1) / UIR_IMAGE_BLOCK_SIZE;
+    return blocks_x * blocks_y;
+}
+
+void UIR_image_init(
+    UIR_Image *image,
+    uint8_t *data,
+    uint32_t data_stride,
+    uint32_t width,
+    uint32_t height,
+    uint32_t *block_generations
+) {
+    *image = (UIR_Image) {
+        .data = data,
+        .data_stride = data_stride,
+        .width = width,
+        .height = height,
+        .block_generations = block_generations,
+    };
+
+    if (block_generations)
+        memset(block_generations, 0, UIR_image_block_count(width, height) * sizeof(uint32_t));
+}
+
+void UIR_image_mark_dirty(
+    UIR_Image *image,
+    uint32_t x0,
+    uint32_t y0,
+    uint32_t x1,
+    uint32_t y1
+) {
+    image->generation++;
+    if (!image->block_generations)
+        return;
+
+    x1 = x1 < image->width ? x1 : image->width;
+    y1 = y1 < image->height ? y1 : image->height;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    uint32_t blocks_x = (image->width + UIR_IMAGE_BLOCK_SIZE - 1) / UIR_IMAGE_BLOCK_SIZE;
+    uint32_t bx0 = x0 / UIR_IMAGE_BLOCK_SIZE;
+    uint32_t by0 = y0 / UIR_IMAGE_BLOCK_SIZE;
+    uint32_t bx1 = (x1 + UIR_IMAGE_BLOCK_SIZE - 1) / UIR_IMAGE_BLOCK_SIZE;
+    uint32_t by1 = (y1 + UIR_IMAGE_BLOCK_SIZE - 1) / UIR_IMAGE_BLOCK_SIZE;
+    for (uint32_t by = by0; by < by1; ++by)
+        for (uint32_t bx = bx0; bx < bx1; ++bx)
+            image->block_generations[by * blocks_x + bx] = image->generation;
+}
+
+// A viewport that starts part way into a tile straddles one more tile.
+static uint32_t UIR_virtual_grid_size(uint32_t size_in_px) {
+    return size_in_px ? (size_in_px + 2*UIR_TILE_SIZE - 2) / UIR_TILE_SIZE : 0;
+}
+
+static size_t UIR_stored_tile_size(
+    uint32_t tile_format
+) {
+    switch (tile_format) {
+        case UIR_TILE_FORMAT_L8: return UIR_TILE_SIZE * UIR_TILE_SIZE;
+        case UIR_TILE_FORMAT_MONO: return UIR_TILE_SIZE * UIR_TILE_SIZE / 8;
+        default: return sizeof(UIR_Tile);
+    }
 }
 
 size_t UIR_minimum_memory_size(
     uint32_t width_in_px,
     uint32_t height_in_px
+) {
+    return UIR_packed_memory_size(width_in_px, height_in_px, UIR_TILE_FORMAT_RGBA);
+}
+
+size_t UIR_packed_memory_size(
+    uint32_t width_in_px,
+    uint32_t height_in_px,
+    uint32_t tile_format
 ) {
     uint32_t width_in_tiles = (width_in_px + UIR_TILE_SIZE - 1) / UIR_TILE_SIZE;
     uint32_t height_in_tiles = (height_in_px + UIR_TILE_SIZE - 1) / UIR_TILE_SIZE;
@@ -66,7 +237,7 @@ size_t UIR_minimum_memory_size(
 
     return sizeof(UIR) * 2 // double to ensure we can align UIR upwards
         + sizeof(UIR_TileInfo) // add to ensure we can align UIR_TileInfo upwards
-        + (size_t)tile_count * (sizeof(UIR_Tile) + sizeof(UIR_TileInfo));
+        + (size_t)tile_count * (UIR_stored_tile_size(tile_format) + sizeof(UIR_TileInfo));
 }
 
 UIR *UIR_new(
@@ -74,6 +245,16 @@ UIR *UIR_new(
     uint32_t height_in_px,
     unsigned char *memory,
     size_t memory_size
+) {
+    return UIR_new_packed(width_in_px, height_in_px, UIR_TILE_FORMAT_RGBA, memory, memory_size);
+}
+
+UIR *UIR_new_packed(
+    uint32_t width_in_px,
+    uint32_t height_in_px,
+    uint32_t tile_format,
+    unsigned char *memory,
+    size_t memory_size
 ) {
     unsigned char *memory_end = memory + memory_size;
 
@@ -96,12 +277,18 @@ UIR *UIR_new(
     unsigned char *memory_left = ALIGN_UP(uir_addr + sizeof(UIR), alignof(UIR_TileInfo));
     size_t memory_size_left = (size_t)(memory_end - memory_left);
 
-    size_t tile_total_size = sizeof(UIR_TileInfo) + sizeof(UIR_Tile);
+    size_t tile_total_size = sizeof(UIR_TileInfo) + UIR_stored_tile_size(tile_format);
     uir->tile_count = (uint32_t)(memory_size_left / tile_total_size);
 
     uir->tile_info = (UIR_TileInfo*)memory_left;
     memory_left += sizeof(UIR_TileInfo) * (size_t)uir->tile_count;
-    uir->tiles = (UIR_Tile*)memory_left;
+    if (tile_format == UIR_TILE_FORMAT_RGBA) {
+        uir->tiles = (UIR_Tile*)memory_left;
+    } else {
+        uir->tile_format = tile_format;
+        uir->packed_tile_size = (uint32_t)UIR_stored_tile_size(tile_format);
+        uir->packed_tiles = memory_left;
+    }
     
     // ---------------------------
     // resize
@@ -120,14 +307,273 @@ bool UIR_resize(
 
     uir->width_in_px = width_in_px;
     uir->height_in_px = height_in_px;
-    uir->width_in_tiles = (width_in_px + UIR_TILE_SIZE - 1) / UIR_TILE_SIZE;
-    uir->height_in_tiles = (height_in_px + UIR_TILE_SIZE - 1) / UIR_TILE_SIZE;
+    if (changed)
+        uir->layout_generation = uir->generation + 1;
+    if (uir->tile_slots) {
+        uir->width_in_tiles = UIR_virtual_grid_size(width_in_px);
+        uir->height_in_tiles = UIR_virtual_grid_size(height_in_px);
+        if (changed)
+            uir->tile_slots_valid = false;
+    } else {
+        uir->width_in_tiles = (width_in_px + UIR_TILE_SIZE - 1) / UIR_TILE_SIZE;
+        uir->height_in_tiles = (height_in_px + UIR_TILE_SIZE - 1) / UIR_TILE_SIZE;
+    }
 
     UIR_check_tiles_fit(uir);
     
     return changed;
 }
 
+// ------------------------------
+// Virtual canvases
+
+#define UIR_NO_SLOT UINT32_MAX
+
+struct UIR_TileSlot {
+    int64_t tile_x, tile_y; // canvas tile held by this slot
+    uint32_t prev, next;    // LRU list, most recently used first
+    bool used;
+};
+
+typedef struct UIR_TileSlot UIR_TileSlot;
+
+static uint32_t UIR_slot_table_size(uint32_t pool_tile_count) {
+    uint32_t size = 2;
+    while (size < pool_tile_count * 2)
+        size *= 2;
+    return size;
+}
+
+static size_t UIR_virtual_pool_size(uint32_t pool_tile_count, uint32_t table_size) {
+    return (size_t)pool_tile_count * (sizeof(UIR_TileSlot) + sizeof(UIR_TileInfo) + sizeof(uint32_t) + sizeof(UIR_Tile))
+        + (size_t)table_size * sizeof(uint32_t);
+}
+
+size_t UIR_virtual_memory_size(
+    uint32_t viewport_width_in_px,
+    uint32_t viewport_height_in_px,
+    uint32_t pool_tile_count
+) {
+    uint32_t grid_tile_count = UIR_virtual_grid_size(viewport_width_in_px) * UIR_virtual_grid_size(viewport_height_in_px);
+    if (pool_tile_count < grid_tile_count)
+        pool_tile_count = grid_tile_count;
+
+    return sizeof(UIR) * 2 // double to ensure we can align UIR upwards
+        + alignof(UIR_TileSlot) // add to ensure we can align the slots upwards
+        + UIR_virtual_pool_size(pool_tile_count, UIR_slot_table_size(pool_tile_count));
+}
+
+UIR *UIR_new_virtual(
+    uint32_t viewport_width_in_px,
+    uint32_t viewport_height_in_px,
+    unsigned char *memory,
+    size_t memory_size
+) {
+    unsigned char *memory_end = memory + memory_size;
+
+    // -----------------------------
+    // allocate UIR at start of memory
+
+    unsigned char *uir_addr = ALIGN_UP(memory, alignof(UIR));
+    if (uir_addr + sizeof(UIR) > memory_end)
+        return NULL;
+
+    UIR *uir = (UIR*)uir_addr;
+    *uir = (UIR) {
+        .memory = memory,
+        .memory_size = memory_size,
+    };
+
+    // ----------------------------
+    // size the pool. The table rounds up to a power of two, so try the two sizes around a first guess
+
+    unsigned char *memory_left = ALIGN_UP(uir_addr + sizeof(UIR), alignof(UIR_TileSlot));
+    size_t memory_size_left = memory_left < memory_end ? (size_t)(memory_end - memory_left) : 0;
+
+    size_t slot_size = sizeof(UIR_TileSlot) + sizeof(UIR_TileInfo) + sizeof(uint32_t) + sizeof(UIR_Tile);
+    size_t guess = memory_size_left / (slot_size + 2 * sizeof(uint32_t));
+    uint32_t table_size = UIR_slot_table_size((uint32_t)(guess < UINT32_MAX / 4 ? guess : UINT32_MAX / 4));
+
+    uint32_t pool_tile_count = 0;
+    for (uint32_t candidate = table_size; candidate >= table_size / 2 && candidate >= 2; candidate /= 2) {
+        size_t table_bytes = (size_t)candidate * sizeof(uint32_t);
+        if (table_bytes > memory_size_left)
+            continue;
+        size_t count = (memory_size_left - table_bytes) / slot_size;
+        if (count > candidate / 2)
+            count = candidate / 2;
+        if (count > pool_tile_count) {
+            pool_tile_count = (uint32_t)count;
+            uir->slot_table_mask = candidate - 1;
+        }
+    }
+
+    // ----------------------------
+    // split memory between slots, tile hashes, the grid, the table and tiles
+
+    uir->tile_count = pool_tile_count;
+    uir->slots = (UIR_TileSlot*)memory_left;
+    memory_left += sizeof(UIR_TileSlot) * (size_t)pool_tile_count;
+    uir->tile_info = (UIR_TileInfo*)memory_left;
+    memory_left += sizeof(UIR_TileInfo) * (size_t)pool_tile_count;
+    uir->tile_slots = (uint32_t*)memory_left;
+    memory_left += sizeof(uint32_t) * (size_t)pool_tile_count;
+    uir->slot_table = (uint32_t*)memory_left;
+    memory_left += sizeof(uint32_t) * (size_t)(pool_tile_count ? uir->slot_table_mask + 1 : 0);
+    uir->tiles = (UIR_Tile*)memory_left;
+
+    // every slot starts free, in one LRU list
+    for (uint32_t i = 0; i < pool_tile_count; ++i) {
+        uir->slots[i] = (UIR_TileSlot) {
+            .prev = i ? i - 1 : UIR_NO_SLOT,
+            .next = i + 1 < pool_tile_count ? i + 1 : UIR_NO_SLOT,
+        };
+    }
+    uir->lru_head = pool_tile_count ? 0 : UIR_NO_SLOT;
+    uir->lru_tail = pool_tile_count ? pool_tile_count - 1 : UIR_NO_SLOT;
+
+    // ---------------------------
+    // resize
+
+    UIR_resize(uir, viewport_width_in_px, viewport_height_in_px);
+
+    return uir;
+}
+
+// Floors, unlike integer division.
+static int64_t UIR_canvas_tile(int64_t px) {
+    return px >= 0 ? px / UIR_TILE_SIZE : -((-(px + 1)) / UIR_TILE_SIZE) - 1;
+}
+
+static void UIR_update_grid(UIR *uir) {
+    uir->grid_x = (float)(uir->grid_tile_x * UIR_TILE_SIZE - uir->anchor_x);
+    uir->grid_y = (float)(uir->grid_tile_y * UIR_TILE_SIZE - uir->anchor_y);
+}
+
+void UIR_set_viewport(
+    UIR *uir,
+    int64_t x,
+    int64_t y
+) {
+    int64_t grid_tile_x = UIR_canvas_tile(x);
+    int64_t grid_tile_y = UIR_canvas_tile(y);
+    if (grid_tile_x != uir->grid_tile_x || grid_tile_y != uir->grid_tile_y) {
+        uir->tile_slots_valid = false;
+        uir->layout_generation = uir->generation + 1;
+    }
+
+    uir->viewport_x = x;
+    uir->viewport_y = y;
+    uir->grid_tile_x = grid_tile_x;
+    uir->grid_tile_y = grid_tile_y;
+    uir->scroll_x = (uint32_t)(x - grid_tile_x * UIR_TILE_SIZE);
+    uir->scroll_y = (uint32_t)(y - grid_tile_y * UIR_TILE_SIZE);
+    UIR_update_grid(uir);
+}
+
+void UIR_set_anchor(
+    UIR *uir,
+    int64_t x,
+    int64_t y
+) {
+    uir->anchor_x = x;
+    uir->anchor_y = y;
+    UIR_update_grid(uir);
+}
+
+static uint32_t UIR_slot_home(UIR *uir, int64_t tile_x, int64_t tile_y) {
+    uint64_t h = (uint64_t)tile_x * 0x9e3779b97f4a7c15ull ^ (uint64_t)tile_y * 0xc2b2ae3d27d4eb4full;
+    return (uint32_t)(h ^ (h >> 32)) & uir->slot_table_mask;
+}
+
+// Returns the table position holding the slot for this canvas tile, or the empty position it would go in.
+static uint32_t UIR_slot_find(UIR *uir, int64_t tile_x, int64_t tile_y) {
+    uint32_t i = UIR_slot_home(uir, tile_x, tile_y);
+    while (uir->slot_table[i]) {
+        UIR_TileSlot *slot = &uir->slots[uir->slot_table[i] - 1];
+        if (slot->tile_x == tile_x && slot->tile_y == tile_y)
+            break;
+        i = (i + 1) & uir->slot_table_mask;
+    }
+    return i;
+}
+
+// Backward shift deletion keeps probe sequences unbroken without tombstones.
+static void UIR_slot_table_remove(UIR *uir, uint32_t i) {
+    uint32_t mask = uir->slot_table_mask;
+    for (uint32_t j = (i + 1) & mask; uir->slot_table[j]; j = (j + 1) & mask) {
+        UIR_TileSlot *slot = &uir->slots[uir->slot_table[j] - 1];
+        uint32_t home = UIR_slot_home(uir, slot->tile_x, slot->tile_y);
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            uir->slot_table[i] = uir->slot_table[j];
+            i = j;
+        }
+    }
+    uir->slot_table[i] = 0;
+}
+
+static void UIR_slot_touch(UIR *uir, uint32_t s) {
+    if (uir->lru_head == s)
+        return;
+
+    UIR_TileSlot *slot = &uir->slots[s];
+    uir->slots[slot->prev].next = slot->next;
+    if (slot->next != UIR_NO_SLOT)
+        uir->slots[slot->next].prev = slot->prev;
+    else
+        uir->lru_tail = slot->prev;
+
+    slot->prev = UIR_NO_SLOT;
+    slot->next = uir->lru_head;
+    uir->slots[uir->lru_head].prev = s;
+    uir->lru_head = s;
+}
+
+// Points every grid tile at the slot holding its canvas tile, evicting the least recently used
+// slots for tiles that are not in the pool. Returns false if the pool can't cover the grid.
+static bool UIR_virtual_map_tiles(UIR *uir) {
+    if (uir->tile_slots_valid)
+        return true;
+    if (uir->width_in_tiles * uir->height_in_tiles > uir->tile_count)
+        return false;
+
+    for (uint32_t y = 0; y < uir->height_in_tiles; ++y) {
+        for (uint32_t x = 0; x < uir->width_in_tiles; ++x) {
+            int64_t tile_x = uir->grid_tile_x + x;
+            int64_t tile_y = uir->grid_tile_y + y;
+
+            uint32_t i = UIR_slot_find(uir, tile_x, tile_y);
+            uint32_t s = uir->slot_table[i] - 1;
+            if (!uir->slot_table[i]) {
+                // Tiles mapped this frame were moved to the front,
+                // and the pool covers the grid, so the tail is never one of them.
+                s = uir->lru_tail;
+                UIR_TileSlot *slot = &uir->slots[s];
+                if (slot->used)
+                    UIR_slot_table_remove(uir, UIR_slot_find(uir, slot->tile_x, slot->tile_y));
+
+                slot->tile_x = tile_x;
+                slot->tile_y = tile_y;
+                slot->used = true;
+                uir->slot_table[UIR_slot_find(uir, tile_x, tile_y)] = s + 1;
+                uir->tile_info[s] = (UIR_TileInfo) {0};
+            }
+
+            UIR_slot_touch(uir, s);
+            uir->tile_slots[y * uir->width_in_tiles + x] = s;
+        }
+    }
+
+    uir->tile_slots_valid = true;
+    return true;
+}
+
+// Returns the index into tiles and tile_info of a grid tile.
+static inline uint32_t UIR_tile_slot(UIR *uir, uint32_t tile_idx) {
+    return uir->tile_slots ? uir->tile_slots[tile_idx] : tile_idx;
+}
+
 static inline bool UIR_rect_inside(
     UIR_Rect *a,
     UIR_Rect *b
@@ -219,344 +665,3695 @@ static inline void UIR_pick_colour(
     UIR_blend2(dst, outline, fill, outline_factor, fill_factor);
 }
 
-static void UIR_tile_draw_cmd(
-    UIR_Tile tile,
-    UIR_Rect *rect,
-    UIR_DrawCmd *cmd
-) {
-    switch (cmd->common.type) {
-        case UIR_DRAW_SHAPE_RECT: {
-            UIR_DrawCmd_Shape *shape = &cmd->shape;
-        
-            float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
-            float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
+// ------------------------------
+// fixed point
 
-            uint32_t i = 0;
-            for (float y = rect->y0; y < rect->y1; y += 1.f) {
-                for (float x = rect->x0; x < rect->x1; x += 1.f) {
-                    float r = UIR_rounded_rect(
-                        x - (shape->rect.x0 + w2),
-                        y - (shape->rect.y0 + h2),
-                        w2, h2,
-                        shape->corner_radius
-                    );
+#ifdef UIR_FIXED_POINT
 
-                    UIR_pick_colour(&tile[i], shape->outline_colour, shape->fill_colour, shape->outline_radius, r);
+// Coordinates and distances in 24.8 fixed point. Coverage is in the same units: 0 to UIR_FIXED_ONE.
+typedef int32_t UIR_Fixed;
 
-                    i++;
-                }
-            }
-        } break;
-        case UIR_DRAW_SHAPE_CIRCLE: {
-            UIR_DrawCmd_Shape *shape = &cmd->shape;
-        
-            float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
-            float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
-            float radius = UIR_min(w2, h2);
-        
-            uint32_t i = 0;
-            for (float y = rect->y0; y < rect->y1; y += 1.f) {
-                for (float x = rect->x0; x < rect->x1; x += 1.f) {
-                    float r = UIR_circle(
-                        x - (shape->rect.x0 + w2),
-                        y - (shape->rect.y0 + h2),
-                        radius
-                    );
-    
-                    UIR_pick_colour(&tile[i], shape->outline_colour, shape->fill_colour, shape->outline_radius, r);
+#define UIR_FIXED_SHIFT 8
+#define UIR_FIXED_ONE (1 << UIR_FIXED_SHIFT)
 
-                    i++;
-                }
-            }
-        } break;
-        case UIR_DRAW_IMAGE_A: {
-            UIR_DrawCmd_Image *image = &cmd->image;
-            
-            float x0 = UIR_max(image->rect.x0, rect->x0);
-            float y0 = UIR_max(image->rect.y0, rect->y0);
-            float x1 = UIR_min(image->rect.x1, rect->x1);
-            float y1 = UIR_min(image->rect.y1, rect->y1);
-            
-            float w = x1 - x0;
-            float h = y1 - y0;
-            
-            uint32_t tile_x_start = (uint32_t)(x0 - rect->x0);
-            uint32_t tile_y = (uint32_t)(y0 - rect->y0);
-            
-            float image_x_start = x0 - image->rect.x0;
-            float image_y_start = y0 - image->rect.y0;
+static inline UIR_Fixed UIR_to_fixed(float n) { return (UIR_Fixed)floorf(n * (float)UIR_FIXED_ONE + 0.5f); }
+static inline UIR_Fixed UIR_fixed_abs(UIR_Fixed n) { return n < 0 ? -n : n; }
+static inline UIR_Fixed UIR_fixed_min(UIR_Fixed n, UIR_Fixed m) { return n < m ? n : m; }
+static inline UIR_Fixed UIR_fixed_max(UIR_Fixed n, UIR_Fixed m) { return n > m ? n : m; }
+static inline UIR_Fixed UIR_fixed_clamp(UIR_Fixed n, UIR_Fixed min, UIR_Fixed max) { return UIR_fixed_min(UIR_fixed_max(n, min), max); }
 
-            float recip_scale = 1.f / image->scale;
+// Maps 0..255 onto 0..UIR_FIXED_ONE, both ends exactly.
+static inline uint32_t UIR_fixed_from_byte(uint8_t n) { return ((uint32_t)n * 257 + 128) >> 8; }
 
-            for (float y = 0; y < h; y += 1.f) {
-                uint32_t tile_x = tile_x_start;
+// sqrt(n) rounded to nearest, a bit at a time. The square root of a squared 24.8 distance is a
+// 24.8 distance. What is left of n once the root is found is n - root^2, so rounding up is one compare.
+static inline uint32_t UIR_isqrt(uint64_t n) {
+    if (n <= UINT32_MAX) {
+        uint32_t m = (uint32_t)n;
+        uint32_t root = 0;
+        for (uint32_t bit = 1u << 30; bit; bit >>= 2) {
+            if (m >= root + bit) {
+                m -= root + bit;
+                root = (root >> 1) + bit;
+            } else {
+                root >>= 1;
+            }
+        }
+        return root + (m > root);
+    }
 
-                for (float x = 0; x < w; x += 1.f) {
-                    float image_x = (image_x_start + x) * recip_scale;
-                    float image_y = (image_y_start + y) * recip_scale;
-                    
-                    uint32_t image_xi = (uint32_t)image_x;
-                    uint32_t image_yi = (uint32_t)image_y;
-                    uint32_t image_i = image_yi * image->data_stride + image_xi;
+    uint64_t root = 0;
+    for (uint64_t bit = (uint64_t)1 << 62; bit; bit >>= 2) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return (uint32_t)(root + (n > root));
+}
 
-                    uint8_t alpha = image->data[image_i];
-                    float r255 = 0.00392156862745098f;
-                    UIR_blend(&tile[tile_y*UIR_TILE_SIZE + tile_x], image->tint_colour, (float)alpha * r255);
+// 1 - alpha * coverage in 0.16 fixed point. Multiplying by 257/256 stands in for dividing by 255.
+static inline uint32_t UIR_fixed_dst_factor(uint8_t alpha, uint32_t coverage) {
+    return 65536 - ((alpha * coverage * 257 + 128) >> 8);
+}
 
-                    tile_x++;
-                }
+// UIR_blend with coverage in 0..UIR_FIXED_ONE, in multiplies and shifts.
+static inline void UIR_blend_fixed(
+    RGBA *dst,
+    RGBA c,
+    uint32_t coverage
+) {
+    uint32_t dst_factor = UIR_fixed_dst_factor(c.a, coverage);
+    uint32_t c_factor = coverage << 8;
 
-                tile_y++;
-            }
-        } break;
-        case UIR_DRAW_IMAGE_RGBA: {
-            UIR_DrawCmd_Image *image = &cmd->image;
-            
-            float x0 = UIR_max(image->rect.x0, rect->x0);
-            float y0 = UIR_max(image->rect.y0, rect->y0);
-            float x1 = UIR_min(image->rect.x1, rect->x1);
-            float y1 = UIR_min(image->rect.y1, rect->y1);
-            
-            float w = x1 - x0;
-            float h = y1 - y0;
-            
-            uint32_t tile_x_start = (uint32_t)(x0 - rect->x0);
-            uint32_t tile_y = (uint32_t)(y0 - rect->y0);
-            
-            float image_x_start = x0 - image->rect.x0;
-            float image_y_start = y0 - image->rect.y0;
-            
-            float recip_scale = 1.f / image->scale;
-
-            for (float y = 0; y < h; y += 1.f) {
-                uint32_t tile_x = tile_x_start;
-
-                for (float x = 0; x < w; x += 1.f) {
-                    float image_x = (image_x_start + x) * recip_scale;
-                    float image_y = (image_y_start + y) * recip_scale;
-                    
-                    uint32_t image_xi = (uint32_t)image_x;
-                    uint32_t image_yi = (uint32_t)image_y;
-                    uint32_t image_i = image_yi * image->data_stride + image_xi*4;
-
-                    UIR_blend2(
-                        &tile[tile_y*UIR_TILE_SIZE + tile_x],
-                        *(RGBA*)&image->data[image_i],
-                        image->tint_colour,
-                        1.f,
-                        1.f
-                    );
+    dst->r = (uint8_t)((c.r * c_factor + dst->r * dst_factor) >> 16);
+    dst->g = (uint8_t)((c.g * c_factor + dst->g * dst_factor) >> 16);
+    dst->b = (uint8_t)((c.b * c_factor + dst->b * dst_factor) >> 16);
+    dst->a = (uint8_t)((c.a * c_factor + dst->a * dst_factor) >> 16);
+}
 
-                    tile_x++;
-                }
+// The first blend keeps 8 more bits, so that only the result is truncated, as in UIR_blend2.
+static inline void UIR_blend2_fixed(
+    RGBA *dst,
+    RGBA c1,
+    RGBA c2,
+    uint32_t c1_coverage,
+    uint32_t c2_coverage
+) {
+    uint32_t dst_factor_1 = UIR_fixed_dst_factor(c1.a, c1_coverage);
+    uint32_t dst_factor_2 = UIR_fixed_dst_factor(c2.a, c2_coverage);
+    uint32_t c1_factor = c1_coverage << 8;
+    uint32_t c2_factor = c2_coverage << 16;
 
-                tile_y++;
-            }
-        } break;
-    }
+    dst->r = (uint8_t)((c2.r * c2_factor + ((c1.r * c1_factor + dst->r * dst_factor_1) >> 8) * dst_factor_2) >> 24);
+    dst->g = (uint8_t)((c2.g * c2_factor + ((c1.g * c1_factor + dst->g * dst_factor_1) >> 8) * dst_factor_2) >> 24);
+    dst->b = (uint8_t)((c2.b * c2_factor + ((c1.b * c1_factor + dst->b * dst_factor_1) >> 8) * dst_factor_2) >> 24);
+    dst->a = (uint8_t)((c2.a * c2_factor + ((c1.a * c1_factor + dst->a * dst_factor_1) >> 8) * dst_factor_2) >> 24);
 }
 
-static void UIR_fill_tile(
-    UIR_Tile tile,
-    RGBA colour
+// UIR_rounded_rect, with a square root only in the corners.
+static inline UIR_Fixed UIR_rounded_rect_fixed(
+    UIR_Fixed px, UIR_Fixed py,
+    UIR_Fixed bx, UIR_Fixed by,
+    UIR_Fixed r
 ) {
-    // Loop is manually unrolled for better codegen. It's equivalent to this code:
-    // for (uint32_t i = 0; i < UIR_TILE_SIZE*UIR_TILE_SIZE; ++i)
-    //     memcpy(&uir->tiles[tile_idx][i], &uir->clear_colour, 4);
+    UIR_Fixed qx = UIR_fixed_abs(px) - bx + r;
+    UIR_Fixed qy = UIR_fixed_abs(py) - by + r;
+    UIR_Fixed outside = qx > 0 && qy > 0
+        ? (UIR_Fixed)UIR_isqrt((uint64_t)((int64_t)qx*qx) + (uint64_t)((int64_t)qy*qy))
+        : UIR_fixed_max(UIR_fixed_max(qx, qy), 0);
+    return UIR_fixed_min(UIR_fixed_max(qx, qy), 0) + outside - r;
+}
 
-    RGBA colour_x4[4] = { colour, colour, colour, colour };
+#endif
+
+// The blends of the build's profile: float, or with UIR_FIXED_POINT, fixed point unless reference
+// is set, as UIR_DEBUG_REFERENCE always draws with the float pipeline.
+static inline void UIR_blend_full(
+    RGBA *dst,
+    RGBA c,
+    bool reference
+) {
+#ifdef UIR_FIXED_POINT
+    if (!reference) {
+        UIR_blend_fixed(dst, c, UIR_FIXED_ONE);
+        return;
+    }
+#else
+    (void)reference;
+#endif
+    UIR_blend(dst, c, 1.f);
+}
+
+static inline void UIR_blend2_full(
+    RGBA *dst,
+    RGBA c1,
+    RGBA c2,
+    bool reference
+) {
+#ifdef UIR_FIXED_POINT
+    if (!reference) {
+        UIR_blend2_fixed(dst, c1, c2, UIR_FIXED_ONE, UIR_FIXED_ONE);
+        return;
+    }
+#else
+    (void)reference;
+#endif
+    UIR_blend2(dst, c1, c2, 1.f, 1.f);
+}
+
+// Coverage alpha / 255, as image alpha is.
+static inline void UIR_blend_byte(
+    RGBA *dst,
+    RGBA c,
+    uint8_t alpha,
+    bool reference
+) {
+#ifdef UIR_FIXED_POINT
+    if (!reference) {
+        UIR_blend_fixed(dst, c, UIR_fixed_from_byte(alpha));
+        return;
+    }
+#else
+    (void)reference;
+#endif
+    float r255 = 0.00392156862745098f;
+    UIR_blend(dst, c, (float)alpha * r255);
+}
+
+// ------------------------------
+// shadows
+
+// Approximates erf(x) with a maximum error of 5e-4.
+static inline float UIR_erf(float x) {
+    float s = x < 0.f ? -1.f : 1.f;
+    float a = UIR_abs(x);
+    float t = 1.f + (0.278393f + (0.230389f + 0.078108f * (a * a)) * a) * a;
+    t *= t;
+    return s - s / (t * t);
+}
+
+// Fraction of a gaussian centred on x that falls within [-half_size, half_size].
+static inline float UIR_shadow_span(float x, float half_size, float k) {
+    return 0.5f * (UIR_erf((x + half_size) * k) - UIR_erf((x - half_size) * k));
+}
+
+// Shadows are sampled out to this many standard deviations.
+#define UIR_SHADOW_EXTENT 3.f
+
+// Closed form blurred rounded rect, after Evan Wallace's "Fast Rounded Rectangle Shadows".
+// Sharp rects are exactly separable. Rounded rects integrate the blur along y with 4 samples,
+// whose positions and weights only depend on the row, so per pixel only erf remains.
+static void UIR_tile_draw_shadow(
+    UIR_Tile tile,
+    UIR_Rect *rect,
+    UIR_DrawCmd_Shadow *shadow
+) {
+    float sigma = UIR_max(shadow->blur_radius, 0.01f);
+    float k = 0.70710678f / sigma;
+
+    float hw = (shadow->shape_rect.x1 - shadow->shape_rect.x0) * 0.5f;
+    float hh = (shadow->shape_rect.y1 - shadow->shape_rect.y0) * 0.5f;
+    float cx = shadow->shape_rect.x0 + hw;
+    float cy = shadow->shape_rect.y0 + hh;
+    float corner = UIR_clamp(shadow->corner_radius, 0, UIR_min(hw, hh));
+
+    float xs[UIR_TILE_SIZE];
+    for (uint32_t px = 0; px < UIR_TILE_SIZE; ++px)
+        xs[px] = rect->x0 + (float)px + 0.5f - cx;
+
+    float values[UIR_TILE_SIZE*UIR_TILE_SIZE];
+
+    if (corner == 0.f) {
+        float fx[UIR_TILE_SIZE];
+        for (uint32_t px = 0; px < UIR_TILE_SIZE; ++px)
+            fx[px] = UIR_shadow_span(xs[px], hw, k);
+
+        for (uint32_t py = 0; py < UIR_TILE_SIZE; ++py) {
+            float y = rect->y0 + (float)py + 0.5f - cy;
+            float fy = UIR_shadow_span(y, hh, k);
+            for (uint32_t px = 0; px < UIR_TILE_SIZE; ++px)
+                values[py*UIR_TILE_SIZE + px] = fx[px] * fy;
+        }
+    } else {
+        // Normalise the sample weights so that the saturated interior reaches 1.
+        float extent = UIR_SHADOW_EXTENT * sigma;
+        float full_step = extent * 0.5f;
+        float weight_sum = 0.f;
+        for (uint32_t s = 0; s < 4; ++s) {
+            float y = -extent + full_step * ((float)s + 0.5f);
+            weight_sum += expf(-(y * y) / (2.f * sigma * sigma)) * full_step;
+        }
+        float recip_weight_sum = 1.f / weight_sum;
+
+        for (uint32_t py = 0; py < UIR_TILE_SIZE; ++py) {
+            float y = rect->y0 + (float)py + 0.5f - cy;
+
+            float start = UIR_clamp(-extent, y - hh, y + hh);
+            float end = UIR_clamp(extent, y - hh, y + hh);
+            float step = (end - start) * 0.25f;
+
+            float curved[4];
+            float weights[4];
+            for (uint32_t s = 0; s < 4; ++s) {
+                float sample = start + step * ((float)s + 0.5f);
+                float delta = UIR_min(hh - corner - UIR_abs(y - sample), 0);
+                curved[s] = hw - corner + sqrtf(UIR_max(0, corner * corner - delta * delta));
+                weights[s] = expf(-(sample * sample) / (2.f * sigma * sigma)) * step * recip_weight_sum;
+            }
+
+            for (uint32_t px = 0; px < UIR_TILE_SIZE; ++px) {
+                float value = 0.f;
+                for (uint32_t s = 0; s < 4; ++s)
+                    value += UIR_shadow_span(xs[px], curved[s], k) * weights[s];
+                values[py*UIR_TILE_SIZE + px] = value;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < UIR_TILE_SIZE*UIR_TILE_SIZE; ++i) {
+        // Snap the saturated interior, so it matches the solid fill fast path exactly.
+        float value = values[i];
+        if (value >= 0.998f)
+            value = 1.f;
+        if (value > 0.002f)
+            UIR_blend(&tile[i], shadow->colour, value);
+    }
+}
+
+// ------------------------------
+// gradients
+
+static RGBA UIR_gradient_colour(
+    UIR_Gradient *gradient,
+    float t
+) {
+    // clamped as UIR_hash_gradient clamps it, so only hashed stops are shaded
+    uint32_t stop_count = gradient->stop_count < UIR_GRADIENT_MAX_STOPS ? gradient->stop_count : UIR_GRADIENT_MAX_STOPS;
+    uint32_t last = stop_count - 1;
+    if (stop_count == 0)
+        return (RGBA) { 0 };
+    if (t <= gradient->stop_offsets[0])
+        return gradient->stop_colours[0];
+    if (t >= gradient->stop_offsets[last])
+        return gradient->stop_colours[last];
+
+    uint32_t i = 1;
+    while (t > gradient->stop_offsets[i])
+        i++;
+
+    float o0 = gradient->stop_offsets[i-1];
+    float o1 = gradient->stop_offsets[i];
+    float f = (t - o0) / (o1 - o0);
+    RGBA c0 = gradient->stop_colours[i-1];
+    RGBA c1 = gradient->stop_colours[i];
+
+    return (RGBA) {
+        (uint8_t)((float)c0.r + ((float)c1.r - (float)c0.r) * f + 0.5f),
+        (uint8_t)((float)c0.g + ((float)c1.g - (float)c0.g) * f + 0.5f),
+        (uint8_t)((float)c0.b + ((float)c1.b - (float)c0.b) * f + 0.5f),
+        (uint8_t)((float)c0.a + ((float)c1.a - (float)c0.a) * f + 0.5f),
+    };
+}
+
+// Evaluates the gradient at the pixel centres of one tile row.
+static void UIR_gradient_row(
+    UIR_Gradient *gradient,
+    float x0,
+    float y,
+    RGBA *colours
+) {
+    float t[UIR_TILE_SIZE];
+    float dx = gradient->p1.x - gradient->p0.x;
+    float dy = gradient->p1.y - gradient->p0.y;
+    float py = y + 0.5f - gradient->p0.y;
+    float px0 = x0 + 0.5f - gradient->p0.x;
+
+    if (gradient->type == UIR_GRADIENT_LINEAR) {
+        float len_sq = dx*dx + dy*dy;
+        float recip_len_sq = len_sq > 0.f ? 1.f / len_sq : 0.f;
+        for (uint32_t i = 0; i < UIR_TILE_SIZE; ++i)
+            t[i] = ((px0 + (float)i) * dx + py * dy) * recip_len_sq;
+    } else {
+        float radius = UIR_length(dx, dy);
+        float recip_radius = radius > 0.f ? 1.f / radius : 0.f;
+        for (uint32_t i = 0; i < UIR_TILE_SIZE; ++i)
+            t[i] = UIR_length(px0 + (float)i, py) * recip_radius;
+    }
+
+    for (uint32_t i = 0; i < UIR_TILE_SIZE; ++i)
+        colours[i] = UIR_gradient_colour(gradient, t[i]);
+}
+
+// ------------------------------
+// paths
+
+typedef struct UIR_PathIter {
+    UIR_DrawCmd_Path *path;
+    UIR_Rect cull; // curves whose hull misses this rect are emitted as a single chord
+    bool close_subpaths;
+    uint32_t verb_i;
+    uint32_t point_i;
+    UIR_Point pen;
+    UIR_Point subpath_start;
+
+    // flattening state of the current curve
+    UIR_Point curve[4];
+    uint32_t curve_order;
+    uint32_t step;
+    uint32_t steps;
+} UIR_PathIter;
+
+#define UIR_PATH_END 0xFFu
+#define UIR_PATH_MAX_CURVE_STEPS 64
+
+static UIR_PathIter UIR_path_iter(
+    UIR_DrawCmd_Path *path,
+    UIR_Rect cull,
+    bool close_subpaths
+) {
+    return (UIR_PathIter) {
+        .path = path,
+        .cull = cull,
+        .close_subpaths = close_subpaths,
+    };
+}
+
+static uint32_t UIR_path_peek_verb(UIR_PathIter *it) {
+    UIR_DrawCmd_Path *path = it->path;
+
+    uint32_t verb;
+    if (path->verbs) {
+        if (it->verb_i >= path->verb_count)
+            return UIR_PATH_END;
+        verb = path->verbs[it->verb_i];
+    } else {
+        verb = it->point_i == 0 ? UIR_PATH_MOVE : UIR_PATH_LINE;
+    }
+
+    uint32_t needed = 0;
+    switch (verb) {
+        case UIR_PATH_MOVE: needed = 1; break;
+        case UIR_PATH_LINE: needed = 1; break;
+        case UIR_PATH_QUAD: needed = 2; break;
+        case UIR_PATH_CUBIC: needed = 3; break;
+        case UIR_PATH_CLOSE: needed = 0; break;
+        default: return UIR_PATH_END;
+    }
+
+    if (it->point_i + needed > path->point_count)
+        return UIR_PATH_END;
+    return verb;
+}
+
+static UIR_Point UIR_curve_eval(
+    UIR_Point *p,
+    uint32_t order,
+    float t
+) {
+    float s = 1.f - t;
+    if (order == 2) {
+        float w0 = s*s, w1 = 2.f*s*t, w2 = t*t;
+        return (UIR_Point) {
+            w0*p[0].x + w1*p[1].x + w2*p[2].x,
+            w0*p[0].y + w1*p[1].y + w2*p[2].y,
+        };
+    } else {
+        float w0 = s*s*s, w1 = 3.f*s*s*t, w2 = 3.f*s*t*t, w3 = t*t*t;
+        return (UIR_Point) {
+            w0*p[0].x + w1*p[1].x + w2*p[2].x + w3*p[3].x,
+            w0*p[0].y + w1*p[1].y + w2*p[2].y + w3*p[3].y,
+        };
+    }
+}
+
+// Number of line segments needed to flatten a curve to within ~0.25px.
+static uint32_t UIR_curve_steps(
+    UIR_Point *p,
+    uint32_t order
+) {
+    float dd;
+    if (order == 2) {
+        dd = UIR_length(p[0].x - 2.f*p[1].x + p[2].x, p[0].y - 2.f*p[1].y + p[2].y) * 2.f;
+    } else {
+        float dd0 = UIR_length(p[0].x - 2.f*p[1].x + p[2].x, p[0].y - 2.f*p[1].y + p[2].y);
+        float dd1 = UIR_length(p[1].x - 2.f*p[2].x + p[3].x, p[1].y - 2.f*p[2].y + p[3].y);
+        dd = UIR_max(dd0, dd1) * 3.f;
+    }
+    float steps = UIR_clamp(ceilf(sqrtf(dd)), 1.f, UIR_PATH_MAX_CURVE_STEPS);
+    return (uint32_t)steps;
+}
+
+// Returns the next line segment of the path, flattening curves as needed.
+static bool UIR_path_next(
+    UIR_PathIter *it,
+    UIR_Point *a,
+    UIR_Point *b
+) {
+    UIR_DrawCmd_Path *path = it->path;
+
+    for (;;) {
+        if (it->step < it->steps) {
+            it->step++;
+            *a = it->pen;
+            *b = it->step == it->steps
+                ? it->curve[it->curve_order]
+                : UIR_curve_eval(it->curve, it->curve_order, (float)it->step / (float)it->steps);
+            it->pen = *b;
+            return true;
+        }
+
+        uint32_t verb = UIR_path_peek_verb(it);
+
+        bool ends_subpath = verb == UIR_PATH_MOVE || verb == UIR_PATH_CLOSE || verb == UIR_PATH_END;
+        bool is_open = it->pen.x != it->subpath_start.x || it->pen.y != it->subpath_start.y;
+        if (ends_subpath && is_open && (it->close_subpaths || verb == UIR_PATH_CLOSE)) {
+            *a = it->pen;
+            *b = it->subpath_start;
+            it->pen = it->subpath_start;
+            return true;
+        }
+
+        if (verb == UIR_PATH_END)
+            return false;
+        if (path->verbs)
+            it->verb_i++;
+
+        UIR_Point *p = &path->points[it->point_i];
+        switch (verb) {
+            case UIR_PATH_MOVE: {
+                it->point_i += 1;
+                it->pen = p[0];
+                it->subpath_start = p[0];
+            } break;
+
+            case UIR_PATH_LINE: {
+                it->point_i += 1;
+                *a = it->pen;
+                *b = p[0];
+                it->pen = p[0];
+                return true;
+            }
+
+            case UIR_PATH_QUAD:
+            case UIR_PATH_CUBIC: {
+                uint32_t order = verb == UIR_PATH_QUAD ? 2 : 3;
+                it->point_i += order;
+
+                it->curve[0] = it->pen;
+                UIR_Rect hull = { it->pen.x, it->pen.y, it->pen.x, it->pen.y };
+                for (uint32_t i = 0; i < order; ++i) {
+                    it->curve[i+1] = p[i];
+                    hull.x0 = UIR_min(hull.x0, p[i].x);
+                    hull.y0 = UIR_min(hull.y0, p[i].y);
+                    hull.x1 = UIR_max(hull.x1, p[i].x);
+                    hull.y1 = UIR_max(hull.y1, p[i].y);
+                }
+                it->curve_order = order;
+
+                // A curve that cannot touch the cull rect has the same effect as its chord.
+                bool touches = hull.x0 <= it->cull.x1 && it->cull.x0 <= hull.x1
+                    && hull.y0 <= it->cull.y1 && it->cull.y0 <= hull.y1;
+                it->steps = touches ? UIR_curve_steps(it->curve, order) : 1;
+                it->step = 0;
+            } break;
+
+            case UIR_PATH_CLOSE:
+                break;
+        }
+    }
+}
+
+static UIR_Rect UIR_path_bounds(
+    UIR_DrawCmd_Path *path
+) {
+    if (path->point_count == 0)
+        return (UIR_Rect) { 0 };
+
+    UIR_Rect bb = { path->points[0].x, path->points[0].y, path->points[0].x, path->points[0].y };
+    for (uint32_t i = 1; i < path->point_count; ++i) {
+        UIR_Point p = path->points[i];
+        bb.x0 = UIR_min(bb.x0, p.x);
+        bb.y0 = UIR_min(bb.y0, p.y);
+        bb.x1 = UIR_max(bb.x1, p.x);
+        bb.y1 = UIR_max(bb.y1, p.y);
+    }
+
+    if (path->type == UIR_DRAW_PATH_STROKE) {
+        float reach = path->stroke_width * 0.5f + 1.f;
+        bb.x0 -= reach;
+        bb.y0 -= reach;
+        bb.x1 += reach;
+        bb.y1 += reach;
+    }
+
+    return bb;
+}
+
+#define UIR_ACC_STRIDE (UIR_TILE_SIZE + 1)
+
+// Accumulates the signed area of a line into acc, in the style of font-rs.
+// Points are tile-local and must lie within [0, UIR_TILE_SIZE].
+static void UIR_fill_accumulate_line(
+    float *acc,
+    UIR_Point p0,
+    UIR_Point p1
+) {
+    if (p0.y == p1.y)
+        return;
+
+    float dir = 1.f;
+    if (p0.y > p1.y) {
+        UIR_Point tmp = p0;
+        p0 = p1;
+        p1 = tmp;
+        dir = -1.f;
+    }
+
+    float dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+    float x = p0.x;
+    uint32_t y_start = (uint32_t)p0.y;
+    uint32_t y_end = (uint32_t)ceilf(p1.y);
+
+    for (uint32_t y = y_start; y < y_end; ++y) {
+        float *row = &acc[y * UIR_ACC_STRIDE];
+        float dy = UIR_min((float)(y + 1), p1.y) - UIR_max((float)y, p0.y);
+        float x_next = UIR_clamp(x + dxdy * dy, 0, UIR_TILE_SIZE);
+        float d = dy * dir;
+
+        float x0 = UIR_min(x, x_next);
+        float x1 = UIR_max(x, x_next);
+        float x0_floor = floorf(x0);
+        float x1_ceil = ceilf(x1);
+        uint32_t x0i = (uint32_t)x0_floor;
+        uint32_t x1i = (uint32_t)x1_ceil;
+
+        if (x1i <= x0i + 1) {
+            float xmf = 0.5f * (x + x_next) - x0_floor;
+            row[x0i] += d - d * xmf;
+            row[x0i + 1] += d * xmf;
+        } else {
+            float s = 1.f / (x1 - x0);
+            float x0f = x0 - x0_floor;
+            float a0 = 0.5f * s * (1.f - x0f) * (1.f - x0f);
+            float x1f = x1 - x1_ceil + 1.f;
+            float am = 0.5f * s * x1f * x1f;
+
+            row[x0i] += d * a0;
+            if (x1i == x0i + 2) {
+                row[x0i + 1] += d * (1.f - a0 - am);
+            } else {
+                float a1 = s * (1.5f - x0f);
+                row[x0i + 1] += d * (a1 - a0);
+                for (uint32_t xi = x0i + 2; xi < x1i - 1; ++xi)
+                    row[xi] += d * s;
+                float a2 = a1 + (float)(x1i - x0i - 3) * s;
+                row[x1i - 1] += d * (1.f - a2 - am);
+            }
+            row[x1i] += d * am;
+        }
+
+        x = x_next;
+    }
+}
+
+static inline UIR_Point UIR_lerp_point(UIR_Point a, UIR_Point b, float t) {
+    return (UIR_Point) { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t };
+}
+
+// Clips a tile-local line to the tile rows and accumulates it.
+// Parts of the line left or right of the tile are projected onto the tile edges,
+// which preserves their contribution to the winding of each row.
+static void UIR_fill_add_line(
+    float *acc,
+    UIR_Point a,
+    UIR_Point b
+) {
+    float size = UIR_TILE_SIZE;
+
+    float dy = b.y - a.y;
+    if (dy == 0.f)
+        return;
+    float ty0 = (0.f - a.y) / dy;
+    float ty1 = (size - a.y) / dy;
+    float t_min = UIR_max(0, UIR_min(ty0, ty1));
+    float t_max = UIR_min(1, UIR_max(ty0, ty1));
+    if (t_min >= t_max)
+        return;
+
+    // split where the line crosses the left and right tile edges
+    float ts[4] = { t_min, t_max, t_max, t_max };
+    uint32_t t_count = 1;
+    float dx = b.x - a.x;
+    if (dx != 0.f) {
+        float tx0 = (0.f - a.x) / dx;
+        float tx1 = (size - a.x) / dx;
+        if (tx0 > tx1) { float tmp = tx0; tx0 = tx1; tx1 = tmp; }
+        if (t_min < tx0 && tx0 < t_max) ts[t_count++] = tx0;
+        if (t_min < tx1 && tx1 < t_max) ts[t_count++] = tx1;
+    }
+    ts[t_count++] = t_max;
+
+    for (uint32_t i = 0; i + 1 < t_count; ++i) {
+        UIR_Point p0 = UIR_lerp_point(a, b, ts[i]);
+        UIR_Point p1 = UIR_lerp_point(a, b, ts[i+1]);
+        p0.x = UIR_clamp(p0.x, 0, size);
+        p1.x = UIR_clamp(p1.x, 0, size);
+        p0.y = UIR_clamp(p0.y, 0, size);
+        p1.y = UIR_clamp(p1.y, 0, size);
+        UIR_fill_accumulate_line(acc, p0, p1);
+    }
+}
+
+typedef struct UIR_PathBins UIR_PathBins;
+struct UIR_PathBins {
+    float x0, y0;           // command coordinates of the first tile covered by the bins
+    uint32_t width, height; // in cells. A cell is one tile, or one tile row for fills.
+    uint32_t *offsets;      // width*height + 1 offsets into indices
+    uint32_t *indices;      // segment indices, grouped by cell
+    UIR_Point *segments;    // flattened segments, as pairs of points
+};
+
+static bool UIR_path_bin_cells(
+    UIR_PathBins *bins,
+    UIR_DrawCmd_Path *path,
+    UIR_Point a,
+    UIR_Point b,
+    uint32_t *cx0, uint32_t *cy0,
+    uint32_t *cx1, uint32_t *cy1
+) {
+    float reach = 0.f;
+    if (path->type == UIR_DRAW_PATH_STROKE) {
+        reach = path->stroke_width * 0.5f + 1.f;
+    } else if (a.y == b.y) {
+        return false; // horizontal edges don't affect winding
+    }
+
+    float x0 = (UIR_min(a.x, b.x) - reach - bins->x0) / UIR_TILE_SIZE;
+    float y0 = (UIR_min(a.y, b.y) - reach - bins->y0) / UIR_TILE_SIZE;
+    float x1 = ceilf((UIR_max(a.x, b.x) + reach - bins->x0) / UIR_TILE_SIZE);
+    float y1 = ceilf((UIR_max(a.y, b.y) + reach - bins->y0) / UIR_TILE_SIZE);
+
+    if (path->type == UIR_DRAW_PATH_FILL) {
+        // fills bin whole tile rows, as segments left of a tile still add winding
+        x0 = 0.f;
+        x1 = 1.f;
+    }
+
+    *cx0 = (uint32_t)UIR_clamp(x0, 0, (float)bins->width);
+    *cy0 = (uint32_t)UIR_clamp(y0, 0, (float)bins->height);
+    *cx1 = (uint32_t)UIR_clamp(x1, 0, (float)bins->width);
+    *cy1 = (uint32_t)UIR_clamp(y1, 0, (float)bins->height);
+    return *cx0 < *cx1 && *cy0 < *cy1;
+}
+
+// Flattens the path and bins its segments into the tiles they can touch.
+// Returns NULL if the arena is too small.
+static UIR_PathBins *UIR_path_bin(
+    UIR *uir,
+    UIR_Arena *arena,
+    UIR_DrawCmd_Path *path
+) {
+    UIR_Rect everything = { -FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX };
+    bool is_fill = path->type == UIR_DRAW_PATH_FILL;
+    UIR_PathIter it;
+    UIR_Point a, b;
+
+    uint32_t segment_count = 0;
+    it = UIR_path_iter(path, everything, is_fill);
+    while (UIR_path_next(&it, &a, &b))
+        segment_count++;
+
+    UIR_PathBins *bins = UIR_arena_alloc(arena, sizeof(UIR_PathBins), alignof(UIR_PathBins));
+    UIR_Point *segments = UIR_arena_alloc(arena, segment_count * 2 * sizeof(UIR_Point), alignof(UIR_Point));
+    if (!bins || !segments)
+        return NULL;
+
+    it = UIR_path_iter(path, everything, is_fill);
+    for (uint32_t i = 0; UIR_path_next(&it, &a, &b); ++i) {
+        segments[i*2 + 0] = a;
+        segments[i*2 + 1] = b;
+    }
+
+    UIR_Rect *bb = &path->rect;
+    uint32_t x0 = (uint32_t)UIR_clamp((bb->x0 - uir->grid_x) / UIR_TILE_SIZE, 0, (float)uir->width_in_tiles);
+    uint32_t y0 = (uint32_t)UIR_clamp((bb->y0 - uir->grid_y) / UIR_TILE_SIZE, 0, (float)uir->height_in_tiles);
+    uint32_t x1 = (uint32_t)UIR_clamp(ceilf((bb->x1 - uir->grid_x) / UIR_TILE_SIZE), 0, (float)uir->width_in_tiles);
+    uint32_t y1 = (uint32_t)UIR_clamp(ceilf((bb->y1 - uir->grid_y) / UIR_TILE_SIZE), 0, (float)uir->height_in_tiles);
+
+    *bins = (UIR_PathBins) {
+        .x0 = uir->grid_x + (float)(x0 * UIR_TILE_SIZE),
+        .y0 = uir->grid_y + (float)(y0 * UIR_TILE_SIZE),
+        .width = x1 > x0 ? (is_fill ? 1 : x1 - x0) : 0,
+        .height = y1 > y0 ? y1 - y0 : 0,
+        .segments = segments,
+    };
+
+    uint32_t cell_count = bins->width * bins->height;
+    bins->offsets = UIR_arena_alloc(arena, (cell_count + 1) * sizeof(uint32_t), alignof(uint32_t));
+    uint32_t *cursors = UIR_arena_alloc(arena, cell_count * sizeof(uint32_t), alignof(uint32_t));
+    if (!bins->offsets || (cell_count && !cursors))
+        return NULL;
+    memset(bins->offsets, 0, (cell_count + 1) * sizeof(uint32_t));
+
+    // count segments per cell
+    uint32_t cx0, cy0, cx1, cy1;
+    for (uint32_t i = 0; i < segment_count; ++i) {
+        if (!UIR_path_bin_cells(bins, path, segments[i*2], segments[i*2 + 1], &cx0, &cy0, &cx1, &cy1))
+            continue;
+        for (uint32_t y = cy0; y < cy1; ++y)
+            for (uint32_t x = cx0; x < cx1; ++x)
+                bins->offsets[y*bins->width + x + 1]++;
+    }
+
+    for (uint32_t c = 0; c < cell_count; ++c) {
+        bins->offsets[c + 1] += bins->offsets[c];
+        cursors[c] = bins->offsets[c];
+    }
+
+    bins->indices = UIR_arena_alloc(arena, bins->offsets[cell_count] * sizeof(uint32_t), alignof(uint32_t));
+    if (!bins->indices)
+        return NULL;
+
+    for (uint32_t i = 0; i < segment_count; ++i) {
+        if (!UIR_path_bin_cells(bins, path, segments[i*2], segments[i*2 + 1], &cx0, &cy0, &cx1, &cy1))
+            continue;
+        for (uint32_t y = cy0; y < cy1; ++y)
+            for (uint32_t x = cx0; x < cx1; ++x)
+                bins->indices[cursors[y*bins->width + x]++] = i;
+    }
+
+    return bins;
+}
+
+// Returns the range of binned segment indices for the tile at rect.
+static void UIR_path_bins_for_tile(
+    UIR_PathBins *bins,
+    UIR_Rect *rect,
+    uint32_t **indices_start,
+    uint32_t **indices_end
+) {
+    uint32_t tx = (uint32_t)(int32_t)((rect->x0 - bins->x0) / UIR_TILE_SIZE);
+    uint32_t ty = (uint32_t)(int32_t)((rect->y0 - bins->y0) / UIR_TILE_SIZE);
+    if (bins->width == 1)
+        tx = 0;
+
+    // unsigned wrap makes tiles before the bins fail this test as well
+    if (tx >= bins->width || ty >= bins->height) {
+        *indices_start = *indices_end = bins->indices;
+        return;
+    }
+
+    uint32_t cell = ty*bins->width + tx;
+    *indices_start = &bins->indices[bins->offsets[cell]];
+    *indices_end = &bins->indices[bins->offsets[cell + 1]];
+}
+
+static bool UIR_stroke_add_segment(
+    float *coverage,
+    UIR_Rect *rect,
+    UIR_Point a,
+    UIR_Point b,
+    float half_width
+) {
+    float reach = half_width + 1.f;
+    UIR_Rect seg = {
+        UIR_min(a.x, b.x) - reach - rect->x0,
+        UIR_min(a.y, b.y) - reach - rect->y0,
+        UIR_max(a.x, b.x) + reach - rect->x0,
+        UIR_max(a.y, b.y) + reach - rect->y0,
+    };
+    if (seg.x1 <= 0 || seg.y1 <= 0 || seg.x0 >= UIR_TILE_SIZE || seg.y0 >= UIR_TILE_SIZE)
+        return false;
+
+    uint32_t px0 = (uint32_t)UIR_max(seg.x0, 0);
+    uint32_t py0 = (uint32_t)UIR_max(seg.y0, 0);
+    uint32_t px1 = (uint32_t)UIR_min(ceilf(seg.x1), UIR_TILE_SIZE);
+    uint32_t py1 = (uint32_t)UIR_min(ceilf(seg.y1), UIR_TILE_SIZE);
+
+    float dx = b.x - a.x;
+    float dy = b.y - a.y;
+    float len_sq = dx*dx + dy*dy;
+    float recip_len_sq = len_sq > 0.f ? 1.f / len_sq : 0.f;
+
+    for (uint32_t py = py0; py < py1; ++py) {
+        float y = rect->y0 + (float)py + 0.5f - a.y;
+        for (uint32_t px = px0; px < px1; ++px) {
+            float x = rect->x0 + (float)px + 0.5f - a.x;
+
+            // distance to segment
+            float t = UIR_clamp((x*dx + y*dy) * recip_len_sq, 0, 1);
+            float d = UIR_length(x - t*dx, y - t*dy);
+
+            float c = UIR_clamp(half_width + 0.5f - d, 0, 1);
+            uint32_t i = py*UIR_TILE_SIZE + px;
+            coverage[i] = UIR_max(coverage[i], c);
+        }
+    }
+
+    return true;
+}
+
+static void UIR_tile_draw_path_stroke(
+    UIR_Tile tile,
+    UIR_Rect *rect,
+    UIR_DrawCmd_Path *path
+) {
+    float half_width = path->stroke_width * 0.5f;
+    float coverage[UIR_TILE_SIZE*UIR_TILE_SIZE] = { 0 };
+    bool covered = false;
+
+    if (path->bins) {
+        uint32_t *indices, *indices_end;
+        UIR_path_bins_for_tile(path->bins, rect, &indices, &indices_end);
+        for (; indices != indices_end; ++indices) {
+            UIR_Point *seg = &path->bins->segments[*indices * 2];
+            covered |= UIR_stroke_add_segment(coverage, rect, seg[0], seg[1], half_width);
+        }
+    } else {
+        float reach = half_width + 1.f;
+        UIR_Rect cull = { rect->x0 - reach, rect->y0 - reach, rect->x1 + reach, rect->y1 + reach };
+        UIR_PathIter it = UIR_path_iter(path, cull, false);
+        UIR_Point a, b;
+        while (UIR_path_next(&it, &a, &b))
+            covered |= UIR_stroke_add_segment(coverage, rect, a, b, half_width);
+    }
+
+    if (!covered)
+        return;
+
+    for (uint32_t i = 0; i < UIR_TILE_SIZE*UIR_TILE_SIZE; ++i) {
+        if (coverage[i] > 0.f)
+            UIR_blend(&tile[i], path->colour, coverage[i]);
+    }
+}
+
+static bool UIR_fill_add_segment(
+    float *acc,
+    UIR_Rect *rect,
+    UIR_Point a,
+    UIR_Point b
+) {
+    // Segments left of the tile still add winding, so only reject those above, below or right of it.
+    if (UIR_max(a.y, b.y) <= rect->y0 || UIR_min(a.y, b.y) >= rect->y1 || UIR_min(a.x, b.x) >= rect->x1)
+        return false;
+
+    UIR_Point la = { a.x - rect->x0, a.y - rect->y0 };
+    UIR_Point lb = { b.x - rect->x0, b.y - rect->y0 };
+    UIR_fill_add_line(acc, la, lb);
+    return true;
+}
+
+static void UIR_tile_draw_path_fill(
+    UIR_Tile tile,
+    UIR_Rect *rect,
+    UIR_DrawCmd_Path *path
+) {
+    // extra space for spill from lines lying exactly on the right edge
+    float acc[UIR_ACC_STRIDE*UIR_TILE_SIZE + 2] = { 0 };
+    bool covered = false;
+
+    if (path->bins) {
+        uint32_t *indices, *indices_end;
+        UIR_path_bins_for_tile(path->bins, rect, &indices, &indices_end);
+        for (; indices != indices_end; ++indices) {
+            UIR_Point *seg = &path->bins->segments[*indices * 2];
+            covered |= UIR_fill_add_segment(acc, rect, seg[0], seg[1]);
+        }
+    } else {
+        UIR_PathIter it = UIR_path_iter(path, *rect, true);
+        UIR_Point a, b;
+        while (UIR_path_next(&it, &a, &b))
+            covered |= UIR_fill_add_segment(acc, rect, a, b);
+    }
+
+    if (!covered)
+        return;
+
+    for (uint32_t y = 0; y < UIR_TILE_SIZE; ++y) {
+        float winding = 0.f;
+        for (uint32_t x = 0; x < UIR_TILE_SIZE; ++x) {
+            winding += acc[y*UIR_ACC_STRIDE + x];
+            float coverage = UIR_min(UIR_abs(winding), 1.f);
+            if (coverage > 0.f)
+                UIR_blend(&tile[y*UIR_TILE_SIZE + x], path->colour, coverage);
+        }
+    }
+}
+
+static inline bool UIR_is_integer(float n) { return n == floorf(n); }
+
+static inline bool UIR_colour_is_zero(RGBA c) { return (c.r | c.g | c.b | c.a) == 0; }
+
+static inline uint8_t UIR_premultiply(uint8_t c, uint8_t a) {
+    return (uint8_t)(((uint32_t)c * a + 127) / 255);
+}
+
+// Converts one source pixel of a UIR_DRAW_IMAGE_RGBA image to premultiplied RGBA.
+static inline RGBA UIR_image_pixel(
+    UIR_DrawCmd_Image *image,
+    const uint8_t *src
+) {
+    RGBA px;
+    switch (image->format) {
+        case UIR_IMAGE_FORMAT_BGRA:
+            px = (RGBA){ src[2], src[1], src[0], src[3] };
+            break;
+        case UIR_IMAGE_FORMAT_RGBA_STRAIGHT:
+            px.a = src[3];
+            px.r = UIR_premultiply(src[0], px.a);
+            px.g = UIR_premultiply(src[1], px.a);
+            px.b = UIR_premultiply(src[2], px.a);
+            break;
+        case UIR_IMAGE_FORMAT_BGRA_STRAIGHT:
+            px.a = src[3];
+            px.r = UIR_premultiply(src[2], px.a);
+            px.g = UIR_premultiply(src[1], px.a);
+            px.b = UIR_premultiply(src[0], px.a);
+            break;
+        case UIR_IMAGE_FORMAT_RGB:
+            px = (RGBA){ src[0], src[1], src[2], 255 };
+            break;
+        case UIR_IMAGE_FORMAT_INDEXED:
+            px = image->palette[src[0]];
+            break;
+        default:
+            memcpy(&px, src, sizeof(RGBA));
+            break;
+    }
+    return px;
+}
+
+// Converts the source pixels of w destination columns into row. The format is switched on once,
+// outside plain loops over the row, which the compiler vectorizes.
+// If src_x is NULL, the columns are w consecutive source pixels from src.
+static void UIR_image_load_row(
+    UIR_DrawCmd_Image *image,
+    const uint8_t *restrict src,
+    const uint32_t *src_x,
+    uint32_t w,
+    RGBA *restrict row
+) {
+    if (!src_x) {
+        switch (image->format) {
+            // Converted a whole tile row at a time, through local copies, so the loops have a
+            // constant trip count and no aliasing, which -O2 vectorizes.
+            case UIR_IMAGE_FORMAT_BGRA: {
+                uint8_t in[UIR_TILE_SIZE * 4] = {0};
+                RGBA out[UIR_TILE_SIZE];
+                memcpy(in, src, w * 4);
+                for (uint32_t x = 0; x < UIR_TILE_SIZE; ++x)
+                    out[x] = (RGBA){ in[x*4 + 2], in[x*4 + 1], in[x*4 + 0], in[x*4 + 3] };
+                memcpy(row, out, w * sizeof(RGBA));
+            } return;
+            case UIR_IMAGE_FORMAT_RGB: {
+                uint8_t in[UIR_TILE_SIZE * 3] = {0};
+                RGBA out[UIR_TILE_SIZE];
+                memcpy(in, src, w * 3);
+                for (uint32_t x = 0; x < UIR_TILE_SIZE; ++x)
+                    out[x] = (RGBA){ in[x*3 + 0], in[x*3 + 1], in[x*3 + 2], 255 };
+                memcpy(row, out, w * sizeof(RGBA));
+            } return;
+            default: {
+                // other formats gain little from consecutive columns
+                uint32_t consecutive[UIR_TILE_SIZE];
+                for (uint32_t x = 0; x < w; ++x)
+                    consecutive[x] = x;
+                UIR_image_load_row(image, src, consecutive, w, row);
+            } return;
+        }
+    }
+
+    switch (image->format) {
+        case UIR_IMAGE_FORMAT_BGRA:
+            for (uint32_t x = 0; x < w; ++x) {
+                const uint8_t *p = &src[src_x[x] * 4];
+                row[x] = (RGBA){ p[2], p[1], p[0], p[3] };
+            }
+            break;
+        case UIR_IMAGE_FORMAT_RGBA_STRAIGHT:
+        case UIR_IMAGE_FORMAT_BGRA_STRAIGHT: {
+            uint32_t ri = image->format == UIR_IMAGE_FORMAT_RGBA_STRAIGHT ? 0 : 2;
+            for (uint32_t x = 0; x < w; ++x) {
+                const uint8_t *p = &src[src_x[x] * 4];
+                row[x].r = UIR_premultiply(p[ri], p[3]);
+                row[x].g = UIR_premultiply(p[1], p[3]);
+                row[x].b = UIR_premultiply(p[2 - ri], p[3]);
+                row[x].a = p[3];
+            }
+        } break;
+        case UIR_IMAGE_FORMAT_RGB:
+            for (uint32_t x = 0; x < w; ++x) {
+                const uint8_t *p = &src[src_x[x] * 3];
+                row[x] = (RGBA){ p[0], p[1], p[2], 255 };
+            }
+            break;
+        case UIR_IMAGE_FORMAT_INDEXED:
+            for (uint32_t x = 0; x < w; ++x)
+                row[x] = image->palette[src[src_x[x]]];
+            break;
+        default:
+            for (uint32_t x = 0; x < w; ++x)
+                memcpy(&row[x], &src[src_x[x] * 4], sizeof(RGBA));
+            break;
+    }
+}
+
+// Finds the source pixel sampled by each pixel of a span of size px starting start px into the
+// image, along one axis. Returns the number of pixels.
+static uint32_t UIR_image_samples(
+    UIR_DrawCmd_Image *image,
+    float start,
+    float size,
+    uint32_t samples[UIR_TILE_SIZE]
+) {
+    uint32_t count = size > 0.f ? (uint32_t)ceilf(size) : 0;
+#ifdef UIR_FIXED_POINT
+    // 32.32 fixed point, rounded up past the error of the float division, so whole number
+    // scales sample the same pixels as the aligned path. Used by both pipelines of this profile.
+    uint64_t step = (uint64_t)(4294967296.f / image->scale) + 512;
+    uint64_t position = ((uint64_t)UIR_to_fixed(start) * step) >> UIR_FIXED_SHIFT;
+    for (uint32_t i = 0; i < count; ++i) {
+        samples[i] = (uint32_t)(position >> 32);
+        position += step;
+    }
+#else
+    float recip_scale = 1.f / image->scale;
+    for (uint32_t i = 0; i < count; ++i)
+        samples[i] = (uint32_t)((start + (float)i) * recip_scale);
+#endif
+    return count;
+}
+
+// Images on whole pixel coordinates at a whole number scale can be sampled with integers only.
+static bool UIR_image_is_aligned(
+    UIR_DrawCmd_Image *image
+) {
+    return image->scale >= 1.f && image->scale <= 65536.f && UIR_is_integer(image->scale)
+        && UIR_is_integer(image->rect.x0) && UIR_is_integer(image->rect.y0)
+        && UIR_is_integer(image->rect.x1) && UIR_is_integer(image->rect.y1);
+}
+
+// Fast paths for aligned images. Produces the same pixels as the general float path.
+// w, h and the image offsets are in panel pixels, relative to the top left of the image rect.
+static void UIR_tile_draw_image_aligned(
+    UIR_Tile tile,
+    UIR_DrawCmd_Image *image,
+    uint32_t tile_x,
+    uint32_t tile_y,
+    uint32_t w,
+    uint32_t h,
+    uint32_t image_x,
+    uint32_t image_y
+) {
+    uint32_t scale = (uint32_t)image->scale;
+    RGBA tint = image->tint_colour;
+
+    // source column for each destination column, stepped without any division in the row loops
+    uint32_t src_x[UIR_TILE_SIZE];
+    uint32_t sx = image_x / scale;
+    uint32_t sub = image_x % scale;
+    for (uint32_t x = 0; x < w; ++x) {
+        src_x[x] = sx;
+        if (++sub == scale) {
+            sub = 0;
+            sx++;
+        }
+    }
+
+    uint32_t sy = image_y / scale;
+    uint32_t sub_y = image_y % scale;
+    for (uint32_t y = 0; y < h; ++y) {
+        RGBA *dst = &tile[(tile_y + y) * UIR_TILE_SIZE + tile_x];
+        uint8_t *src = &image->data[sy * image->data_stride];
+
+        if (image->type == UIR_DRAW_IMAGE_A) {
+            uint8_t alpha[UIR_TILE_SIZE];
+            uint32_t any = 0;
+            uint32_t all = 255;
+            for (uint32_t x = 0; x < w; ++x) {
+                alpha[x] = src[src_x[x]];
+                any |= alpha[x];
+                all &= alpha[x];
+            }
+
+            // Zero alpha leaves dst unchanged, and full alpha with an opaque tint replaces it.
+            if (any == 0) {
+                // nothing to draw
+            } else if (all == 255 && tint.a == 255) {
+                for (uint32_t x = 0; x < w; ++x)
+                    dst[x] = tint;
+            } else {
+                for (uint32_t x = 0; x < w; ++x) {
+                    if (alpha[x] == 0)
+                        continue;
+                    if (alpha[x] == 255 && tint.a == 255)
+                        dst[x] = tint;
+                    else
+                        UIR_blend_byte(&dst[x], tint, alpha[x], false);
+                }
+            }
+        } else {
+            bool no_tint = UIR_colour_is_zero(tint);
+            bool opaque = (image->flags & UIR_IMAGE_OPAQUE) || image->format == UIR_IMAGE_FORMAT_RGB;
+
+            if (no_tint && opaque && scale == 1 && image->format == UIR_IMAGE_FORMAT_RGBA) {
+                memcpy(dst, &src[image_x * 4], w * sizeof(RGBA));
+            } else if (no_tint && opaque && scale == 1) {
+                UIR_image_load_row(image, &src[image_x * UIR_image_bytes_per_pixel(image)], NULL, w, dst);
+            } else if (no_tint && opaque) {
+                UIR_image_load_row(image, src, src_x, w, dst);
+            } else {
+                RGBA row[UIR_TILE_SIZE];
+                UIR_image_load_row(image, src, src_x, w, row);
+                if (no_tint) {
+                    for (uint32_t x = 0; x < w; ++x)
+                        UIR_blend_full(&dst[x], row[x], false);
+                } else {
+                    for (uint32_t x = 0; x < w; ++x)
+                        UIR_blend2_full(&dst[x], row[x], tint, false);
+                }
+            }
+        }
+
+        if (++sub_y == scale) {
+            sub_y = 0;
+            sy++;
+        }
+    }
+}
+
+// ------------------------------
+// shape kernels
+
+// Chosen per shape by UIR_draw, so that common shapes skip work that can't affect them.
+// Every kernel produces the same pixels as UIR_SHAPE_KERNEL_FULL.
+typedef enum UIR_ShapeKernel {
+    UIR_SHAPE_KERNEL_FULL,
+    UIR_SHAPE_KERNEL_NONE,      // fully transparent
+    UIR_SHAPE_KERNEL_AXIS_FILL, // sharp rect without outline
+    UIR_SHAPE_KERNEL_FILL,      // no visible outline
+    UIR_SHAPE_KERNEL_OUTLINE,   // no fill
+} UIR_ShapeKernel;
+
+static uint32_t UIR_shape_kernel(
+    UIR_DrawCmd_Shape *shape
+) {
+    bool has_gradient = shape->fill_gradient.type != UIR_GRADIENT_NONE;
+    bool has_fill = has_gradient || !UIR_colour_is_zero(shape->fill_colour);
+    bool has_outline = shape->outline_radius != 0.f && !UIR_colour_is_zero(shape->outline_colour);
+
+    if (!has_fill && !has_outline)
+        return UIR_SHAPE_KERNEL_NONE;
+    if (has_gradient)
+        return UIR_SHAPE_KERNEL_FULL;
+
+    if (!has_outline) {
+        // an invisible outline still insets the fill, so only a zero radius is axis aligned
+        bool is_sharp = shape->corner_radius == 0.f && shape->outline_radius == 0.f;
+        if (shape->type == UIR_DRAW_SHAPE_RECT && is_sharp)
+            return UIR_SHAPE_KERNEL_AXIS_FILL;
+        return UIR_SHAPE_KERNEL_FILL;
+    }
+
+    if (!has_fill)
+        return UIR_SHAPE_KERNEL_OUTLINE;
+    return UIR_SHAPE_KERNEL_FULL;
+}
+
+// How a shape covers a tile. Tiles inside a shape's bounding box but outside the shape, or inside
+// the hole of an outline, are empty: they are neither hashed nor drawn.
+enum {
+    UIR_COVERAGE_EMPTY,
+    UIR_COVERAGE_EDGE,
+    UIR_COVERAGE_FULL, // every pixel takes the fill colour at full coverage
+};
+
+// Slack for the rounding of the SDF, in px.
+#define UIR_COVERAGE_MARGIN 0.05f
+
+// The SDFs only grow with the distance from the centre along either axis, so their smallest and
+// largest values over a tile are at the tile's pixels nearest to and farthest from the centre.
+static uint32_t UIR_shape_tile_coverage(
+    UIR_DrawCmd_Shape *shape,
+    UIR_Rect *tile_rect
+) {
+    bool has_gradient = shape->fill_gradient.type != UIR_GRADIENT_NONE;
+    bool has_fill = has_gradient || !UIR_colour_is_zero(shape->fill_colour);
+    bool has_outline = shape->outline_radius > 0.f && !UIR_colour_is_zero(shape->outline_colour);
+    if (!has_fill && !has_outline)
+        return UIR_COVERAGE_EMPTY;
+
+    float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
+    float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
+    float x0 = tile_rect->x0 - (shape->rect.x0 + w2);
+    float y0 = tile_rect->y0 - (shape->rect.y0 + h2);
+    float x1 = tile_rect->x1 - 1.f - (shape->rect.x0 + w2);
+    float y1 = tile_rect->y1 - 1.f - (shape->rect.y0 + h2);
+    float near_x = x0 > 0.f ? x0 : x1 < 0.f ? -x1 : 0.f;
+    float near_y = y0 > 0.f ? y0 : y1 < 0.f ? -y1 : 0.f;
+    float far_x = UIR_max(UIR_abs(x0), UIR_abs(x1));
+    float far_y = UIR_max(UIR_abs(y0), UIR_abs(y1));
+
+    float r_min, r_max;
+    if (shape->type == UIR_DRAW_SHAPE_CIRCLE) {
+        float radius = UIR_min(w2, h2);
+        r_min = UIR_circle(near_x, near_y, radius);
+        r_max = UIR_circle(far_x, far_y, radius);
+    } else {
+        r_min = UIR_rounded_rect(near_x, near_y, w2, h2, shape->corner_radius);
+        r_max = UIR_rounded_rect(far_x, far_y, w2, h2, shape->corner_radius);
+    }
+
+    // same factors as UIR_pick_colour: the fill is zero from fill_edge out, and the outline
+    // is zero outside the shape and deeper than twice its radius inside
+    float outline_radius = shape->outline_radius;
+    float fill_edge = UIR_min(1, outline_radius) - outline_radius * 2.f;
+    bool fill_touches = has_fill && r_min < fill_edge + UIR_COVERAGE_MARGIN;
+    bool outline_touches = outline_radius > 0.f
+        && r_min < UIR_COVERAGE_MARGIN
+        && r_max > -outline_radius * 2.f - UIR_COVERAGE_MARGIN;
+
+    if (!fill_touches && !(has_outline && outline_touches))
+        return UIR_COVERAGE_EMPTY;
+    if (has_fill && !has_gradient && !outline_touches && r_max < fill_edge - 1.f - UIR_COVERAGE_MARGIN)
+        return UIR_COVERAGE_FULL;
+    return UIR_COVERAGE_EDGE;
+}
+
+// Finds the pixels of the tile row at y that a shape may draw: those where its SDF is below outer,
+// less those of the hole, where it is at most inner, if has_hole. Writes up to 2 spans [start, end)
+// of tile columns, and returns how many.
+static uint32_t UIR_shape_row_spans(
+    UIR_DrawCmd_Shape *shape,
+    bool is_circle,
+    UIR_Rect *rect,
+    float y,
+    float outer,
+    bool has_hole,
+    float inner,
+    uint32_t spans[4]
+) {
+    float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
+    float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
+    float cx = shape->rect.x0 + w2 - rect->x0;
+    float py = UIR_abs(y - (shape->rect.y0 + h2));
+    outer += UIR_COVERAGE_MARGIN;
+    inner -= UIR_COVERAGE_MARGIN;
+
+    // half widths of the row's extent, and of its hole, around the centre
+    float extent = -1.f;
+    float hole = -1.f;
+    if (is_circle) {
+        float radius = UIR_min(w2, h2);
+        float a = radius + outer;
+        if (a > py)
+            extent = sqrtf(a*a - py*py);
+        float b = radius + inner;
+        if (has_hole && b > py)
+            hole = sqrtf(b*b - py*py);
+    } else if (py - h2 < outer) {
+        // the SDF is at least the distance past the straight edges, and exact in the corners
+        float corner_radius = shape->corner_radius;
+        float qy = py - h2 + corner_radius;
+        float a = outer + corner_radius;
+        if (qy <= 0.f)
+            extent = w2 + outer;
+        else if (a > qy)
+            extent = w2 - corner_radius + sqrtf(a*a - qy*qy);
+
+        // between the corners, the SDF is the distance to the nearest straight edge
+        if (has_hole && qy <= 0.f && py - h2 <= inner)
+            hole = UIR_min(w2 + inner, w2 - corner_radius);
+    }
+
+    if (extent <= 0.f)
+        return 0;
+
+    float start = UIR_clamp(ceilf(cx - extent), 0, UIR_TILE_SIZE);
+    float end = UIR_clamp(floorf(cx + extent) + 1.f, 0, UIR_TILE_SIZE);
+    if (start >= end)
+        return 0;
+
+    spans[0] = (uint32_t)start;
+    spans[1] = (uint32_t)end;
+    if (hole < 0.f)
+        return 1;
+
+    float hole_start = UIR_clamp(ceilf(cx - hole), start, end);
+    float hole_end = UIR_clamp(floorf(cx + hole) + 1.f, hole_start, end);
+    spans[1] = (uint32_t)hole_start;
+    spans[2] = (uint32_t)hole_end;
+    spans[3] = (uint32_t)end;
+    return 2;
+}
+
+// Sharp rect fills are separable: coverage is the minimum of a row and a column coverage.
+// Fully covered spans of opaque fills are stored without blending.
+static void UIR_tile_draw_shape_axis_fill(
+    UIR_Tile tile,
+    UIR_Rect *rect,
+    UIR_DrawCmd_Shape *shape
+) {
+    float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
+    float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
+    RGBA fill = shape->fill_colour;
+
+    // same arithmetic as UIR_rounded_rect with no corner
+    float cx[UIR_TILE_SIZE];
+    uint32_t span_x0 = UIR_TILE_SIZE;
+    uint32_t span_x1 = 0;
+    for (uint32_t px = 0; px < UIR_TILE_SIZE; ++px) {
+        float x = rect->x0 + (float)px;
+        float qx = UIR_abs(x - (shape->rect.x0 + w2)) - w2 + 0.f;
+        cx[px] = UIR_clamp(-qx, 0, 1);
+        if (cx[px] == 1.f) {
+            span_x0 = span_x0 < px ? span_x0 : px;
+            span_x1 = px + 1;
+        }
+    }
+    bool opaque = fill.a == 255;
+
+    for (uint32_t py = 0; py < UIR_TILE_SIZE; ++py) {
+        float y = rect->y0 + (float)py;
+        float qy = UIR_abs(y - (shape->rect.y0 + h2)) - h2 + 0.f;
+        float cy = UIR_clamp(-qy, 0, 1);
+        if (cy == 0.f)
+            continue;
+
+        RGBA *row = &tile[py * UIR_TILE_SIZE];
+        bool store_span = opaque && cy == 1.f && span_x0 < span_x1;
+        for (uint32_t px = 0; px < UIR_TILE_SIZE; ++px) {
+            if (store_span && px == span_x0) {
+                for (; px < span_x1; ++px)
+                    row[px] = fill;
+                if (px == UIR_TILE_SIZE)
+                    break;
+            }
+
+            float coverage = UIR_min(cx[px], cy);
+            if (coverage > 0.f)
+                UIR_blend(&row[px], fill, coverage);
+        }
+    }
+}
+
+// Specialised at compile time by the constant arguments of its callers.
+// Drawing only one of fill or outline is a single blend, which is skipped where it has no effect.
+UIR_FORCE_INLINE void UIR_tile_draw_shape_sdf(
+    UIR_Tile tile,
+    UIR_Rect *rect,
+    UIR_DrawCmd_Shape *shape,
+    bool is_circle,
+    bool is_outline
+) {
+    float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
+    float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
+    float radius = UIR_min(w2, h2);
+    float outline_radius = shape->outline_radius;
+    float fill_edge = UIR_min(1, outline_radius) - outline_radius * 2.f;
+
+    for (uint32_t row = 0; row < UIR_TILE_SIZE; ++row) {
+        float y = rect->y0 + (float)row;
+        uint32_t spans[4];
+        uint32_t span_count = is_outline
+            ? UIR_shape_row_spans(shape, is_circle, rect, y, 0.f, true, -outline_radius * 2.f, spans)
+            : UIR_shape_row_spans(shape, is_circle, rect, y, fill_edge, false, 0.f, spans);
+
+        for (uint32_t span = 0; span < span_count; ++span) {
+            for (uint32_t column = spans[span*2]; column < spans[span*2 + 1]; ++column) {
+                float x = rect->x0 + (float)column;
+                float px = x - (shape->rect.x0 + w2);
+                float py = y - (shape->rect.y0 + h2);
+                float r = is_circle
+                    ? UIR_circle(px, py, radius)
+                    : UIR_rounded_rect(px, py, w2, h2, shape->corner_radius);
+
+                // same factors as UIR_pick_colour
+                RGBA *dst = &tile[row*UIR_TILE_SIZE + column];
+                if (is_outline) {
+                    float outline_factor = UIR_clamp(outline_radius - UIR_abs(r + outline_radius), 0, 1);
+                    if (outline_factor > 0.f)
+                        UIR_blend(dst, shape->outline_colour, outline_factor);
+                } else {
+                    float fill_factor = UIR_clamp(fill_edge - r, 0, 1);
+                    if (fill_factor > 0.f)
+                        UIR_blend(dst, shape->fill_colour, fill_factor);
+                }
+            }
+        }
+    }
+}
+
+static void UIR_tile_draw_rect_fill(UIR_Tile tile, UIR_Rect *rect, UIR_DrawCmd_Shape *shape) {
+    UIR_tile_draw_shape_sdf(tile, rect, shape, false, false);
+}
+
+static void UIR_tile_draw_rect_outline(UIR_Tile tile, UIR_Rect *rect, UIR_DrawCmd_Shape *shape) {
+    UIR_tile_draw_shape_sdf(tile, rect, shape, false, true);
+}
+
+static void UIR_tile_draw_circle_fill(UIR_Tile tile, UIR_Rect *rect, UIR_DrawCmd_Shape *shape) {
+    UIR_tile_draw_shape_sdf(tile, rect, shape, true, false);
+}
+
+static void UIR_tile_draw_circle_outline(UIR_Tile tile, UIR_Rect *rect, UIR_DrawCmd_Shape *shape) {
+    UIR_tile_draw_shape_sdf(tile, rect, shape, true, true);
+}
+
+#ifdef UIR_FIXED_POINT
+
+// Every shape kernel but gradients, in fixed point. Circles compare squared distances against the
+// edges of the antialiased band, so the square root is only taken for pixels inside it.
+static void UIR_tile_draw_shape_fixed(
+    UIR_Tile tile,
+    UIR_Rect *rect,
+    UIR_DrawCmd_Shape *shape,
+    bool is_circle
+) {
+    RGBA fill = shape->fill_colour;
+    RGBA outline = shape->outline_colour;
+    bool has_fill = !UIR_colour_is_zero(fill);
+    bool has_outline = shape->outline_radius > 0.f && !UIR_colour_is_zero(outline);
+    if (!has_fill && !has_outline)
+        return;
+
+    UIR_Fixed x0 = UIR_to_fixed(shape->rect.x0);
+    UIR_Fixed y0 = UIR_to_fixed(shape->rect.y0);
+    UIR_Fixed w2 = (UIR_to_fixed(shape->rect.x1) - x0) / 2;
+    UIR_Fixed h2 = (UIR_to_fixed(shape->rect.y1) - y0) / 2;
+    UIR_Fixed radius = UIR_fixed_min(w2, h2);
+    UIR_Fixed corner_radius = UIR_to_fixed(shape->corner_radius);
+    UIR_Fixed outline_radius = UIR_to_fixed(shape->outline_radius);
+    UIR_Fixed fill_edge = UIR_fixed_min(UIR_FIXED_ONE, outline_radius) - outline_radius * 2;
+
+    // Nothing is drawn where the SDF is at least outer. Where it is at most inner, the outline
+    // is zero and the fill, if any, is full.
+    UIR_Fixed outer = has_fill ? fill_edge : 0;
+    UIR_Fixed inner = has_fill ? fill_edge - UIR_FIXED_ONE : -outline_radius * 2;
+    if (has_outline) {
+        outer = UIR_fixed_max(outer, 0);
+        inner = UIR_fixed_min(inner, -outline_radius * 2);
+    }
+
+    // the same bounds on squared distances from the centre of a circle
+    int64_t outer_edge = (int64_t)radius + outer;
+    int64_t inner_edge = (int64_t)radius + inner;
+    uint64_t outer_sq = outer_edge > 0 ? (uint64_t)(outer_edge * outer_edge) : 0;
+    uint64_t inner_sq = inner_edge >= 0 ? (uint64_t)((inner_edge + 1) * (inner_edge + 1)) : 0;
+
+    UIR_Fixed px0 = UIR_to_fixed(rect->x0) - (x0 + w2);
+    UIR_Fixed py = UIR_to_fixed(rect->y0) - (y0 + h2);
+    for (uint32_t row = 0; row < UIR_TILE_SIZE; ++row, py += UIR_FIXED_ONE) {
+        UIR_Fixed px = px0;
+        for (uint32_t column = 0; column < UIR_TILE_SIZE; ++column, px += UIR_FIXED_ONE) {
+            RGBA *dst = &tile[row*UIR_TILE_SIZE + column];
+
+            UIR_Fixed r;
+            if (is_circle) {
+                uint64_t d_sq = (uint64_t)((int64_t)px*px) + (uint64_t)((int64_t)py*py);
+                if (d_sq >= outer_sq)
+                    continue;
+                if (d_sq < inner_sq) {
+                    if (has_fill)
+                        UIR_blend_fixed(dst, fill, UIR_FIXED_ONE);
+                    continue;
+                }
+                r = (UIR_Fixed)UIR_isqrt(d_sq) - radius;
+            } else {
+                r = UIR_rounded_rect_fixed(px, py, w2, h2, corner_radius);
+                if (r >= outer)
+                    continue;
+                if (r <= inner) {
+                    if (has_fill)
+                        UIR_blend_fixed(dst, fill, UIR_FIXED_ONE);
+                    continue;
+                }
+            }
+
+            // same factors as UIR_pick_colour
+            UIR_Fixed outline_factor = UIR_fixed_clamp(outline_radius - UIR_fixed_abs(r + outline_radius), 0, UIR_FIXED_ONE);
+            UIR_Fixed fill_factor = UIR_fixed_clamp(fill_edge - r, 0, UIR_FIXED_ONE);
+            if (has_outline && has_fill)
+                UIR_blend2_fixed(dst, outline, fill, (uint32_t)outline_factor, (uint32_t)fill_factor);
+            else if (has_outline)
+                UIR_blend_fixed(dst, outline, (uint32_t)outline_factor);
+            else
+                UIR_blend_fixed(dst, fill, (uint32_t)fill_factor);
+        }
+    }
+}
+
+#endif
+
+static void UIR_tile_draw_cmd(
+    UIR_Tile tile,
+    UIR_Rect *rect,
+    UIR_DrawCmd *cmd,
+    bool reference
+) {
+    switch (cmd->common.type) {
+        case UIR_DRAW_SHAPE_RECT: {
+            UIR_DrawCmd_Shape *shape = &cmd->shape;
+
+#ifdef UIR_FIXED_POINT
+            if (!reference && shape->fill_gradient.type == UIR_GRADIENT_NONE) {
+                UIR_tile_draw_shape_fixed(tile, rect, shape, false);
+                return;
+            }
+#endif
+
+            switch (shape->kernel) {
+                case UIR_SHAPE_KERNEL_NONE: return;
+                case UIR_SHAPE_KERNEL_AXIS_FILL: UIR_tile_draw_shape_axis_fill(tile, rect, shape); return;
+                case UIR_SHAPE_KERNEL_FILL: UIR_tile_draw_rect_fill(tile, rect, shape); return;
+                case UIR_SHAPE_KERNEL_OUTLINE: UIR_tile_draw_rect_outline(tile, rect, shape); return;
+                default: break;
+            }
+        
+            float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
+            float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
+
+            bool has_gradient = shape->fill_gradient.type != UIR_GRADIENT_NONE;
+            RGBA fill_row[UIR_TILE_SIZE];
+
+            // neither fill nor outline reaches past the larger of their edges
+            float outer = UIR_max(UIR_min(1, shape->outline_radius) - shape->outline_radius * 2.f, 0);
+
+            for (uint32_t row = 0; row < UIR_TILE_SIZE; ++row) {
+                float y = rect->y0 + (float)row;
+                uint32_t spans[4] = { 0, UIR_TILE_SIZE };
+                uint32_t span_count = reference ? 1 : UIR_shape_row_spans(shape, false, rect, y, outer, false, 0.f, spans);
+                if (!span_count)
+                    continue;
+
+                if (has_gradient)
+                    UIR_gradient_row(&shape->fill_gradient, rect->x0, y, fill_row);
+
+                for (uint32_t px = spans[0]; px < spans[1]; ++px) {
+                    float r = UIR_rounded_rect(
+                        rect->x0 + (float)px - (shape->rect.x0 + w2),
+                        y - (shape->rect.y0 + h2),
+                        w2, h2,
+                        shape->corner_radius
+                    );
+
+                    RGBA fill = has_gradient ? fill_row[px] : shape->fill_colour;
+                    UIR_pick_colour(&tile[row*UIR_TILE_SIZE + px], shape->outline_colour, fill, shape->outline_radius, r);
+                }
+            }
+        } break;
+        case UIR_DRAW_SHAPE_CIRCLE: {
+            UIR_DrawCmd_Shape *shape = &cmd->shape;
+
+#ifdef UIR_FIXED_POINT
+            if (!reference && shape->fill_gradient.type == UIR_GRADIENT_NONE) {
+                UIR_tile_draw_shape_fixed(tile, rect, shape, true);
+                return;
+            }
+#endif
+
+            switch (shape->kernel) {
+                case UIR_SHAPE_KERNEL_NONE: return;
+                case UIR_SHAPE_KERNEL_FILL: UIR_tile_draw_circle_fill(tile, rect, shape); return;
+                case UIR_SHAPE_KERNEL_OUTLINE: UIR_tile_draw_circle_outline(tile, rect, shape); return;
+                default: break;
+            }
+        
+            float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
+            float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
+            float radius = UIR_min(w2, h2);
+
+            bool has_gradient = shape->fill_gradient.type != UIR_GRADIENT_NONE;
+            RGBA fill_row[UIR_TILE_SIZE];
+            float outer = UIR_max(UIR_min(1, shape->outline_radius) - shape->outline_radius * 2.f, 0);
+
+            for (uint32_t row = 0; row < UIR_TILE_SIZE; ++row) {
+                float y = rect->y0 + (float)row;
+                uint32_t spans[4] = { 0, UIR_TILE_SIZE };
+                uint32_t span_count = reference ? 1 : UIR_shape_row_spans(shape, true, rect, y, outer, false, 0.f, spans);
+                if (!span_count)
+                    continue;
+
+                if (has_gradient)
+                    UIR_gradient_row(&shape->fill_gradient, rect->x0, y, fill_row);
+
+                for (uint32_t px = spans[0]; px < spans[1]; ++px) {
+                    float r = UIR_circle(
+                        rect->x0 + (float)px - (shape->rect.x0 + w2),
+                        y - (shape->rect.y0 + h2),
+                        radius
+                    );
+
+                    RGBA fill = has_gradient ? fill_row[px] : shape->fill_colour;
+                    UIR_pick_colour(&tile[row*UIR_TILE_SIZE + px], shape->outline_colour, fill, shape->outline_radius, r);
+                }
+            }
+        } break;
+        case UIR_DRAW_IMAGE_A: {
+            UIR_DrawCmd_Image *image = &cmd->image;
+            
+            float x0 = UIR_max(image->rect.x0, rect->x0);
+            float y0 = UIR_max(image->rect.y0, rect->y0);
+            float x1 = UIR_min(image->rect.x1, rect->x1);
+            float y1 = UIR_min(image->rect.y1, rect->y1);
+            
+            float w = x1 - x0;
+            float h = y1 - y0;
+            
+            uint32_t tile_x_start = (uint32_t)(x0 - rect->x0);
+            uint32_t tile_y = (uint32_t)(y0 - rect->y0);
+            
+            float image_x_start = x0 - image->rect.x0;
+            float image_y_start = y0 - image->rect.y0;
+
+            if (!reference && UIR_image_is_aligned(image)) {
+                UIR_tile_draw_image_aligned(
+                    tile, image,
+                    tile_x_start, tile_y,
+                    (uint32_t)w, (uint32_t)h,
+                    (uint32_t)image_x_start, (uint32_t)image_y_start
+                );
+                break;
+            }
+
+            uint32_t columns[UIR_TILE_SIZE];
+            uint32_t rows[UIR_TILE_SIZE];
+            uint32_t column_count = UIR_image_samples(image, image_x_start, w, columns);
+            uint32_t row_count = UIR_image_samples(image, image_y_start, h, rows);
+
+            for (uint32_t y = 0; y < row_count; ++y) {
+                RGBA *dst = &tile[(tile_y + y)*UIR_TILE_SIZE + tile_x_start];
+                uint8_t *src = &image->data[rows[y] * image->data_stride];
+
+                for (uint32_t x = 0; x < column_count; ++x)
+                    UIR_blend_byte(&dst[x], image->tint_colour, src[columns[x]], reference);
+            }
+        } break;
+        case UIR_DRAW_IMAGE_RGBA: {
+            UIR_DrawCmd_Image *image = &cmd->image;
+            
+            float x0 = UIR_max(image->rect.x0, rect->x0);
+            float y0 = UIR_max(image->rect.y0, rect->y0);
+            float x1 = UIR_min(image->rect.x1, rect->x1);
+            float y1 = UIR_min(image->rect.y1, rect->y1);
+            
+            float w = x1 - x0;
+            float h = y1 - y0;
+            
+            uint32_t tile_x_start = (uint32_t)(x0 - rect->x0);
+            uint32_t tile_y = (uint32_t)(y0 - rect->y0);
+            
+            float image_x_start = x0 - image->rect.x0;
+            float image_y_start = y0 - image->rect.y0;
+
+            if (!reference && UIR_image_is_aligned(image)) {
+                UIR_tile_draw_image_aligned(
+                    tile, image,
+                    tile_x_start, tile_y,
+                    (uint32_t)w, (uint32_t)h,
+                    (uint32_t)image_x_start, (uint32_t)image_y_start
+                );
+                break;
+            }
+            
+            bool no_tint = !reference && UIR_colour_is_zero(image->tint_colour);
+            uint32_t bpp = UIR_image_bytes_per_pixel(image);
+
+            uint32_t columns[UIR_TILE_SIZE];
+            uint32_t rows[UIR_TILE_SIZE];
+            uint32_t column_count = UIR_image_samples(image, image_x_start, w, columns);
+            uint32_t row_count = UIR_image_samples(image, image_y_start, h, rows);
+
+            for (uint32_t y = 0; y < row_count; ++y) {
+                RGBA *dst = &tile[(tile_y + y)*UIR_TILE_SIZE + tile_x_start];
+                uint8_t *src = &image->data[rows[y] * image->data_stride];
+
+                for (uint32_t x = 0; x < column_count; ++x) {
+                    RGBA px = UIR_image_pixel(image, &src[columns[x] * bpp]);
+
+                    // blending with a zero tint is a no-op
+                    if (no_tint)
+                        UIR_blend_full(&dst[x], px, reference);
+                    else
+                        UIR_blend2_full(&dst[x], px, image->tint_colour, reference);
+                }
+            }
+        } break;
+        case UIR_DRAW_PATH_STROKE: {
+            UIR_tile_draw_path_stroke(tile, rect, &cmd->path);
+        } break;
+        case UIR_DRAW_PATH_FILL: {
+            UIR_tile_draw_path_fill(tile, rect, &cmd->path);
+        } break;
+        case UIR_DRAW_SHAPE_SHADOW: {
+            UIR_tile_draw_shadow(tile, rect, &cmd->shadow);
+        } break;
+    }
+}
+
+static void UIR_fill_tile(
+    UIR_Tile tile,
+    RGBA colour
+) {
+    // Loop is manually unrolled for better codegen. It's equivalent to this code:
+    // for (uint32_t i = 0; i < UIR_TILE_SIZE*UIR_TILE_SIZE; ++i)
+    //     memcpy(&uir->tiles[tile_idx][i], &uir->clear_colour, 4);
+
+    RGBA colour_x4[4] = { colour, colour, colour, colour };
     RGBA *tile_ptr = &tile[0];
     for (uint32_t i = 0; i < UIR_TILE_SIZE*UIR_TILE_SIZE; i += 4)
         memcpy(&tile_ptr[i], colour_x4, sizeof(RGBA) * 4);
 }
 
-static bool UIR_draw_cmd_is_fill(
-    RGBA *fill_colour,
-    UIR_Rect *tile_rect,
-    UIR_DrawCmd *cmd
+// Returns UIR_COVERAGE_FULL, with the colour, if the command fills the tile with one colour at full coverage.
+// Shapes that miss the tile are empty. The rest are edges, even if they cover the tile.
+static uint32_t UIR_draw_cmd_coverage(
+    RGBA *fill_colour,
+    UIR_Rect *tile_rect,
+    UIR_DrawCmd *cmd
+) {
+    if (!UIR_rect_intersect(tile_rect, &cmd->common.rect))
+        return UIR_COVERAGE_EMPTY;
+
+    switch (cmd->common.type) {
+        case UIR_DRAW_SHAPE_RECT:
+        case UIR_DRAW_SHAPE_CIRCLE: {
+            *fill_colour = cmd->shape.fill_colour;
+            return UIR_shape_tile_coverage(&cmd->shape, tile_rect);
+        }
+
+        case UIR_DRAW_SHAPE_SHADOW: {
+            UIR_DrawCmd_Shadow *shadow = &cmd->shadow;
+
+            // the blur saturates a few standard deviations inside the straight edges
+            float nonfill_size = shadow->corner_radius + UIR_max(shadow->blur_radius, 0.01f) * 4.f;
+            UIR_Rect fill_rect = {
+                shadow->shape_rect.x0 + nonfill_size,
+                shadow->shape_rect.y0 + nonfill_size,
+                shadow->shape_rect.x1 - nonfill_size,
+                shadow->shape_rect.y1 - nonfill_size,
+            };
+
+            *fill_colour = shadow->colour;
+            return UIR_rect_inside(tile_rect, &fill_rect) ? UIR_COVERAGE_FULL : UIR_COVERAGE_EDGE;
+        }
+
+        default:
+            return UIR_COVERAGE_EDGE;
+    }
+}
+
+// Returns the command coordinates covered by a grid tile.
+static UIR_Rect UIR_grid_tile_rect(
+    UIR *uir,
+    uint32_t tile_x,
+    uint32_t tile_y
+) {
+    return (UIR_Rect) {
+        .x0 = uir->grid_x + (float)(tile_x * UIR_TILE_SIZE),
+        .y0 = uir->grid_y + (float)(tile_y * UIR_TILE_SIZE),
+        .x1 = uir->grid_x + (float)((tile_x + 1) * UIR_TILE_SIZE),
+        .y1 = uir->grid_y + (float)((tile_y + 1) * UIR_TILE_SIZE),
+    };
+}
+
+// Fills in the fields of a command that UIR_draw writes.
+static void UIR_draw_cmd_prepare(
+    UIR_DrawCmd *cmd,
+    bool reference
+) {
+    switch (cmd->common.type) {
+
+        // pick kernel
+        case UIR_DRAW_SHAPE_RECT: {
+            cmd->shape.kernel = reference ? UIR_SHAPE_KERNEL_FULL : UIR_shape_kernel(&cmd->shape);
+        } break;
+
+        // tighten circle bounding box, and pick kernel
+        case UIR_DRAW_SHAPE_CIRCLE: {
+            UIR_DrawCmd_Shape *shape = &cmd->shape;
+            shape->kernel = reference ? UIR_SHAPE_KERNEL_FULL : UIR_shape_kernel(shape);
+
+            float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
+            float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
+            float radius = UIR_min(w2, h2);
+
+            float x = shape->rect.x0 + w2;
+            float y = shape->rect.y0 + h2;
+            
+            shape->rect.x0 = x - radius;
+            shape->rect.y0 = y - radius;
+            shape->rect.x1 = x + radius;
+            shape->rect.y1 = y + radius;
+        } break;
+
+        // find path bounding box
+        case UIR_DRAW_PATH_STROKE:
+        case UIR_DRAW_PATH_FILL: {
+            cmd->path.rect = UIR_path_bounds(&cmd->path);
+            cmd->path.bins = NULL;
+        } break;
+
+        // grow shadow bounding box by the blur
+        case UIR_DRAW_SHAPE_SHADOW: {
+            UIR_DrawCmd_Shadow *shadow = &cmd->shadow;
+
+            float grow = UIR_max(shadow->blur_radius, 0.01f) * UIR_SHADOW_EXTENT + 1.f;
+            shadow->rect.x0 = shadow->shape_rect.x0 - grow;
+            shadow->rect.y0 = shadow->shape_rect.y0 - grow;
+            shadow->rect.x1 = shadow->shape_rect.x1 + grow;
+            shadow->rect.y1 = shadow->shape_rect.y1 + grow;
+        } break;
+
+        default:
+            break;
+    }
+}
+
+// ------------------------------
+// Groups
+
+// Returns how many commands follow a group command, clamped to the command list.
+static inline uint32_t UIR_group_cmd_count(
+    UIR_DrawCmd *group,
+    UIR_DrawCmd *draw_cmds_end
+) {
+    uint32_t left = (uint32_t)(draw_cmds_end - group - 1);
+    return group->group.cmd_count < left ? group->group.cmd_count : left;
+}
+
+// Prepares the group's commands. If the group has no hash yet, also finds its hash and bounds.
+static void UIR_group_prepare(
+    UIR_DrawCmd *cmd,
+    uint32_t count,
+    bool reference
+) {
+    UIR_DrawCmd_Group *group = &cmd->group;
+    UIR_DrawCmd *children = cmd + 1;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (children[i].common.type != UIR_DRAW_GROUP)
+            UIR_draw_cmd_prepare(&children[i], reference);
+    }
+    group->prepared = true;
+
+    // order matters, so chain the hashes like murmur3 does its blocks
+    UIR_Hash hash = count;
+    UIR_Rect rect = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX };
+    bool live = false;
+    for (uint32_t i = 0; i < count; ++i) {
+        UIR_DrawCmd *child = &children[i];
+        if (child->common.type == UIR_DRAW_GROUP)
+            continue;
+        live |= UIR_draw_cmd_is_image(child->common.type) && child->image.handle;
+        if (group->hash)
+            continue;
+
+        hash ^= UIR_murmur32_scramble(UIR_hash_draw_cmd(child));
+        hash = ((hash << 13) | (hash >> 19)) * 5 + 0xe6546b64;
+
+        rect.x0 = UIR_min(rect.x0, child->common.rect.x0);
+        rect.y0 = UIR_min(rect.y0, child->common.rect.y0);
+        rect.x1 = UIR_max(rect.x1, child->common.rect.x1);
+        rect.y1 = UIR_max(rect.y1, child->common.rect.y1);
+    }
+
+    // a hash set by the app comes with its rect, but live is still found from the commands
+    if (!group->hash) {
+        group->hash = hash ? hash : 1;
+        group->rect = rect.x0 <= rect.x1 ? rect : (UIR_Rect) {0};
+    }
+    group->live = live;
+    group->live_hash = group->hash;
+}
+
+// ------------------------------
+// Tiles
+
+// Blends a colour over the whole tile at full coverage, as the shape kernels would.
+static void UIR_tile_blend_colour(
+    UIR_Tile tile,
+    RGBA colour
+) {
+    if (colour.a == 255) {
+        UIR_fill_tile(tile, colour);
+        return;
+    }
+    for (uint32_t i = 0; i < UIR_TILE_SIZE*UIR_TILE_SIZE; ++i)
+        UIR_blend_full(&tile[i], colour, false);
+}
+
+// Draws a command whose bounding box meets the tile, skipping shapes that miss it and shading
+// shapes that cover it with a single colour. Returns false if nothing was drawn.
+static bool UIR_tile_draw_covered_cmd(
+    UIR_Tile tile,
+    UIR_Rect *tile_rect,
+    UIR_DrawCmd *cmd,
+    bool reference
+) {
+    if (reference) {
+        UIR_tile_draw_cmd(tile, tile_rect, cmd, reference);
+        return true;
+    }
+
+    RGBA fill_colour;
+    switch (UIR_draw_cmd_coverage(&fill_colour, tile_rect, cmd)) {
+        case UIR_COVERAGE_EMPTY:
+            return false;
+        case UIR_COVERAGE_FULL:
+            UIR_tile_blend_colour(tile, fill_colour);
+            return true;
+        default:
+            break;
+    }
+    UIR_tile_draw_cmd(tile, tile_rect, cmd, reference);
+    return true;
+}
+
+// Returns the number of commands drawn into the tile.
+static uint32_t UIR_tile_draw(
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count,
+    uint32_t tile_x,
+    uint32_t tile_y,
+    RGBA *tile
+) {
+    UIR_Rect tile_rect = UIR_grid_tile_rect(uir, tile_x, tile_y);
+    bool reference = uir->debug_flags & UIR_DEBUG_REFERENCE;
+
+    UIR_DrawCmd *draw_cmds_start = draw_cmds;
+    UIR_DrawCmd *draw_cmds_end = draw_cmds_start + draw_cmd_count;
+
+    // Find clear colour, blending in the commands that fill the whole tile
+    RGBA clear_colour = uir->clear_colour;
+    for (; !reference && draw_cmds != draw_cmds_end; draw_cmds++) {
+        RGBA fill_colour;
+        if (draw_cmds->common.type == UIR_DRAW_GROUP) {
+            if (UIR_rect_intersect(&tile_rect, &draw_cmds->common.rect))
+                break;
+            draw_cmds += UIR_group_cmd_count(draw_cmds, draw_cmds_end);
+            continue;
+        }
+        if (!UIR_rect_intersect(&tile_rect, &draw_cmds->common.rect))
+            continue;
+
+        uint32_t coverage = UIR_draw_cmd_coverage(&fill_colour, &tile_rect, draw_cmds);
+        if (coverage == UIR_COVERAGE_FULL)
+            UIR_blend_full(&clear_colour, fill_colour, false);
+        else if (coverage == UIR_COVERAGE_EDGE)
+            break;
+    }
+
+    // Clear tile
+    UIR_fill_tile(tile, clear_colour);
+    
+    // Draw!
+    uint32_t drawn = 0;
+    UIR_DrawCmd *group_end = draw_cmds;
+    for (; draw_cmds != draw_cmds_end; draw_cmds++) {
+        if (draw_cmds->common.type == UIR_DRAW_GROUP) {
+            // groups inside groups are ignored
+            if (draw_cmds < group_end)
+                continue;
+
+            uint32_t count = UIR_group_cmd_count(draw_cmds, draw_cmds_end);
+            group_end = draw_cmds + 1 + count;
+            if (!UIR_rect_intersect(&tile_rect, &draw_cmds->common.rect))
+                draw_cmds += count;
+            else if (!draw_cmds->group.prepared)
+                UIR_group_prepare(draw_cmds, count, reference);
+        } else if (UIR_rect_intersect(&tile_rect, &draw_cmds->common.rect)) {
+            drawn += UIR_tile_draw_covered_cmd(tile, &tile_rect, draw_cmds, reference);
+        }
+    }
+    return drawn;
+}
+
+// ------------------------------
+// Tracing and heatmaps
+
+// Emits a span from *start until now, and moves *start to now.
+static void UIR_trace_span(
+    UIR_Trace *trace,
+    const char *name,
+    uint64_t *start,
+    int32_t tile_x,
+    int32_t tile_y,
+    uint32_t count
+) {
+    uint64_t now = trace->now(trace->user_data);
+    if (trace->span) {
+        UIR_TraceSpan span = {
+            .name = name,
+            .start = *start,
+            .duration = now - *start,
+            .tile_x = tile_x,
+            .tile_y = tile_y,
+            .count = count,
+        };
+        trace->span(trace->user_data, &span);
+    }
+    *start = now;
+}
+
+// Blends green to red over the tile, for heat in [0, 1].
+static void UIR_tile_draw_heat(
+    UIR_Tile tile,
+    float heat
+) {
+    heat = UIR_clamp(heat, 0.f, 1.f);
+    RGBA tint = { (uint8_t)(heat * 128.f), (uint8_t)((1.f - heat) * 128.f), 0, 128 };
+    for (uint32_t i = 0; i < UIR_TILE_SIZE*UIR_TILE_SIZE; ++i)
+        UIR_blend(&tile[i], tint, 1.f);
+}
+
+// Returns the latest generation of the image pixels visible in a tile.
+static uint32_t UIR_image_tile_generation(
+    UIR_DrawCmd_Image *image,
+    UIR_Rect *tile_rect
+) {
+    UIR_Image *handle = image->handle;
+    if (!handle->block_generations)
+        return handle->generation;
+
+    // where this command's pixels start within the handle
+    size_t offset = (size_t)(image->data - handle->data);
+    uint32_t origin_y = (uint32_t)(offset / handle->data_stride);
+    uint32_t origin_x = (uint32_t)(offset % handle->data_stride) / UIR_image_bytes_per_pixel(image);
+
+    // visible part of the image rect, in image pixels
+    float recip_scale = 1.f / image->scale;
+    float x0 = UIR_max(image->rect.x0, tile_rect->x0) - image->rect.x0;
+    float y0 = UIR_max(image->rect.y0, tile_rect->y0) - image->rect.y0;
+    float x1 = UIR_min(image->rect.x1, tile_rect->x1) - image->rect.x0;
+    float y1 = UIR_min(image->rect.y1, tile_rect->y1) - image->rect.y0;
+    if (x0 >= x1 || y0 >= y1)
+        return 0;
+
+    uint32_t blocks_x = (handle->width + UIR_IMAGE_BLOCK_SIZE - 1) / UIR_IMAGE_BLOCK_SIZE;
+    uint32_t blocks_y = (handle->height + UIR_IMAGE_BLOCK_SIZE - 1) / UIR_IMAGE_BLOCK_SIZE;
+    uint32_t bx0 = (origin_x + (uint32_t)(x0 * recip_scale)) / UIR_IMAGE_BLOCK_SIZE;
+    uint32_t by0 = (origin_y + (uint32_t)(y0 * recip_scale)) / UIR_IMAGE_BLOCK_SIZE;
+    uint32_t bx1 = (origin_x + (uint32_t)ceilf(x1 * recip_scale) + UIR_IMAGE_BLOCK_SIZE - 1) / UIR_IMAGE_BLOCK_SIZE;
+    uint32_t by1 = (origin_y + (uint32_t)ceilf(y1 * recip_scale) + UIR_IMAGE_BLOCK_SIZE - 1) / UIR_IMAGE_BLOCK_SIZE;
+    bx1 = bx1 < blocks_x ? bx1 : blocks_x;
+    by1 = by1 < blocks_y ? by1 : blocks_y;
+
+    uint32_t generation = 0;
+    for (uint32_t by = by0; by < by1; ++by) {
+        for (uint32_t bx = bx0; bx < bx1; ++bx) {
+            uint32_t block_generation = handle->block_generations[by * blocks_x + bx];
+            generation = generation > block_generation ? generation : block_generation;
+        }
+    }
+    return generation;
+}
+
+// XORs a command's hash into the tiles its bounding box covers.
+static void UIR_hash_cmd_into_tiles(
+    UIR *uir,
+    UIR_DrawCmd *cmd,
+    UIR_Hash draw_cmd_hash
+) {
+    // clamp to the panel, as bounding boxes (e.g. of paths) often extend past it
+    UIR_Rect *bb = &cmd->common.rect;
+    float width_in_tiles = (float)uir->width_in_tiles;
+    float height_in_tiles = (float)uir->height_in_tiles;
+    uint32_t x0 = (uint32_t)UIR_clamp((bb->x0 - uir->grid_x) / UIR_TILE_SIZE, 0, width_in_tiles);
+    uint32_t y0 = (uint32_t)UIR_clamp((bb->y0 - uir->grid_y) / UIR_TILE_SIZE, 0, height_in_tiles);
+    uint32_t x1 = (uint32_t)UIR_clamp(ceilf((bb->x1 - uir->grid_x) / UIR_TILE_SIZE), 0, width_in_tiles);
+    uint32_t y1 = (uint32_t)UIR_clamp(ceilf((bb->y1 - uir->grid_y) / UIR_TILE_SIZE), 0, height_in_tiles);
+    
+    if (UIR_draw_cmd_is_image(cmd->common.type) && cmd->image.handle) {
+        // mix in the generation of the pixels each tile shows, so only changed parts are redrawn
+        for (uint32_t y = y0; y < y1; ++y) {
+            for (uint32_t x = x0; x < x1; ++x) {
+                uint32_t tile_idx = UIR_tile_slot(uir, y * uir->width_in_tiles + x);
+                UIR_Rect tile_rect = UIR_grid_tile_rect(uir, x, y);
+                uint32_t generation = UIR_image_tile_generation(&cmd->image, &tile_rect);
+                uir->tile_info[tile_idx].hash_new ^= draw_cmd_hash ^ UIR_murmur32_scramble(generation);
+            }
+        }
+    } else if (UIR_draw_cmd_is_shape(cmd->common.type) && !(uir->debug_flags & UIR_DEBUG_REFERENCE)) {
+        // only the tiles the shape touches, so the corners of circles and the holes of outlines stay clean
+        for (uint32_t y = y0; y < y1; ++y) {
+            for (uint32_t x = x0; x < x1; ++x) {
+                UIR_Rect tile_rect = UIR_grid_tile_rect(uir, x, y);
+                if (UIR_shape_tile_coverage(&cmd->shape, &tile_rect) == UIR_COVERAGE_EMPTY)
+                    continue;
+                uint32_t tile_idx = UIR_tile_slot(uir, y * uir->width_in_tiles + x);
+                uir->tile_info[tile_idx].hash_new ^= draw_cmd_hash;
+            }
+        }
+    } else {
+        for (uint32_t y = y0; y < y1; ++y) {
+            for (uint32_t x = x0; x < x1; ++x) {
+                uint32_t tile_idx = UIR_tile_slot(uir, y * uir->width_in_tiles + x);
+                uir->tile_info[tile_idx].hash_new ^= draw_cmd_hash;
+            }
+        }
+    }
+}
+
+// ------------------------------
+// Command streams
+
+#define UIR_CMD_STREAM_ALIGN 8
+// Commands are tested against a tile this many at a time.
+#define UIR_CMD_STREAM_CHUNK 64
+
+// Bounding boxes are tested a whole chunk at a time, so their arrays are rounded up to whole chunks.
+static size_t UIR_cmd_stream_box_capacity(uint32_t capacity) {
+    return ((size_t)capacity + UIR_CMD_STREAM_CHUNK - 1) / UIR_CMD_STREAM_CHUNK * UIR_CMD_STREAM_CHUNK;
+}
+
+// The bytes a command takes in a stream, before aligning.
+static size_t UIR_cmd_stream_cmd_size(
+    const UIR_DrawCmd *cmd
+) {
+    switch (cmd->common.type) {
+        case UIR_DRAW_SHAPE_RECT:
+        case UIR_DRAW_SHAPE_CIRCLE:
+            if (cmd->shape.fill_gradient.type == UIR_GRADIENT_NONE)
+                return offsetof(UIR_DrawCmd_Shape, fill_gradient);
+            return sizeof(UIR_DrawCmd_Shape);
+        case UIR_DRAW_IMAGE_A:
+        case UIR_DRAW_IMAGE_RGBA:
+            return sizeof(UIR_DrawCmd_Image);
+        case UIR_DRAW_PATH_STROKE:
+        case UIR_DRAW_PATH_FILL:
+            return sizeof(UIR_DrawCmd_Path);
+        case UIR_DRAW_SHAPE_SHADOW:
+            return sizeof(UIR_DrawCmd_Shadow);
+        default:
+            return 0;
+    }
+}
+
+size_t UIR_cmd_stream_memory_size(
+    uint32_t capacity,
+    size_t payload_capacity
+) {
+    return sizeof(UIR_CmdStream) + alignof(UIR_CmdStream) // add to ensure we can align the stream upwards
+        + UIR_cmd_stream_box_capacity(capacity) * 4 * sizeof(float)
+        + ((size_t)capacity + 1) * sizeof(uint32_t)
+        + UIR_CMD_STREAM_ALIGN + payload_capacity;
+}
+
+UIR_CmdStream *UIR_cmd_stream_new(
+    uint32_t capacity,
+    size_t payload_capacity,
+    unsigned char *memory,
+    size_t memory_size
+) {
+    unsigned char *memory_end = memory + memory_size;
+    unsigned char *stream_addr = ALIGN_UP(memory, alignof(UIR_CmdStream));
+    size_t size = UIR_cmd_stream_memory_size(capacity, payload_capacity);
+    if (payload_capacity > UINT32_MAX || stream_addr + size - alignof(UIR_CmdStream) > memory_end)
+        return NULL;
+
+    // -----------------------------
+    // split memory between the stream, bounding boxes, offsets and payload
+
+    UIR_CmdStream *stream = (UIR_CmdStream*)stream_addr;
+    unsigned char *memory_left = stream_addr + sizeof(UIR_CmdStream);
+
+    size_t box_capacity = UIR_cmd_stream_box_capacity(capacity);
+    float *bounds = (float*)memory_left;
+    memory_left += box_capacity * 4 * sizeof(float);
+    uint32_t *offsets = (uint32_t*)memory_left;
+    memory_left += ((size_t)capacity + 1) * sizeof(uint32_t);
+
+    *stream = (UIR_CmdStream) {
+        .x0 = bounds,
+        .y0 = bounds + box_capacity,
+        .x1 = bounds + box_capacity * 2,
+        .y1 = bounds + box_capacity * 3,
+        .offsets = offsets,
+        .payload = ALIGN_UP(memory_left, UIR_CMD_STREAM_ALIGN),
+        .payload_capacity = payload_capacity,
+        .capacity = capacity,
+    };
+    stream->offsets[0] = 0;
+
+    // boxes past the last command never touch a tile
+    for (size_t i = 0; i < box_capacity; ++i) {
+        stream->x0[i] = FLT_MAX;
+        stream->y0[i] = FLT_MAX;
+        stream->x1[i] = -FLT_MAX;
+        stream->y1[i] = -FLT_MAX;
+    }
+
+    return stream;
+}
+
+void UIR_cmd_stream_clear(
+    UIR_CmdStream *stream
+) {
+    stream->count = 0;
+    stream->offsets[0] = 0;
+}
+
+bool UIR_cmd_stream_push(
+    UIR_CmdStream *stream,
+    const UIR_DrawCmd *cmd
+) {
+    size_t size = UIR_cmd_stream_cmd_size(cmd);
+    if (!size)
+        return false;
+
+    size_t offset = stream->offsets[stream->count];
+    size_t next_offset = (offset + size + UIR_CMD_STREAM_ALIGN - 1) & ~(size_t)(UIR_CMD_STREAM_ALIGN - 1);
+    if (stream->count == stream->capacity || next_offset > stream->payload_capacity) {
+        stream->error_flags |= UIR_ERROR_NO_MEM;
+        return false;
+    }
+
+    memcpy(stream->payload + offset, cmd, size);
+
+    uint32_t i = stream->count++;
+    stream->x0[i] = cmd->common.rect.x0;
+    stream->y0[i] = cmd->common.rect.y0;
+    stream->x1[i] = cmd->common.rect.x1;
+    stream->y1[i] = cmd->common.rect.y1;
+    stream->offsets[i + 1] = (uint32_t)next_offset;
+    return true;
+}
+
+uint32_t UIR_cmd_stream_push_array(
+    UIR_CmdStream *stream,
+    const UIR_DrawCmd *cmds,
+    uint32_t cmd_count
+) {
+    uint32_t pushed = 0;
+    while (pushed < cmd_count && UIR_cmd_stream_push(stream, &cmds[pushed]))
+        pushed++;
+    return pushed;
+}
+
+// Shapes stored without a gradient stop short of it, and of the kernel.
+static inline bool UIR_cmd_stream_is_short_shape(
+    UIR_CmdStream *stream,
+    uint32_t i,
+    uint32_t type
+) {
+    return type <= UIR_DRAW_SHAPE_CIRCLE && stream->offsets[i + 1] - stream->offsets[i] < sizeof(UIR_DrawCmd_Shape);
+}
+
+// Copies command i out of the stream, filling in what short shapes leave out.
+static void UIR_cmd_stream_unpack(
+    UIR_CmdStream *stream,
+    uint32_t i,
+    UIR_DrawCmd *cmd,
+    bool reference
+) {
+    unsigned char *data = stream->payload + stream->offsets[i];
+    size_t size = stream->offsets[i + 1] - stream->offsets[i];
+    memcpy(cmd, data, size < sizeof(*cmd) ? size : sizeof(*cmd));
+
+    if (UIR_cmd_stream_is_short_shape(stream, i, cmd->common.type)) {
+        cmd->shape.fill_gradient.type = UIR_GRADIENT_NONE;
+        cmd->shape.kernel = reference ? UIR_SHAPE_KERNEL_FULL : UIR_shape_kernel(&cmd->shape);
+    }
+}
+
+// Returns the number of commands drawn into the tile.
+static uint32_t UIR_stream_tile_draw(
+    UIR *uir,
+    UIR_CmdStream *stream,
+    uint32_t tile_x,
+    uint32_t tile_y,
+    RGBA *tile
+) {
+    UIR_Rect tile_rect = UIR_grid_tile_rect(uir, tile_x, tile_y);
+    bool reference = uir->debug_flags & UIR_DEBUG_REFERENCE;
+
+    RGBA clear_colour = uir->clear_colour;
+    bool cleared = false;
+    uint32_t drawn = 0;
+
+    for (uint32_t chunk = 0; chunk < stream->count; chunk += UIR_CMD_STREAM_CHUNK) {
+        uint32_t chunk_size = stream->count - chunk < UIR_CMD_STREAM_CHUNK ? stream->count - chunk : UIR_CMD_STREAM_CHUNK;
+
+        // branch free and a whole chunk, so the compiler can test several bounding boxes at once.
+        // Boxes past the last command are empty, or left from before a clear, and never drawn.
+        uint8_t hits[UIR_CMD_STREAM_CHUNK];
+        uint8_t any_hits = 0;
+        float *x0 = stream->x0 + chunk;
+        float *y0 = stream->y0 + chunk;
+        float *x1 = stream->x1 + chunk;
+        float *y1 = stream->y1 + chunk;
+        for (uint32_t i = 0; i < UIR_CMD_STREAM_CHUNK; ++i) {
+            hits[i] = (uint8_t)(
+                (tile_rect.x0 < x1[i]) & (x0[i] < tile_rect.x1) &
+                (tile_rect.y0 < y1[i]) & (y0[i] < tile_rect.y1)
+            );
+            any_hits |= hits[i];
+        }
+        if (!any_hits)
+            continue;
+
+        for (uint32_t i = 0; i < chunk_size; ++i) {
+            if (!hits[i])
+                continue;
+
+            UIR_DrawCmd cmd;
+            UIR_cmd_stream_unpack(stream, chunk + i, &cmd, reference);
+
+            // Find clear colour, until the first command that isn't a fill
+            if (!cleared && !reference) {
+                RGBA fill_colour;
+                uint32_t coverage = UIR_draw_cmd_coverage(&fill_colour, &tile_rect, &cmd);
+                if (coverage == UIR_COVERAGE_FULL)
+                    UIR_blend_full(&clear_colour, fill_colour, false);
+                if (coverage != UIR_COVERAGE_EDGE)
+                    continue;
+            }
+            if (!cleared) {
+                UIR_fill_tile(tile, clear_colour);
+                cleared = true;
+            }
+
+            drawn += UIR_tile_draw_covered_cmd(tile, &tile_rect, &cmd, reference);
+        }
+    }
+
+    if (!cleared)
+        UIR_fill_tile(tile, clear_colour);
+    return drawn;
+}
+
+// ------------------------------
+// Packed tiles
+
+// An 8x8 Bayer matrix, spread over 2..254.
+static const uint8_t UIR_dither_thresholds[8][8] = {
+    {   2, 130,  34, 162,  10, 138,  42, 170 },
+    { 194,  66, 226,  98, 202,  74, 234, 106 },
+    {  50, 178,  18, 146,  58, 186,  26, 154 },
+    { 242, 114, 210,  82, 250, 122, 218,  90 },
+    {  14, 142,  46, 174,   6, 134,  38, 166 },
+    { 206,  78, 238, 110, 198,  70, 230, 102 },
+    {  62, 190,  30, 158,  54, 182,  22, 150 },
+    { 254, 126, 222,  94, 246, 118, 214,  86 },
+};
+
+// Rec. 709 weights in 1/256ths, which sum to 256.
+static inline uint8_t UIR_luma(
+    RGBA px
+) {
+    return (uint8_t)(((uint32_t)px.r * 54 + (uint32_t)px.g * 183 + (uint32_t)px.b * 19 + 128) >> 8);
+}
+
+// Light if above the threshold at grid px (x, y).
+static inline bool UIR_dither_ordered(
+    uint8_t luma,
+    uint32_t x,
+    uint32_t y
+) {
+    return luma > UIR_dither_thresholds[y & 7][x & 7];
+}
+
+// Errors stay inside the tile, so a tile packs the same whether or not its neighbours were redrawn.
+// Along the right, left and bottom edges, the error is shared by the neighbours inside the tile,
+// so flat areas keep their average.
+static void UIR_tile_pack_diffusion(
+    const uint8_t *luma,
+    uint8_t *packed
+) {
+    // in 1/16ths, with one column of padding on each side
+    int32_t error[2][UIR_TILE_SIZE + 2] = {{0}};
+    for (uint32_t y = 0; y < UIR_TILE_SIZE; ++y) {
+        int32_t *row = error[y & 1];
+        int32_t *below = error[(y & 1) ^ 1];
+        memset(below, 0, sizeof(error[0]));
+        bool last_row = y == UIR_TILE_SIZE - 1;
+        for (uint32_t x = 0; x < UIR_TILE_SIZE; ++x) {
+            int32_t value = luma[y*UIR_TILE_SIZE + x] + row[x + 1] / 16;
+            int32_t out = value > 127 ? 255 : 0;
+            if (out)
+                packed[y*UIR_TILE_SIZE/8 + x/8] |= (uint8_t)(0x80 >> (x & 7));
+
+            int32_t right = x + 1 < UIR_TILE_SIZE ? 7 : 0;
+            int32_t below_left = !last_row && x > 0 ? 3 : 0;
+            int32_t below_centre = !last_row ? 5 : 0;
+            int32_t below_right = !last_row && right ? 1 : 0;
+            int32_t weights = right + below_left + below_centre + below_right;
+            if (!weights)
+                continue;
+
+            int32_t e = (value - out) * 16 / weights;
+            row[x + 2] += e * right;
+            below[x] += e * below_left;
+            below[x + 1] += e * below_centre;
+            below[x + 2] += e * below_right;
+        }
+    }
+}
+
+static inline uint8_t *UIR_packed_tile(
+    UIR *uir,
+    uint32_t tile_idx
+) {
+    return uir->packed_tiles + (size_t)tile_idx * uir->packed_tile_size;
+}
+
+// Packs a drawn tile into the panel's tile format.
+static void UIR_tile_pack(
+    UIR *uir,
+    uint32_t tile_idx,
+    const RGBA *restrict tile
+) {
+    uint8_t *packed = UIR_packed_tile(uir, tile_idx);
+
+    // a row at a time, through local copies, which -O2 vectorizes
+    uint8_t luma[UIR_TILE_SIZE*UIR_TILE_SIZE];
+    for (uint32_t y = 0; y < UIR_TILE_SIZE; ++y) {
+        uint8_t in[UIR_TILE_SIZE * 4];
+        uint8_t out[UIR_TILE_SIZE];
+        memcpy(in, tile + y*UIR_TILE_SIZE, sizeof(in));
+        for (uint32_t x = 0; x < UIR_TILE_SIZE; ++x)
+            out[x] = (uint8_t)((uint16_t)(in[x*4] * 54 + in[x*4 + 1] * 183 + in[x*4 + 2] * 19 + 128) >> 8);
+        memcpy(luma + y*UIR_TILE_SIZE, out, sizeof(out));
+    }
+
+    if (uir->tile_format == UIR_TILE_FORMAT_L8) {
+        memcpy(packed, luma, sizeof(luma));
+        return;
+    }
+    if (uir->dither == UIR_DITHER_DIFFUSION) {
+        memset(packed, 0, uir->packed_tile_size);
+        UIR_tile_pack_diffusion(luma, packed);
+        return;
+    }
+
+    // each pixel's bit in its own byte, then the 8 bytes of each packed byte ORed together
+    static const uint8_t bit_values[UIR_TILE_SIZE] = {
+        0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+        0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+    };
+    bool dither = uir->dither != UIR_DITHER_NONE;
+    for (uint32_t y = 0; y < UIR_TILE_SIZE; ++y) {
+        uint8_t thresholds[UIR_TILE_SIZE];
+        if (!dither) {
+            memset(thresholds, 127, sizeof(thresholds));
+        } else {
+            memcpy(thresholds, UIR_dither_thresholds[y & 7], 8);
+            memcpy(thresholds + 8, UIR_dither_thresholds[y & 7], 8);
+        }
+
+        uint8_t bits[UIR_TILE_SIZE];
+        for (uint32_t x = 0; x < UIR_TILE_SIZE; ++x)
+            bits[x] = bit_values[x] & (uint8_t)-(luma[y*UIR_TILE_SIZE + x] > thresholds[x]);
+
+        for (uint32_t i = 0; i < UIR_TILE_SIZE / 8; ++i) {
+            uint64_t byte;
+            memcpy(&byte, &bits[i*8], 8);
+            byte |= byte >> 32;
+            byte |= byte >> 16;
+            byte |= byte >> 8;
+            packed[y*UIR_TILE_SIZE/8 + i] = (uint8_t)byte;
+        }
+    }
+}
+
+// ------------------------------
+// Compressed tiles
+
+// The first byte of a compressed tile.
+enum {
+    UIR_COMPRESSED_SOLID,   // the colour
+    UIR_COMPRESSED_PALETTE, // the colour count, the colours, then 1, 2 or 4 bit indices, first pixel in the top bits
+    UIR_COMPRESSED_RUNS,    // length - 1 and the colour of each run, until the tile is covered
+    UIR_COMPRESSED_RAW,     // the tile
+};
+
+#define UIR_COMPRESSED_MAX_TILE (1 + sizeof(UIR_Tile))
+#define UIR_COMPRESSED_MAX_COLOURS 16
+#define UIR_TILE_PIXELS (UIR_TILE_SIZE * UIR_TILE_SIZE)
+
+static uint32_t UIR_palette_bits(
+    uint32_t colour_count
+) {
+    return colour_count <= 2 ? 1 : colour_count <= 4 ? 2 : 4;
+}
+
+// Returns the size of a compressed tile.
+static size_t UIR_compressed_tile_size(
+    const uint8_t *in
+) {
+    switch (in[0]) {
+        case UIR_COMPRESSED_SOLID: return 1 + sizeof(RGBA);
+        case UIR_COMPRESSED_PALETTE: return 2 + in[1] * sizeof(RGBA) + UIR_TILE_PIXELS * UIR_palette_bits(in[1]) / 8;
+        case UIR_COMPRESSED_RUNS: {
+            size_t size = 1;
+            for (uint32_t covered = 0; covered < UIR_TILE_PIXELS; size += 5)
+                covered += in[size] + 1u;
+            return size;
+        }
+        default: return UIR_COMPRESSED_MAX_TILE;
+    }
+}
+
+// Compresses a tile into out, which holds UIR_COMPRESSED_MAX_TILE bytes. Returns the size.
+static size_t UIR_tile_compress(
+    const RGBA *tile,
+    uint8_t *restrict out
+) {
+    uint32_t px[UIR_TILE_PIXELS];
+    memcpy(px, tile, sizeof(px));
+
+    // colours, in order of first use, until there are too many
+    uint32_t colours[UIR_COMPRESSED_MAX_COLOURS];
+    uint8_t indices[UIR_TILE_PIXELS];
+    uint32_t colour_count = 1;
+    uint32_t run_count = 1;
+    uint32_t run_length = 1;
+    colours[0] = px[0];
+    indices[0] = 0;
+    for (uint32_t i = 1; i < UIR_TILE_PIXELS; ++i) {
+        bool same = px[i] == px[i - 1];
+        if (same && run_length < 256) {
+            run_length++;
+        } else {
+            run_count++;
+            run_length = 1;
+        }
+        if (same) {
+            indices[i] = indices[i - 1];
+            continue;
+        }
+
+        if (colour_count > UIR_COMPRESSED_MAX_COLOURS)
+            continue;
+        uint32_t c = 0;
+        while (c < colour_count && colours[c] != px[i])
+            c++;
+        if (c == colour_count) {
+            if (colour_count == UIR_COMPRESSED_MAX_COLOURS) {
+                colour_count++;
+                continue;
+            }
+            colours[colour_count++] = px[i];
+        }
+        indices[i] = (uint8_t)c;
+    }
+
+    size_t runs_size = 1 + run_count * 5;
+    size_t palette_size = colour_count > UIR_COMPRESSED_MAX_COLOURS
+        ? UIR_COMPRESSED_MAX_TILE
+        : 2 + colour_count * sizeof(RGBA) + UIR_TILE_PIXELS * UIR_palette_bits(colour_count) / 8;
+
+    if (colour_count == 1) {
+        out[0] = UIR_COMPRESSED_SOLID;
+        memcpy(out + 1, &colours[0], sizeof(RGBA));
+        return 1 + sizeof(RGBA);
+    }
+    if (palette_size <= runs_size && palette_size < UIR_COMPRESSED_MAX_TILE) {
+        uint32_t bits = UIR_palette_bits(colour_count);
+        uint32_t per_byte = 8 / bits;
+        out[0] = UIR_COMPRESSED_PALETTE;
+        out[1] = (uint8_t)colour_count;
+        memcpy(out + 2, colours, colour_count * sizeof(RGBA));
+        uint8_t *packed = out + 2 + colour_count * sizeof(RGBA);
+        for (uint32_t i = 0; i < UIR_TILE_PIXELS / per_byte; ++i) {
+            uint32_t byte = 0;
+            for (uint32_t j = 0; j < per_byte; ++j)
+                byte = (byte << bits) | indices[i * per_byte + j];
+            packed[i] = (uint8_t)byte;
+        }
+        return palette_size;
+    }
+    if (runs_size < UIR_COMPRESSED_MAX_TILE) {
+        out[0] = UIR_COMPRESSED_RUNS;
+        size_t size = 1;
+        for (uint32_t i = 0; i < UIR_TILE_PIXELS;) {
+            uint32_t length = 1;
+            while (i + length < UIR_TILE_PIXELS && length < 256 && px[i + length] == px[i])
+                length++;
+            out[size] = (uint8_t)(length - 1);
+            memcpy(out + size + 1, &px[i], sizeof(RGBA));
+            size += 5;
+            i += length;
+        }
+        return size;
+    }
+    out[0] = UIR_COMPRESSED_RAW;
+    memcpy(out + 1, tile, sizeof(UIR_Tile));
+    return UIR_COMPRESSED_MAX_TILE;
+}
+
+static void UIR_tile_decompress(
+    const uint8_t *in,
+    RGBA *restrict tile
+) {
+    switch (in[0]) {
+        case UIR_COMPRESSED_SOLID: {
+            RGBA colour;
+            memcpy(&colour, in + 1, sizeof(colour));
+            UIR_fill_tile(tile, colour);
+        } break;
+        case UIR_COMPRESSED_PALETTE: {
+            RGBA colours[UIR_COMPRESSED_MAX_COLOURS];
+            uint32_t colour_count = in[1];
+            uint32_t bits = UIR_palette_bits(colour_count);
+            uint32_t per_byte = 8 / bits;
+            uint32_t mask = (1u << bits) - 1;
+            memcpy(colours, in + 2, colour_count * sizeof(RGBA));
+            const uint8_t *packed = in + 2 + colour_count * sizeof(RGBA);
+            for (uint32_t i = 0; i < UIR_TILE_PIXELS; ++i) {
+                uint32_t shift = 8 - bits - (i % per_byte) * bits;
+                tile[i] = colours[(packed[i / per_byte] >> shift) & mask];
+            }
+        } break;
+        case UIR_COMPRESSED_RUNS: {
+            const uint8_t *run = in + 1;
+            for (uint32_t i = 0; i < UIR_TILE_PIXELS; run += 5) {
+                RGBA colour;
+                memcpy(&colour, run + 1, sizeof(colour));
+                for (uint32_t end = i + run[0] + 1; i < end; ++i)
+                    tile[i] = colour;
+            }
+        } break;
+        default:
+            memcpy(tile, in + 1, sizeof(UIR_Tile));
+    }
+}
+
+// Offsets into the block, one per tile, 0 for tiles that aren't compressed.
+static uint32_t UIR_compressed_offset(
+    UIR *uir,
+    uint32_t tile_idx
+) {
+    uint32_t offset;
+    memcpy(&offset, uir->compressed + (size_t)tile_idx * sizeof(offset), sizeof(offset));
+    return offset;
+}
+
+static void UIR_set_compressed_offset(
+    unsigned char *compressed,
+    uint32_t tile_idx,
+    uint32_t offset
+) {
+    memcpy(compressed + (size_t)tile_idx * sizeof(offset), &offset, sizeof(offset));
+}
+
+// Forgets the tile's compressed copy. Returns the copy, or NULL if it had none.
+static const uint8_t *UIR_tile_uncompressed(
+    UIR *uir,
+    uint32_t tile_idx
+) {
+    uint32_t offset = UIR_compressed_offset(uir, tile_idx);
+    if (!offset)
+        return NULL;
+    const uint8_t *in = uir->compressed + offset;
+    UIR_set_compressed_offset(uir->compressed, tile_idx, 0);
+    if (--uir->compressed_count == 0)
+        uir->compressed = NULL;
+    return in;
+}
+
+// Returns the tile's pixels, decompressing them first if needed.
+static inline RGBA *UIR_tile_pixels(
+    UIR *uir,
+    uint32_t tile_idx
+) {
+    if (uir->compressed_count) {
+        const uint8_t *in = UIR_tile_uncompressed(uir, tile_idx);
+        if (in)
+            UIR_tile_decompress(in, uir->tiles[tile_idx]);
+    }
+    return uir->tiles[tile_idx];
+}
+
+// Compresses every tile into compressed, if not NULL. Tiles still compressed are copied as they are.
+// Returns the size, or 0 if it's more than memory_size.
+static size_t UIR_compress_into(
+    UIR *uir,
+    unsigned char *compressed,
+    size_t memory_size
+) {
+    size_t size = (size_t)uir->tile_count * sizeof(uint32_t);
+    for (uint32_t tile_idx = 0; tile_idx < uir->tile_count; ++tile_idx) {
+        uint8_t buffer[UIR_COMPRESSED_MAX_TILE];
+        uint32_t offset = uir->compressed_count ? UIR_compressed_offset(uir, tile_idx) : 0;
+        const uint8_t *in = offset ? uir->compressed + offset : buffer;
+        size_t tile_size = offset ? UIR_compressed_tile_size(in) : UIR_tile_compress(uir->tiles[tile_idx], buffer);
+
+        if (size + tile_size > memory_size || size > UINT32_MAX)
+            return 0;
+        if (compressed) {
+            memcpy(compressed + size, in, tile_size);
+            UIR_set_compressed_offset(compressed, tile_idx, (uint32_t)size);
+        }
+        size += tile_size;
+    }
+    return size;
+}
+
+size_t UIR_compressed_size(
+    UIR *uir
+) {
+    if (!uir->tiles)
+        return 0;
+    return UIR_compress_into(uir, NULL, SIZE_MAX);
+}
+
+bool UIR_compress_tiles(
+    UIR *uir,
+    unsigned char *memory,
+    size_t memory_size
+) {
+    if (!uir->tiles || !uir->tile_count || !UIR_compress_into(uir, memory, memory_size))
+        return false;
+    uir->compressed = memory;
+    uir->compressed_count = uir->tile_count;
+    return true;
+}
+
+void UIR_decompress_tiles(
+    UIR *uir
+) {
+    for (uint32_t tile_idx = 0; uir->compressed_count && tile_idx < uir->tile_count; ++tile_idx)
+        UIR_tile_pixels(uir, tile_idx);
+}
+
+// The pixel at grid px (x, y), in any tile format.
+static inline RGBA UIR_grid_pixel(
+    UIR *uir,
+    uint32_t x,
+    uint32_t y
+) {
+    uint32_t tile_idx = UIR_tile_slot(uir, y / UIR_TILE_SIZE * uir->width_in_tiles + x / UIR_TILE_SIZE);
+    uint32_t px_idx = y % UIR_TILE_SIZE * UIR_TILE_SIZE + x % UIR_TILE_SIZE;
+    if (uir->tiles)
+        return UIR_tile_pixels(uir, tile_idx)[px_idx];
+
+    uint8_t *packed = UIR_packed_tile(uir, tile_idx);
+    uint8_t luma = uir->tile_format == UIR_TILE_FORMAT_L8
+        ? packed[px_idx]
+        : (packed[px_idx / 8] & (0x80 >> (px_idx & 7))) ? 255 : 0;
+    return (RGBA) { luma, luma, luma, 255 };
+}
+
+// ------------------------------
+// Drawing
+
+// Returns false if the tiles in view don't fit in memory.
+static bool UIR_draw_begin(
+    UIR *uir
+) {
+    if (uir->width_in_tiles * uir->height_in_tiles > uir->tile_count)
+        return false;
+
+    // assign pool slots to the tiles in view
+    if (uir->tile_slots && !UIR_virtual_map_tiles(uir))
+        return false;
+
+    uir->generation++;
+    return true;
+}
+
+// Seeds every tile's new hash, before the commands are mixed in.
+static void UIR_reset_tile_hashes(
+    UIR *uir
+) {
+    // Tiles are seeded with their canvas position, so a tile that scrolls back into view keeps its hash.
+    // The anchor moves every command, heatmaps tint every tile, and dithering changes every packed tile,
+    // so they are part of every tile's hash.
+    uint32_t heatmap = uir->debug_flags & (UIR_DEBUG_HEATMAP_OVERDRAW | UIR_DEBUG_HEATMAP_COST);
+    uint32_t dither = uir->tile_format == UIR_TILE_FORMAT_MONO ? uir->dither : 0;
+    uint32_t init_hash = UIR_hash((uint8_t*)&uir->clear_colour, sizeof(uir->clear_colour))
+        ^ UIR_murmur32_scramble(heatmap) * 5
+        ^ UIR_murmur32_scramble(dither) * 7
+        ^ UIR_murmur32_scramble((uint32_t)uir->anchor_x ^ (uint32_t)((uint64_t)uir->anchor_x >> 32))
+        ^ UIR_murmur32_scramble((uint32_t)uir->anchor_y ^ (uint32_t)((uint64_t)uir->anchor_y >> 32)) * 3;
+    for (uint32_t y = 0; y < uir->height_in_tiles; ++y) {
+        for (uint32_t x = 0; x < uir->width_in_tiles; ++x) {
+            uint32_t canvas_x = (uint32_t)(uir->grid_tile_x + x);
+            uint32_t canvas_y = (uint32_t)(uir->grid_tile_y + y);
+            uint32_t tile_idx = UIR_tile_slot(uir, y*uir->width_in_tiles + x);
+            uir->tile_info[tile_idx].hash_new = init_hash ^ canvas_x ^ (canvas_y << 16);
+        }
+    }
+}
+
+// Redraws one grid tile, and marks it up to date. Emits a span if sampled.
+static uint32_t UIR_redraw_tile(
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count,
+    UIR_CmdStream *stream,
+    uint32_t grid_idx,
+    UIR_Trace *trace,
+    bool sampled
+) {
+    uint32_t heatmap = uir->debug_flags & (UIR_DEBUG_HEATMAP_OVERDRAW | UIR_DEBUG_HEATMAP_COST);
+    uint32_t x = grid_idx % uir->width_in_tiles;
+    uint32_t y = grid_idx / uir->width_in_tiles;
+    uint32_t tile_idx = UIR_tile_slot(uir, grid_idx);
+    uir->tile_info[tile_idx].hash_old = uir->tile_info[tile_idx].hash_new;
+    uir->tile_info[tile_idx].generation = uir->generation;
+
+    // packed panels draw into a tile on the stack, then pack it
+    UIR_Tile unpacked;
+    RGBA *tile = uir->tiles ? uir->tiles[tile_idx] : unpacked;
+
+    // only read the clock for sampled tiles, or the cost heatmap
+    bool timed = trace && (sampled || (heatmap & UIR_DEBUG_HEATMAP_COST));
+    uint64_t tile_start = timed ? trace->now(trace->user_data) : 0;
+
+    uint32_t drawn = stream
+        ? UIR_stream_tile_draw(uir, stream, x, y, tile)
+        : UIR_tile_draw(uir, draw_cmds, draw_cmd_count, x, y, tile);
+
+    uint64_t tile_end = tile_start;
+    if (sampled)
+        UIR_trace_span(trace, "tile", &tile_end, (int32_t)x, (int32_t)y, drawn);
+    else if (timed)
+        tile_end = trace->now(trace->user_data);
+
+    // without a clock, the cost heatmap falls back to overdraw
+    if (heatmap && timed && !(heatmap & UIR_DEBUG_HEATMAP_OVERDRAW))
+        UIR_tile_draw_heat(tile, (float)(tile_end - tile_start) / UIR_HEATMAP_MAX_COST);
+    else if (heatmap)
+        UIR_tile_draw_heat(tile, (float)drawn / UIR_HEATMAP_MAX_OVERDRAW);
+
+    if (!uir->tiles)
+        UIR_tile_pack(uir, tile_idx, tile);
+    return drawn;
+}
+
+static inline bool UIR_tile_changed(
+    UIR *uir,
+    uint32_t grid_idx
+) {
+    UIR_TileInfo *tile_info = &uir->tile_info[UIR_tile_slot(uir, grid_idx)];
+    return tile_info->hash_old != tile_info->hash_new || (uir->debug_flags & UIR_DEBUG_REFERENCE);
+}
+
+// Forgets the compressed copies of the tiles about to be redrawn, before any are drawn, so tiles
+// can be drawn from several threads without touching uir->compressed. With keep_pixels, the copies
+// are decompressed instead, for tiles that may stay on screen until a later draw redraws them.
+static void UIR_drop_changed_compressed(
+    UIR *uir,
+    bool keep_pixels
+) {
+    uint32_t grid_tile_count = uir->width_in_tiles * uir->height_in_tiles;
+    for (uint32_t grid_idx = 0; uir->compressed_count && grid_idx < grid_tile_count; ++grid_idx) {
+        if (!UIR_tile_changed(uir, grid_idx))
+            continue;
+        uint32_t tile_idx = UIR_tile_slot(uir, grid_idx);
+        if (keep_pixels)
+            UIR_tile_pixels(uir, tile_idx);
+        else
+            UIR_tile_uncompressed(uir, tile_idx);
+    }
+}
+
+// Draws the tiles whose hash changed among grid tiles [first_tile, end_tile), from the command array,
+// or from stream if it isn't NULL. Without phase_start, emits no spans.
+static uint32_t UIR_draw_changed_tiles(
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count,
+    UIR_CmdStream *stream,
+    uint32_t first_tile,
+    uint32_t end_tile,
+    UIR_Trace *trace,
+    uint64_t *phase_start
+) {
+    uint32_t redrawn = 0;
+    for (uint32_t grid_idx = first_tile; grid_idx < end_tile; ++grid_idx) {
+        if (UIR_tile_changed(uir, grid_idx)) {
+            redrawn++;
+            bool sampled = phase_start && trace && trace->tile_sample_rate && redrawn % trace->tile_sample_rate == 0;
+            UIR_redraw_tile(uir, draw_cmds, draw_cmd_count, stream, grid_idx, trace, sampled);
+        }
+    }
+
+    if (trace && phase_start)
+        UIR_trace_span(trace, "raster", phase_start, -1, -1, redrawn);
+
+    return redrawn;
+}
+
+// Everything UIR_draw does before drawing tiles. Returns false if there is nothing to draw into.
+// Unless lazy_groups, every group's commands are prepared, so tiles can be drawn from several threads.
+static bool UIR_draw_prepare_cmds(
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count,
+    bool lazy_groups,
+    UIR_Trace *trace,
+    uint64_t *phase_start
+) {
+    if (!UIR_draw_begin(uir))
+        return false;
+
+    // ------------------------------
+    // easy optimization prepass
+
+    bool reference = uir->debug_flags & UIR_DEBUG_REFERENCE;
+    for (uint32_t i = 0; i < draw_cmd_count; ++i) {
+        UIR_DrawCmd *cmd = &draw_cmds[i];
+        if (cmd->common.type != UIR_DRAW_GROUP) {
+            UIR_draw_cmd_prepare(cmd, reference);
+            continue;
+        }
+
+        // unchanged groups are skipped, and prepared later if a tile they cover is redrawn.
+        // A new hash, even one set by the app, prepares the group to find whether it is live.
+        UIR_DrawCmd_Group *group = &cmd->group;
+        uint32_t count = UIR_group_cmd_count(cmd, draw_cmds + draw_cmd_count);
+        group->prepared = !group->hash || group->hash != group->live_hash || group->live || reference || !lazy_groups;
+        if (group->prepared)
+            UIR_group_prepare(cmd, count, reference);
+        i += count;
+    }
+
+    if (trace)
+        UIR_trace_span(trace, "prepass", phase_start, -1, -1, draw_cmd_count);
+
+    // ------------------------------
+    // bin path segments into tiles
+
+    if (uir->scratch && !reference) {
+        UIR_Arena scratch = { uir->scratch, uir->scratch + uir->scratch_size };
+        uint32_t path_count = 0;
+        uint32_t group_end = 0;
+        for (uint32_t i = 0; i < draw_cmd_count; ++i) {
+            UIR_DrawCmd *cmd = &draw_cmds[i];
+            if (cmd->common.type == UIR_DRAW_GROUP && i >= group_end) {
+                // paths in unprepared groups are binned, or not, when a tile needs them
+                uint32_t count = UIR_group_cmd_count(cmd, draw_cmds + draw_cmd_count);
+                group_end = i + 1 + count;
+                if (!cmd->group.prepared)
+                    i += count;
+            } else if (cmd->common.type == UIR_DRAW_PATH_STROKE || cmd->common.type == UIR_DRAW_PATH_FILL) {
+                cmd->path.bins = UIR_path_bin(uir, &scratch, &cmd->path);
+                path_count++;
+            }
+        }
+
+        if (trace)
+            UIR_trace_span(trace, "bin paths", phase_start, -1, -1, path_count);
+    }
+    
+    UIR_reset_tile_hashes(uir);
+
+    // ------------------------------
+    // hash draw_cmds for tiles
+
+    for (uint32_t i = 0; i < draw_cmd_count; ++i) {
+        UIR_DrawCmd *cmd = &draw_cmds[i];
+        if (cmd->common.type != UIR_DRAW_GROUP) {
+            UIR_hash_cmd_into_tiles(uir, cmd, UIR_hash_draw_cmd(cmd));
+            continue;
+        }
+
+        // an unchanged group stands in for its commands, unless they show images that may have changed
+        UIR_DrawCmd_Group *group = &cmd->group;
+        uint32_t count = UIR_group_cmd_count(cmd, draw_cmds + draw_cmd_count);
+        if (group->live) {
+            for (uint32_t j = 1; j <= count; ++j) {
+                if (cmd[j].common.type != UIR_DRAW_GROUP)
+                    UIR_hash_cmd_into_tiles(uir, &cmd[j], UIR_hash_draw_cmd(&cmd[j]));
+            }
+        } else {
+            UIR_hash_cmd_into_tiles(uir, cmd, group->hash);
+        }
+        i += count;
+    }
+
+    if (trace)
+        UIR_trace_span(trace, "hash", phase_start, -1, -1, draw_cmd_count);
+
+    return true;
+}
+
+uint32_t UIR_draw(
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count
 ) {
-    switch (cmd->common.type) {
-        case UIR_DRAW_SHAPE_RECT: {
-            UIR_DrawCmd_Shape *shape = &cmd->shape;
-            
-            float nonfill_size = shape->outline_radius * 2.f + shape->corner_radius + 2.f;
-            UIR_Rect fill_rect = {
-                shape->rect.x0 + nonfill_size,
-                shape->rect.y0 + nonfill_size,
-                shape->rect.x1 - nonfill_size,
-                shape->rect.y1 - nonfill_size,
-            };
-            
-            *fill_colour = shape->fill_colour;
-            return UIR_rect_inside(tile_rect, &fill_rect);
-        }
+    UIR_Trace *trace = uir->trace && uir->trace->now ? uir->trace : NULL;
+    uint64_t phase_start = trace ? trace->now(trace->user_data) : 0;
+    if (!UIR_draw_prepare_cmds(uir, draw_cmds, draw_cmd_count, true, trace, &phase_start))
+        return 0;
+    UIR_drop_changed_compressed(uir, false);
 
-        case UIR_DRAW_SHAPE_CIRCLE: {
-            UIR_DrawCmd_Shape *shape = &cmd->shape;
-            
-            float nonfill_radius = shape->outline_radius * 2.f + 2.f;
-            
-            float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
-            float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
-            float radius = UIR_min(w2, h2);
-            float fill_radius = radius - nonfill_radius;
-            float fill_radius_sq = fill_radius * fill_radius;
-            
-            float x = shape->rect.x0 + w2;
-            float y = shape->rect.y0 + h2;
+    uint32_t grid_tile_count = uir->width_in_tiles * uir->height_in_tiles;
+    return UIR_draw_changed_tiles(uir, draw_cmds, draw_cmd_count, NULL, 0, grid_tile_count, trace, &phase_start);
+}
 
-            float corners_x[4] = { tile_rect->x0, tile_rect->x0, tile_rect->x1, tile_rect->x1 };
-            float corners_y[4] = { tile_rect->y0, tile_rect->y1, tile_rect->y0, tile_rect->y1 };
-            float corners_dist_sq[4];
+uint32_t UIR_draw_prepare(
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count
+) {
+    UIR_Trace *trace = uir->trace && uir->trace->now ? uir->trace : NULL;
+    uint64_t phase_start = trace ? trace->now(trace->user_data) : 0;
+    if (!UIR_draw_prepare_cmds(uir, draw_cmds, draw_cmd_count, false, trace, &phase_start))
+        return 0;
+    // the app draws every changed tile, maybe from several threads
+    UIR_drop_changed_compressed(uir, false);
 
-            for (uint32_t i = 0; i < 4; ++i) {
-                corners_x[i] -= x;
-                corners_y[i] -= y;
-                corners_x[i] *= corners_x[i];
-                corners_y[i] *= corners_y[i];
-                corners_dist_sq[i] = corners_x[i] + corners_y[i];
-            }
-            
-            bool all_inside = true;
-            for (uint32_t i = 0; i < 4; ++i)
-                all_inside &= corners_dist_sq[i] <= fill_radius_sq;
+    uint32_t grid_tile_count = uir->width_in_tiles * uir->height_in_tiles;
+    if (uir->debug_flags & UIR_DEBUG_REFERENCE)
+        return grid_tile_count;
 
-            *fill_colour = shape->fill_colour;
-            return all_inside;
-        } break;
+    uint32_t changed = 0;
+    for (uint32_t i = 0; i < grid_tile_count; ++i) {
+        UIR_TileInfo *tile_info = &uir->tile_info[UIR_tile_slot(uir, i)];
+        changed += tile_info->hash_old != tile_info->hash_new;
+    }
+    return changed;
+}
 
-        default:
-            return false;
+uint32_t UIR_draw_tiles(
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count,
+    uint32_t first_tile,
+    uint32_t end_tile
+) {
+    uint32_t grid_tile_count = uir->width_in_tiles * uir->height_in_tiles;
+    if (grid_tile_count > uir->tile_count)
+        return 0;
+    end_tile = end_tile < grid_tile_count ? end_tile : grid_tile_count;
+
+    UIR_Trace *trace = uir->trace && uir->trace->now ? uir->trace : NULL;
+    return UIR_draw_changed_tiles(uir, draw_cmds, draw_cmd_count, NULL, first_tile, end_tile, trace, NULL);
+}
+
+// ------------------------------
+// Progressive drawing
+
+typedef struct UIR_Progress {
+    UIR *uir;
+    UIR_DrawCmd *draw_cmds;
+    uint32_t draw_cmd_count;
+    const UIR_DrawBudget *budget;
+    UIR_Trace *trace;
+
+    uint32_t redrawn;
+    uint64_t last_time;
+    uint64_t slowest_tile;
+} UIR_Progress;
+
+// Draws the grid tile if it changed. Returns false once the budget is spent.
+static bool UIR_progress_tile(
+    UIR_Progress *progress,
+    uint32_t grid_idx
+) {
+    UIR *uir = progress->uir;
+    const UIR_DrawBudget *budget = progress->budget;
+    if (!UIR_tile_changed(uir, grid_idx))
+        return true;
+
+    if (progress->redrawn && budget->max_tiles && progress->redrawn >= budget->max_tiles)
+        return false;
+
+    if (budget->now) {
+        uint64_t time = budget->now(budget->user_data);
+        if (progress->redrawn) {
+            uint64_t tile_time = time - progress->last_time;
+            progress->slowest_tile = tile_time > progress->slowest_tile ? tile_time : progress->slowest_tile;
+            if (time + progress->slowest_tile > budget->deadline)
+                return false;
+        }
+        progress->last_time = time;
     }
+
+    progress->redrawn++;
+    UIR_Trace *trace = progress->trace;
+    bool sampled = trace && trace->tile_sample_rate && progress->redrawn % trace->tile_sample_rate == 0;
+    UIR_redraw_tile(uir, progress->draw_cmds, progress->draw_cmd_count, NULL, grid_idx, trace, sampled);
+    return true;
 }
 
-static void UIR_tile_draw(
+uint32_t UIR_draw_progressive(
     UIR *uir,
     UIR_DrawCmd *draw_cmds,
     uint32_t draw_cmd_count,
-    uint32_t tile_x,
-    uint32_t tile_y
+    const UIR_DrawBudget *budget,
+    uint32_t *remaining
 ) {
-    uint32_t tile_idx = tile_y * uir->width_in_tiles + tile_x;
+    *remaining = 0;
+    UIR_Trace *trace = uir->trace && uir->trace->now ? uir->trace : NULL;
+    uint64_t phase_start = trace ? trace->now(trace->user_data) : 0;
+    if (!UIR_draw_prepare_cmds(uir, draw_cmds, draw_cmd_count, true, trace, &phase_start))
+        return 0;
+    // tiles past the budget keep showing what they showed until a later call
+    UIR_drop_changed_compressed(uir, true);
+
+    if (!uir->width_in_tiles || !uir->height_in_tiles)
+        return 0;
 
-    UIR_Rect tile_rect = {
-        .x0 = (float)(tile_x * UIR_TILE_SIZE),
-        .y0 = (float)(tile_y * UIR_TILE_SIZE),
-        .x1 = (float)((tile_x + 1) * UIR_TILE_SIZE),
-        .y1 = (float)((tile_y + 1) * UIR_TILE_SIZE),
+    // in reference mode every tile counts as changed on every call, so a budget would never finish
+    UIR_DrawBudget unlimited = { .focus = budget->focus };
+    if (uir->debug_flags & UIR_DEBUG_REFERENCE)
+        budget = &unlimited;
+
+    UIR_Progress progress = {
+        .uir = uir,
+        .draw_cmds = draw_cmds,
+        .draw_cmd_count = draw_cmd_count,
+        .budget = budget,
+        .trace = trace,
     };
 
-    UIR_DrawCmd *draw_cmds_start = draw_cmds;
-    UIR_DrawCmd *draw_cmds_end = draw_cmds_start + draw_cmd_count;
+    // the grid tiles the focus touches
+    int32_t width = (int32_t)uir->width_in_tiles;
+    int32_t height = (int32_t)uir->height_in_tiles;
+    const UIR_Rect *focus = &budget->focus;
+    int32_t fx0 = (int32_t)UIR_clamp((focus->x0 - uir->grid_x) / UIR_TILE_SIZE, 0, (float)(width - 1));
+    int32_t fy0 = (int32_t)UIR_clamp((focus->y0 - uir->grid_y) / UIR_TILE_SIZE, 0, (float)(height - 1));
+    int32_t fx1 = (int32_t)UIR_clamp(ceilf((focus->x1 - uir->grid_x) / UIR_TILE_SIZE) - 1, 0, (float)(width - 1));
+    int32_t fy1 = (int32_t)UIR_clamp(ceilf((focus->y1 - uir->grid_y) / UIR_TILE_SIZE) - 1, 0, (float)(height - 1));
+    fx1 = fx1 > fx0 ? fx1 : fx0;
+    fy1 = fy1 > fy0 ? fy1 : fy0;
 
-    // Find clear colour
-    RGBA clear_colour = uir->clear_colour;
-    for (; draw_cmds != draw_cmds_end; draw_cmds++) {
-        RGBA fill_colour;
-        if (UIR_draw_cmd_is_fill(&fill_colour, &tile_rect, draw_cmds)) {
-            UIR_blend(&clear_colour, fill_colour, 1.f);
-        } else if (UIR_rect_intersect(&tile_rect, &draw_cmds->common.rect)) {
-            break;
+    for (int32_t y = fy0; y <= fy1; ++y) {
+        for (int32_t x = fx0; x <= fx1; ++x) {
+            if (!UIR_progress_tile(&progress, (uint32_t)(y*width + x)))
+                goto done;
         }
     }
 
-    // Clear tile
-    UIR_fill_tile(uir->tiles[tile_idx], clear_colour);
-    
-    // Draw!
-    for (; draw_cmds != draw_cmds_end; draw_cmds++) {
-        if (UIR_rect_intersect(&tile_rect, &draw_cmds->common.rect))
-            UIR_tile_draw_cmd(uir->tiles[tile_idx], &tile_rect, draw_cmds);
+    // then each ring around it, clipped to the grid
+    for (int32_t d = 1; fx0 - d >= 0 || fy0 - d >= 0 || fx1 + d < width || fy1 + d < height; ++d) {
+        int32_t x0 = fx0 - d, y0 = fy0 - d;
+        int32_t x1 = fx1 + d, y1 = fy1 + d;
+        int32_t row_x0 = x0 > 0 ? x0 : 0;
+        int32_t row_x1 = x1 < width - 1 ? x1 : width - 1;
+        int32_t column_y0 = y0 + 1 > 0 ? y0 + 1 : 0;
+        int32_t column_y1 = y1 - 1 < height - 1 ? y1 - 1 : height - 1;
+
+        for (int32_t x = row_x0; y0 >= 0 && x <= row_x1; ++x) {
+            if (!UIR_progress_tile(&progress, (uint32_t)(y0*width + x)))
+                goto done;
+        }
+        for (int32_t x = row_x0; y1 < height && x <= row_x1; ++x) {
+            if (!UIR_progress_tile(&progress, (uint32_t)(y1*width + x)))
+                goto done;
+        }
+        for (int32_t y = column_y0; x0 >= 0 && y <= column_y1; ++y) {
+            if (!UIR_progress_tile(&progress, (uint32_t)(y*width + x0)))
+                goto done;
+        }
+        for (int32_t y = column_y0; x1 < width && y <= column_y1; ++y) {
+            if (!UIR_progress_tile(&progress, (uint32_t)(y*width + x1)))
+                goto done;
+        }
     }
+
+done:
+    if (trace)
+        UIR_trace_span(trace, "raster", &phase_start, -1, -1, progress.redrawn);
+
+    // in reference mode every tile was drawn, though each still counts as changed
+    uint32_t grid_tile_count = uir->width_in_tiles * uir->height_in_tiles;
+    for (uint32_t i = 0; i < grid_tile_count && !(uir->debug_flags & UIR_DEBUG_REFERENCE); ++i)
+        *remaining += UIR_tile_changed(uir, i);
+    return progress.redrawn;
 }
 
-uint32_t UIR_draw(
+uint32_t UIR_draw_stream(
     UIR *uir,
-    UIR_DrawCmd *draw_cmds,
-    uint32_t draw_cmd_count
+    UIR_CmdStream *stream
 ) {
-    // ------------------------------
-    // easy optimization prepass
+    UIR_Trace *trace = uir->trace && uir->trace->now ? uir->trace : NULL;
+    uint64_t phase_start = trace ? trace->now(trace->user_data) : 0;
+    if (!UIR_draw_begin(uir))
+        return 0;
 
-    for (uint32_t i = 0; i < draw_cmd_count; ++i) {
-        UIR_DrawCmd *cmd = &draw_cmds[i];
-        switch (cmd->common.type) {
-
-            // tighten circle bounding box
-            case UIR_DRAW_SHAPE_CIRCLE: {
-                UIR_DrawCmd_Shape *shape = &cmd->shape;
-
-                float w2 = (shape->rect.x1 - shape->rect.x0) * 0.5f;
-                float h2 = (shape->rect.y1 - shape->rect.y0) * 0.5f;
-                float radius = UIR_min(w2, h2);
-
-                float x = shape->rect.x0 + w2;
-                float y = shape->rect.y0 + h2;
-                
-                shape->rect.x0 = x - radius;
-                shape->rect.y0 = y - radius;
-                shape->rect.x1 = x + radius;
-                shape->rect.y1 = y + radius;
-            } break;
+    // ------------------------------
+    // easy optimization prepass, in place, then refresh the bounding boxes
 
-            default:
-                break;
+    bool reference = uir->debug_flags & UIR_DEBUG_REFERENCE;
+    for (uint32_t i = 0; i < stream->count; ++i) {
+        UIR_DrawCmd *cmd = (UIR_DrawCmd*)(stream->payload + stream->offsets[i]);
+        if (UIR_cmd_stream_is_short_shape(stream, i, cmd->common.type)) {
+            // short shapes have no room for the kernel, so only their rect is kept
+            UIR_DrawCmd shape;
+            UIR_cmd_stream_unpack(stream, i, &shape, reference);
+            UIR_draw_cmd_prepare(&shape, reference);
+            cmd->shape.rect = shape.shape.rect;
+        } else {
+            UIR_draw_cmd_prepare(cmd, reference);
         }
+
+        stream->x0[i] = cmd->common.rect.x0;
+        stream->y0[i] = cmd->common.rect.y0;
+        stream->x1[i] = cmd->common.rect.x1;
+        stream->y1[i] = cmd->common.rect.y1;
     }
-    
+
+    if (trace)
+        UIR_trace_span(trace, "prepass", &phase_start, -1, -1, stream->count);
+
     // ------------------------------
-    // reset hashes
-    
-    uint32_t init_hash = UIR_hash((uint8_t*)&uir->clear_colour, sizeof(uir->clear_colour));
-    for (uint32_t y = 0; y < uir->height_in_tiles; ++y)
-        for (uint32_t x = 0; x < uir->width_in_tiles; ++x)
-            uir->tile_info[y*uir->width_in_tiles + x].hash_new = init_hash ^ x ^ (y << 16);
+    // bin path segments into tiles
+
+    if (uir->scratch && !reference) {
+        UIR_Arena scratch = { uir->scratch, uir->scratch + uir->scratch_size };
+        uint32_t path_count = 0;
+        for (uint32_t i = 0; i < stream->count; ++i) {
+            UIR_DrawCmd *cmd = (UIR_DrawCmd*)(stream->payload + stream->offsets[i]);
+            if (cmd->common.type == UIR_DRAW_PATH_STROKE || cmd->common.type == UIR_DRAW_PATH_FILL) {
+                cmd->path.bins = UIR_path_bin(uir, &scratch, &cmd->path);
+                path_count++;
+            }
+        }
+
+        if (trace)
+            UIR_trace_span(trace, "bin paths", &phase_start, -1, -1, path_count);
+    }
+
+    UIR_reset_tile_hashes(uir);
 
     // ------------------------------
-    // hash draw_cmds for tiles
+    // hash commands for tiles
 
-    for (uint32_t i = 0; i < draw_cmd_count; ++i) {
-        UIR_DrawCmd *cmd = &draw_cmds[i];
+    for (uint32_t i = 0; i < stream->count; ++i) {
+        UIR_DrawCmd *cmd = (UIR_DrawCmd*)(stream->payload + stream->offsets[i]);
+        UIR_Hash hash = UIR_cmd_stream_is_short_shape(stream, i, cmd->common.type)
+            ? UIR_hash((unsigned char*)cmd, offsetof(UIR_DrawCmd_Shape, fill_gradient))
+            : UIR_hash_draw_cmd(cmd);
+        UIR_hash_cmd_into_tiles(uir, cmd, hash);
+    }
 
-        uint32_t draw_cmd_hash = UIR_hash_draw_cmd(cmd);
+    if (trace)
+        UIR_trace_span(trace, "hash", &phase_start, -1, -1, stream->count);
 
-        UIR_Rect *bb = &cmd->common.rect;
-        uint32_t x0 = (uint32_t)(bb->x0 / UIR_TILE_SIZE);
-        uint32_t y0 = (uint32_t)(bb->y0 / UIR_TILE_SIZE);
-        uint32_t x1 = (uint32_t)((bb->x1 + (UIR_TILE_SIZE - 1)) / UIR_TILE_SIZE);
-        uint32_t y1 = (uint32_t)((bb->y1 + (UIR_TILE_SIZE - 1)) / UIR_TILE_SIZE);
-        
-        for (uint32_t y = y0; y < y1; ++y) {
-            for (uint32_t x = x0; x < x1; ++x) {
-                uint32_t tile_idx = y * uir->width_in_tiles + x;
-                uir->tile_info[tile_idx].hash_new ^= draw_cmd_hash;
-            }
+    UIR_drop_changed_compressed(uir, false);
+    uint32_t grid_tile_count = uir->width_in_tiles * uir->height_in_tiles;
+    return UIR_draw_changed_tiles(uir, NULL, 0, stream, 0, grid_tile_count, trace, &phase_start);
+}
+
+// ------------------------------
+// Command builders
+
+void UIR_builder_begin(
+    UIR_Builder *builder,
+    UIR *uir,
+    UIR_DrawCmd *cmd_memory,
+    uint32_t cmd_capacity
+) {
+    *builder = (UIR_Builder) {
+        .uir = uir,
+        .cmds = cmd_memory,
+        .cmd_capacity = cmd_capacity,
+        .scratch = uir->scratch,
+    };
+    builder->ready = UIR_draw_begin(uir);
+    if (builder->ready)
+        UIR_reset_tile_hashes(uir);
+}
+
+// Does for one command what UIR_draw_prepare_cmds does for every command.
+const UIR_DrawCmd *UIR_builder_push(
+    UIR_Builder *builder,
+    const UIR_DrawCmd *cmd
+) {
+    if (cmd->common.type == UIR_DRAW_GROUP)
+        return NULL;
+    if (builder->cmd_count == builder->cmd_capacity) {
+        builder->error_flags |= UIR_ERROR_NO_MEM;
+        return NULL;
+    }
+
+    UIR_DrawCmd *pushed = &builder->cmds[builder->cmd_count++];
+    *pushed = *cmd;
+    if (!builder->ready)
+        return pushed;
+
+    UIR *uir = builder->uir;
+    bool reference = uir->debug_flags & UIR_DEBUG_REFERENCE;
+    UIR_draw_cmd_prepare(pushed, reference);
+
+    bool path = pushed->common.type == UIR_DRAW_PATH_STROKE || pushed->common.type == UIR_DRAW_PATH_FILL;
+    if (path && uir->scratch && !reference) {
+        UIR_Arena scratch = { builder->scratch, uir->scratch + uir->scratch_size };
+        pushed->path.bins = UIR_path_bin(uir, &scratch, &pushed->path);
+        builder->scratch = scratch.ptr;
+    }
+
+    UIR_hash_cmd_into_tiles(uir, pushed, UIR_hash_draw_cmd(pushed));
+    return pushed;
+}
+
+bool UIR_push_rect(
+    UIR_Builder *builder,
+    UIR_Rect rect,
+    RGBA fill_colour,
+    RGBA outline_colour,
+    float outline_radius,
+    float corner_radius
+) {
+    UIR_DrawCmd cmd = { .shape = {
+        .type = UIR_DRAW_SHAPE_RECT,
+        .rect = rect,
+        .fill_colour = fill_colour,
+        .outline_colour = outline_colour,
+        .outline_radius = outline_radius,
+        .corner_radius = corner_radius,
+    }};
+    return UIR_builder_push(builder, &cmd) != NULL;
+}
+
+bool UIR_push_circle(
+    UIR_Builder *builder,
+    UIR_Rect rect,
+    RGBA fill_colour,
+    RGBA outline_colour,
+    float outline_radius
+) {
+    UIR_DrawCmd cmd = { .shape = {
+        .type = UIR_DRAW_SHAPE_CIRCLE,
+        .rect = rect,
+        .fill_colour = fill_colour,
+        .outline_colour = outline_colour,
+        .outline_radius = outline_radius,
+    }};
+    return UIR_builder_push(builder, &cmd) != NULL;
+}
+
+bool UIR_push_image(
+    UIR_Builder *builder,
+    UIR_Rect rect,
+    uint8_t *data,
+    uint32_t data_stride,
+    float scale
+) {
+    UIR_DrawCmd cmd = { .image = {
+        .type = UIR_DRAW_IMAGE_RGBA,
+        .rect = rect,
+        .data = data,
+        .data_stride = data_stride,
+        .scale = scale,
+    }};
+    return UIR_builder_push(builder, &cmd) != NULL;
+}
+
+uint32_t UIR_builder_draw(
+    UIR_Builder *builder
+) {
+    if (!builder->ready)
+        return 0;
+    builder->ready = false;
+
+    UIR *uir = builder->uir;
+    UIR_Trace *trace = uir->trace && uir->trace->now ? uir->trace : NULL;
+    uint64_t phase_start = trace ? trace->now(trace->user_data) : 0;
+    UIR_drop_changed_compressed(uir, false);
+    uint32_t grid_tile_count = uir->width_in_tiles * uir->height_in_tiles;
+    return UIR_draw_changed_tiles(uir, builder->cmds, builder->cmd_count, NULL, 0, grid_tile_count, trace, &phase_start);
+}
+
+// ------------------------------
+// Changed tiles
+
+// Differences, rather than comparisons, so generations may wrap.
+static inline bool UIR_generation_after(
+    uint32_t generation,
+    uint32_t since
+) {
+    return (int32_t)(generation - since) > 0;
+}
+
+uint32_t UIR_tiles_changed_since(
+    UIR *uir,
+    uint32_t generation,
+    uint32_t *tile_indices,
+    uint32_t capacity
+) {
+    uint32_t grid_tile_count = uir->width_in_tiles * uir->height_in_tiles;
+    if (grid_tile_count > uir->tile_count)
+        return 0;
+
+    // grid tiles show other canvas tiles, or sit elsewhere in the panel
+    bool all = UIR_generation_after(uir->layout_generation, generation);
+
+    uint32_t changed = 0;
+    for (uint32_t grid_idx = 0; grid_idx < grid_tile_count; ++grid_idx) {
+        if (all || UIR_generation_after(uir->tile_info[UIR_tile_slot(uir, grid_idx)].generation, generation)) {
+            if (changed < capacity)
+                tile_indices[changed] = grid_idx;
+            changed++;
         }
     }
+    return changed;
+}
 
-    // ------------------------------
-    // draw tiles that have changed
+static inline int64_t UIR_pixel_rect_area(
+    UIR_PixelRect rect
+) {
+    return (int64_t)(rect.x1 - rect.x0) * (int64_t)(rect.y1 - rect.y0);
+}
 
-    uint32_t redrawn = 0;
+// Adds a rect one tile row high, stacking it onto the rect of the row above if it spans the same columns.
+static void UIR_add_changed_rect(
+    UIR_PixelRect *rects,
+    uint32_t *count,
+    uint32_t max_rects,
+    UIR_PixelRect rect
+) {
+    for (uint32_t i = 0; i < *count; ++i) {
+        if (rects[i].x0 == rect.x0 && rects[i].x1 == rect.x1 && rects[i].y1 == rect.y0) {
+            rects[i].y1 = rect.y1;
+            return;
+        }
+    }
+    if (*count < max_rects) {
+        rects[(*count)++] = rect;
+        return;
+    }
+
+    // merge into the rect that covers the fewest extra pixels
+    uint32_t best = 0;
+    int64_t best_extra = INT64_MAX;
+    for (uint32_t i = 0; i < *count; ++i) {
+        UIR_PixelRect merged = {
+            rects[i].x0 < rect.x0 ? rects[i].x0 : rect.x0,
+            rects[i].y0 < rect.y0 ? rects[i].y0 : rect.y0,
+            rects[i].x1 > rect.x1 ? rects[i].x1 : rect.x1,
+            rects[i].y1 > rect.y1 ? rects[i].y1 : rect.y1,
+        };
+        int64_t extra = UIR_pixel_rect_area(merged) - UIR_pixel_rect_area(rects[i]) - UIR_pixel_rect_area(rect);
+        if (extra < best_extra) {
+            best = i;
+            best_extra = extra;
+        }
+    }
+    UIR_PixelRect *target = &rects[best];
+    target->x0 = target->x0 < rect.x0 ? target->x0 : rect.x0;
+    target->y0 = target->y0 < rect.y0 ? target->y0 : rect.y0;
+    target->x1 = target->x1 > rect.x1 ? target->x1 : rect.x1;
+    target->y1 = target->y1 > rect.y1 ? target->y1 : rect.y1;
+}
 
-    uint32_t width_in_tiles = uir->width_in_tiles;
-    uint32_t height_in_tiles = uir->height_in_tiles;
-    for (uint32_t y = 0; y < height_in_tiles; ++y) {
-        for (uint32_t x = 0; x < width_in_tiles; ++x) {
-            uint32_t tile_idx = y * width_in_tiles + x;
-            UIR_TileInfo *tile_info = &uir->tile_info[tile_idx];
+uint32_t UIR_changed_rects_since(
+    UIR *uir,
+    uint32_t generation,
+    UIR_PixelRect *rects,
+    uint32_t max_rects
+) {
+    uint32_t grid_tile_count = uir->width_in_tiles * uir->height_in_tiles;
+    if (grid_tile_count > uir->tile_count || !max_rects)
+        return 0;
+
+    bool all = UIR_generation_after(uir->layout_generation, generation);
+
+    // the grid starts scroll px above and left of the viewport, and may reach past it
+    uint32_t count = 0;
+    for (uint32_t tile_y = 0; tile_y < uir->height_in_tiles; ++tile_y) {
+        uint32_t y0 = tile_y * UIR_TILE_SIZE;
+        uint32_t y1 = y0 + UIR_TILE_SIZE;
+        y0 = (y0 > uir->scroll_y ? y0 : uir->scroll_y) - uir->scroll_y;
+        y1 = (y1 < uir->height_in_px + uir->scroll_y ? y1 : uir->height_in_px + uir->scroll_y) - uir->scroll_y;
+        if (y0 >= y1)
+            continue;
 
-            if (tile_info->hash_old != tile_info->hash_new) {
-                redrawn++;
-                tile_info->hash_old = tile_info->hash_new;
-                UIR_tile_draw(uir, draw_cmds, draw_cmd_count, x, y);
+        uint32_t tile_x = 0;
+        while (tile_x < uir->width_in_tiles) {
+            uint32_t run_start = tile_x;
+            while (tile_x < uir->width_in_tiles && (all || UIR_generation_after(
+                uir->tile_info[UIR_tile_slot(uir, tile_y * uir->width_in_tiles + tile_x)].generation, generation
+            )))
+                tile_x++;
+            if (tile_x == run_start) {
+                tile_x++;
+                continue;
             }
+
+            uint32_t x0 = run_start * UIR_TILE_SIZE;
+            uint32_t x1 = tile_x * UIR_TILE_SIZE;
+            x0 = (x0 > uir->scroll_x ? x0 : uir->scroll_x) - uir->scroll_x;
+            x1 = (x1 < uir->width_in_px + uir->scroll_x ? x1 : uir->width_in_px + uir->scroll_x) - uir->scroll_x;
+            if (x0 < x1)
+                UIR_add_changed_rect(rects, &count, max_rects, (UIR_PixelRect) { x0, y0, x1, y1 });
         }
     }
-    
-    return redrawn;
+    return count;
+}
+
+// ------------------------------
+// Thumbnails
+
+// Each tile is 4x4 px of level 0 and 2x2 px of level 1.
+#define UIR_THUMBNAIL_TILE (UIR_TILE_SIZE / 4)
+
+static size_t UIR_thumbnail_grid_size(
+    uint32_t width_in_tiles,
+    uint32_t height_in_tiles
+) {
+    size_t tile_count = (size_t)width_in_tiles * height_in_tiles;
+    return tile_count * (UIR_THUMBNAIL_TILE * UIR_THUMBNAIL_TILE + UIR_THUMBNAIL_TILE * UIR_THUMBNAIL_TILE / 4) * sizeof(RGBA);
+}
+
+size_t UIR_thumbnail_memory_size(
+    uint32_t width_in_px,
+    uint32_t height_in_px
+) {
+    uint32_t width_in_tiles = (width_in_px + UIR_TILE_SIZE - 1) / UIR_TILE_SIZE;
+    uint32_t height_in_tiles = (height_in_px + UIR_TILE_SIZE - 1) / UIR_TILE_SIZE;
+    return UIR_thumbnail_grid_size(width_in_tiles, height_in_tiles);
+}
+
+// Lays the levels out for the panel's grid. Returns false if they don't fit.
+static bool UIR_thumbnail_layout(
+    UIR_Thumbnail *thumbnail,
+    UIR *uir
+) {
+    if (UIR_thumbnail_grid_size(uir->width_in_tiles, uir->height_in_tiles) > thumbnail->memory_size)
+        return false;
+
+    thumbnail->width_in_tiles = uir->width_in_tiles;
+    thumbnail->height_in_tiles = uir->height_in_tiles;
+    RGBA *pixels = (RGBA*)thumbnail->memory;
+    for (uint32_t i = 0; i < UIR_THUMBNAIL_LEVELS; ++i) {
+        thumbnail->levels[i] = pixels;
+        thumbnail->level_widths[i] = uir->width_in_tiles * (UIR_THUMBNAIL_TILE >> i);
+        thumbnail->level_heights[i] = uir->height_in_tiles * (UIR_THUMBNAIL_TILE >> i);
+        pixels += thumbnail->level_widths[i] * thumbnail->level_heights[i];
+    }
+    return true;
+}
+
+// Box filters a tile into its 4x4 px of level 0 and 2x2 px of level 1.
+// A row at a time, through local copies, which -O2 vectorizes.
+static void UIR_thumbnail_filter(
+    const RGBA *restrict tile,
+    RGBA *restrict quarter,
+    uint32_t quarter_stride,
+    RGBA *restrict eighth,
+    uint32_t eighth_stride
+) {
+    // per level 0 px and channel, the sum of its 16 panel px
+    uint16_t sums[UIR_THUMBNAIL_TILE][UIR_THUMBNAIL_TILE * 4];
+
+    for (uint32_t qy = 0; qy < UIR_THUMBNAIL_TILE; ++qy) {
+        uint16_t columns[UIR_TILE_SIZE * 4] = { 0 };
+        for (uint32_t y = 0; y < 4; ++y) {
+            uint8_t in[UIR_TILE_SIZE * 4];
+            memcpy(in, tile + (qy*4 + y)*UIR_TILE_SIZE, sizeof(in));
+            for (uint32_t i = 0; i < UIR_TILE_SIZE * 4; ++i)
+                columns[i] += in[i];
+        }
+
+        uint8_t out[UIR_THUMBNAIL_TILE * 4];
+        for (uint32_t i = 0; i < UIR_THUMBNAIL_TILE * 4; ++i) {
+            const uint16_t *px = &columns[i / 4 * 16 + i % 4];
+            sums[qy][i] = (uint16_t)(px[0] + px[4] + px[8] + px[12]);
+            out[i] = (uint8_t)((sums[qy][i] + 8) >> 4);
+        }
+        memcpy(&quarter[qy * quarter_stride], out, sizeof(out));
+    }
+
+    // from the sums rather than level 0, so level 1 is rounded once
+    for (uint32_t ey = 0; ey < UIR_THUMBNAIL_TILE / 2; ++ey) {
+        uint8_t out[UIR_THUMBNAIL_TILE / 2 * 4];
+        for (uint32_t i = 0; i < UIR_THUMBNAIL_TILE / 2 * 4; ++i) {
+            uint32_t column = i / 4 * 8 + i % 4;
+            uint32_t sum = (uint32_t)sums[ey*2][column] + sums[ey*2][column + 4]
+                + sums[ey*2 + 1][column] + sums[ey*2 + 1][column + 4];
+            out[i] = (uint8_t)((sum + 32) >> 6);
+        }
+        memcpy(&eighth[ey * eighth_stride], out, sizeof(out));
+    }
+}
+
+// Expands a packed tile into opaque grays.
+static void UIR_tile_unpack(
+    UIR *uir,
+    uint32_t tile_idx,
+    RGBA *restrict tile
+) {
+    const uint8_t *packed = UIR_packed_tile(uir, tile_idx);
+    for (uint32_t i = 0; i < UIR_TILE_SIZE * UIR_TILE_SIZE; ++i) {
+        uint8_t luma = uir->tile_format == UIR_TILE_FORMAT_L8
+            ? packed[i]
+            : (uint8_t)-((packed[i / 8] >> (7 - i % 8)) & 1);
+        tile[i] = (RGBA) { luma, luma, luma, 255 };
+    }
+}
+
+// Filters the grid tiles redrawn since the thumbnail's generation, or all of them.
+static uint32_t UIR_thumbnail_filter_tiles(
+    UIR_Thumbnail *thumbnail,
+    UIR *uir,
+    bool all
+) {
+    uint32_t grid_tile_count = uir->width_in_tiles * uir->height_in_tiles;
+    if (grid_tile_count > uir->tile_count)
+        return 0;
+
+    uint32_t filtered = 0;
+    for (uint32_t grid_idx = 0; grid_idx < grid_tile_count; ++grid_idx) {
+        uint32_t tile_idx = UIR_tile_slot(uir, grid_idx);
+        if (!all && !UIR_generation_after(uir->tile_info[tile_idx].generation, thumbnail->generation))
+            continue;
+
+        UIR_Tile unpacked;
+        const RGBA *tile = uir->tiles ? UIR_tile_pixels(uir, tile_idx) : unpacked;
+        if (!uir->tiles)
+            UIR_tile_unpack(uir, tile_idx, unpacked);
+
+        uint32_t tile_x = grid_idx % uir->width_in_tiles;
+        uint32_t tile_y = grid_idx / uir->width_in_tiles;
+        uint32_t quarter_stride = thumbnail->level_widths[0];
+        uint32_t eighth_stride = thumbnail->level_widths[1];
+        UIR_thumbnail_filter(
+            tile,
+            &thumbnail->levels[0][tile_y * UIR_THUMBNAIL_TILE * quarter_stride + tile_x * UIR_THUMBNAIL_TILE], quarter_stride,
+            &thumbnail->levels[1][tile_y * UIR_THUMBNAIL_TILE / 2 * eighth_stride + tile_x * UIR_THUMBNAIL_TILE / 2], eighth_stride
+        );
+        filtered++;
+    }
+    thumbnail->generation = uir->generation;
+    return filtered;
 }
 
+bool UIR_thumbnail_init(
+    UIR_Thumbnail *thumbnail,
+    UIR *uir,
+    unsigned char *memory,
+    size_t memory_size
+) {
+    *thumbnail = (UIR_Thumbnail) {
+        .memory = memory,
+        .memory_size = memory_size,
+    };
+    if (!UIR_thumbnail_layout(thumbnail, uir))
+        return false;
+    UIR_thumbnail_filter_tiles(thumbnail, uir, true);
+    return true;
+}
+
+uint32_t UIR_thumbnail_update(
+    UIR_Thumbnail *thumbnail,
+    UIR *uir
+) {
+    bool all = UIR_generation_after(uir->layout_generation, thumbnail->generation);
+    if (thumbnail->width_in_tiles != uir->width_in_tiles || thumbnail->height_in_tiles != uir->height_in_tiles) {
+        if (!UIR_thumbnail_layout(thumbnail, uir)) {
+            thumbnail->error_flags |= UIR_ERROR_NO_MEM;
+            return 0;
+        }
+        all = true;
+    }
+    return UIR_thumbnail_filter_tiles(thumbnail, uir, all);
+}
+
+// ------------------------------
+// Writing buffers
+
 void UIR_write_buffer_rgb(
     UIR *uir,
     unsigned char *rgb_buffer,
@@ -564,18 +4361,8 @@ void UIR_write_buffer_rgb(
 ) {
     for (uint32_t y = 0; y < uir->height_in_px; ++y) {
         for (uint32_t x = 0; x < uir->width_in_px; ++x) {
-            uint32_t tile_x = x / UIR_TILE_SIZE;
-            uint32_t tile_y = y / UIR_TILE_SIZE;
-            uint32_t px_x = x % UIR_TILE_SIZE;
-            uint32_t px_y = y % UIR_TILE_SIZE;
-            uint32_t tile_idx = tile_y * uir->width_in_tiles + tile_x;
-            uint32_t px_idx = px_y * UIR_TILE_SIZE + px_x;
-
-            memcpy(
-                &rgb_buffer[y * (uint32_t)row_stride_in_bytes + x*3],
-                &uir->tiles[tile_idx][px_idx],
-                3
-            );
+            RGBA px = UIR_grid_pixel(uir, x + uir->scroll_x, y + uir->scroll_y);
+            memcpy(&rgb_buffer[y * (uint32_t)row_stride_in_bytes + x*3], &px, 3);
         }
     }
 }
@@ -587,14 +4374,7 @@ void UIR_write_buffer_bgra(
 ) {
     for (uint32_t y = 0; y < uir->height_in_px; ++y) {
         for (uint32_t x = 0; x < uir->width_in_px; ++x) {
-            uint32_t tile_x = x / UIR_TILE_SIZE;
-            uint32_t tile_y = y / UIR_TILE_SIZE;
-            uint32_t px_x = x % UIR_TILE_SIZE;
-            uint32_t px_y = y % UIR_TILE_SIZE;
-            uint32_t tile_idx = tile_y * uir->width_in_tiles + tile_x;
-            uint32_t px_idx = px_y * UIR_TILE_SIZE + px_x;
-            
-            RGBA px = uir->tiles[tile_idx][px_idx];
+            RGBA px = UIR_grid_pixel(uir, x + uir->scroll_x, y + uir->scroll_y);
             uint8_t c = px.r ^ px.b;
             px.r ^= c;
             px.b ^= c;
@@ -611,18 +4391,107 @@ void UIR_write_buffer_rgba(
 ) {
     for (uint32_t y = 0; y < uir->height_in_px; ++y) {
         for (uint32_t x = 0; x < uir->width_in_px; ++x) {
-            uint32_t tile_x = x / UIR_TILE_SIZE;
-            uint32_t tile_y = y / UIR_TILE_SIZE;
-            uint32_t px_x = x % UIR_TILE_SIZE;
-            uint32_t px_y = y % UIR_TILE_SIZE;
-            uint32_t tile_idx = tile_y * uir->width_in_tiles + tile_x;
-            uint32_t px_idx = px_y * UIR_TILE_SIZE + px_x;
-
-            memcpy(
-                &rgba_buffer[y * (uint32_t)row_stride_in_bytes + x*4],
-                &uir->tiles[tile_idx][px_idx],
-                4
-            );
+            RGBA px = UIR_grid_pixel(uir, x + uir->scroll_x, y + uir->scroll_y);
+            memcpy(&rgba_buffer[y * (uint32_t)row_stride_in_bytes + x*4], &px, 4);
+        }
+    }
+}
+
+void UIR_write_buffer_l8(
+    UIR *uir,
+    unsigned char *l8_buffer,
+    size_t row_stride_in_bytes
+) {
+    UIR_PixelRect rect = { 0, 0, uir->width_in_px, uir->height_in_px };
+    UIR_write_rect_l8(uir, &rect, l8_buffer, row_stride_in_bytes);
+}
+
+void UIR_write_buffer_mono(
+    UIR *uir,
+    unsigned char *mono_buffer,
+    size_t row_stride_in_bytes
+) {
+    UIR_PixelRect rect = { 0, 0, uir->width_in_px, uir->height_in_px };
+    UIR_write_rect_mono(uir, &rect, mono_buffer, row_stride_in_bytes);
+}
+
+// Rows of the rect are copied in runs of pixels that lie in one tile.
+void UIR_write_rect_l8(
+    UIR *uir,
+    const UIR_PixelRect *rect,
+    unsigned char *l8_buffer,
+    size_t row_stride_in_bytes
+) {
+    for (uint32_t y = rect->y0; y < rect->y1; ++y) {
+        unsigned char *row = l8_buffer + (size_t)(y - rect->y0) * row_stride_in_bytes;
+        uint32_t grid_y = y + uir->scroll_y;
+        for (uint32_t x = rect->x0; x < rect->x1;) {
+            uint32_t grid_x = x + uir->scroll_x;
+            uint32_t tile_idx = UIR_tile_slot(uir, grid_y / UIR_TILE_SIZE * uir->width_in_tiles + grid_x / UIR_TILE_SIZE);
+            uint32_t px_idx = grid_y % UIR_TILE_SIZE * UIR_TILE_SIZE + grid_x % UIR_TILE_SIZE;
+            uint32_t n = UIR_TILE_SIZE - grid_x % UIR_TILE_SIZE;
+            n = n < rect->x1 - x ? n : rect->x1 - x;
+
+            unsigned char *dst = row + (x - rect->x0);
+            if (uir->tiles) {
+                const RGBA *tile = UIR_tile_pixels(uir, tile_idx);
+                for (uint32_t i = 0; i < n; ++i)
+                    dst[i] = UIR_luma(tile[px_idx + i]);
+            } else if (uir->tile_format == UIR_TILE_FORMAT_L8) {
+                memcpy(dst, UIR_packed_tile(uir, tile_idx) + px_idx, n);
+            } else {
+                uint8_t *packed = UIR_packed_tile(uir, tile_idx);
+                for (uint32_t i = 0; i < n; ++i)
+                    dst[i] = (packed[(px_idx + i) / 8] & (0x80 >> ((px_idx + i) & 7))) ? 255 : 0;
+            }
+            x += n;
+        }
+    }
+}
+
+void UIR_write_rect_mono(
+    UIR *uir,
+    const UIR_PixelRect *rect,
+    unsigned char *mono_buffer,
+    size_t row_stride_in_bytes
+) {
+    for (uint32_t y = rect->y0; y < rect->y1; ++y) {
+        unsigned char *row = mono_buffer + (size_t)(y - rect->y0) * row_stride_in_bytes;
+        memset(row, 0, (rect->x1 - rect->x0 + 7) / 8);
+        uint32_t grid_y = y + uir->scroll_y;
+        for (uint32_t x = rect->x0; x < rect->x1;) {
+            uint32_t grid_x = x + uir->scroll_x;
+            uint32_t tile_idx = UIR_tile_slot(uir, grid_y / UIR_TILE_SIZE * uir->width_in_tiles + grid_x / UIR_TILE_SIZE);
+            uint32_t px_idx = grid_y % UIR_TILE_SIZE * UIR_TILE_SIZE + grid_x % UIR_TILE_SIZE;
+            uint32_t n = UIR_TILE_SIZE - grid_x % UIR_TILE_SIZE;
+            n = n < rect->x1 - x ? n : rect->x1 - x;
+            uint32_t bit = x - rect->x0;
+
+            if (uir->tile_format == UIR_TILE_FORMAT_MONO) {
+                uint8_t *packed = UIR_packed_tile(uir, tile_idx);
+                if (px_idx % 8 == 0 && bit % 8 == 0) {
+                    // whole bytes, as for rects from UIR_changed_rects_since
+                    for (uint32_t i = 0; i < n; i += 8) {
+                        uint8_t mask = n - i >= 8 ? 0xff : (uint8_t)(0xff00 >> (n - i));
+                        row[(bit + i) / 8] = packed[(px_idx + i) / 8] & mask;
+                    }
+                } else {
+                    for (uint32_t i = 0; i < n; ++i) {
+                        if (packed[(px_idx + i) / 8] & (0x80 >> ((px_idx + i) & 7)))
+                            row[(bit + i) / 8] |= (uint8_t)(0x80 >> ((bit + i) & 7));
+                    }
+                }
+            } else {
+                for (uint32_t i = 0; i < n; ++i) {
+                    uint8_t luma = uir->tiles
+                        ? UIR_luma(UIR_tile_pixels(uir, tile_idx)[px_idx + i])
+                        : UIR_packed_tile(uir, tile_idx)[px_idx + i];
+                    bool light = uir->dither == UIR_DITHER_NONE ? luma > 127 : UIR_dither_ordered(luma, grid_x + i, grid_y);
+                    if (light)
+                        row[(bit + i) / 8] |= (uint8_t)(0x80 >> ((bit + i) & 7));
+                }
+            }
+            x += n;
         }
     }
 }
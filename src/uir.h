@@ -8,10 +8,34 @@
 #define UIR_TILE_SIZE 16
 #define UIR_COPY_COLOUR(dst, src) memcpy(dst, src, 4)
 
+// Compile uir.c with UIR_FIXED_POINT for targets without an FPU. Shapes, images and blending then
+// draw every pixel with integer math: 24.8 fixed point distances, coverage in 1/256ths, and an
+// integer square root for circles and rounded corners. Commands keep their float fields, which
+// are converted once per tile, and paths, gradients and shadows still draw in float.
+// With premultiplied colours, pixels stay within UIR_FIXED_POINT_TOLERANCE per channel of the
+// float build. Coordinates must stay within +-4 million px.
+#define UIR_FIXED_POINT_TOLERANCE 4
+
 enum {
     UIR_ERROR_NO_MEM = (1u << 0),
 };
 
+enum {
+    // Draws every tile, every frame, with the plain scalar kernels: no fast paths,
+    // no path binning and no hash caching. Slow, but every optimized path must match it.
+    // With UIR_FIXED_POINT, draws with the float kernels, to measure the fixed point error.
+    UIR_DEBUG_REFERENCE = (1u << 0),
+
+    // Tint each redrawn tile from green to red by how many commands it drew,
+    // or by how long it took to draw. Cost needs a trace with a clock, and falls back to overdraw.
+    UIR_DEBUG_HEATMAP_OVERDRAW = (1u << 1),
+    UIR_DEBUG_HEATMAP_COST = (1u << 2),
+};
+
+// Tiles reach full red at this many commands, or this many nanoseconds.
+#define UIR_HEATMAP_MAX_OVERDRAW 16
+#define UIR_HEATMAP_MAX_COST 50000
+
 typedef struct RGBA {
     uint8_t r, g, b, a;
 } RGBA;
@@ -19,11 +43,44 @@ typedef struct RGBA {
 typedef RGBA UIR_Tile[UIR_TILE_SIZE*UIR_TILE_SIZE];
 typedef uint32_t UIR_Hash;
 
+typedef struct UIR_TraceSpan {
+    const char *name;
+    uint64_t start;         // from UIR_Trace.now
+    uint64_t duration;
+    int32_t tile_x, tile_y; // the grid tile, or -1 for spans covering a whole phase
+    uint32_t count;         // commands processed by the phase, tiles drawn by the raster phase, or commands drawn into the tile
+} UIR_TraceSpan;
+
+// Optional hooks for timing UIR_draw. See uir_trace.h for a Chrome trace writer.
+typedef struct UIR_Trace {
+    uint64_t (*now)(void *user_data); // nanoseconds
+    void (*span)(void *user_data, const UIR_TraceSpan *span);
+    void *user_data;
+    uint32_t tile_sample_rate; // emit spans for 1 in this many drawn tiles, 0 for none
+} UIR_Trace;
+
 typedef struct UIR_TileInfo {
     UIR_Hash hash_old;
     UIR_Hash hash_new;
+    uint32_t generation; // of the draw that last redrew the tile
 } UIR_TileInfo;
 
+// How tiles are stored. See UIR_new_packed.
+typedef enum UIR_TileFormat {
+    UIR_TILE_FORMAT_RGBA, // UIR_Tile
+    UIR_TILE_FORMAT_L8,   // 1 byte of luminance per pixel
+    UIR_TILE_FORMAT_MONO, // 1 bit per pixel, set for light pixels, leftmost pixel in the top bit
+} UIR_TileFormat;
+
+// How UIR_TILE_FORMAT_MONO tiles turn luminance into bits.
+typedef enum UIR_Dither {
+    UIR_DITHER_ORDERED,   // an 8x8 Bayer matrix, so every pixel only depends on itself
+    UIR_DITHER_DIFFUSION, // Floyd-Steinberg, within each tile
+    UIR_DITHER_NONE,      // light above half
+} UIR_Dither;
+
+struct UIR_TileSlot;
+
 typedef struct UIR {
     // ----------------------
     // Read Only!
@@ -40,11 +97,55 @@ typedef struct UIR {
     UIR_Tile *tiles;
     uint32_t tile_count;
 
+    // Panels from UIR_new_packed only. tiles is NULL, and tile i is packed_tile_size bytes at
+    // packed_tiles + i * packed_tile_size.
+    uint32_t tile_format; // UIR_TileFormat
+    uint32_t packed_tile_size;
+    uint8_t *packed_tiles;
+
+    // Panels with compressed tiles only (see UIR_compress_tiles), NULL otherwise.
+    unsigned char *compressed;
+    uint32_t compressed_count; // tiles not yet decompressed or redrawn
+
+    // Virtual canvases only (see UIR_new_virtual), zero otherwise.
+    // The tile grid is a window onto the canvas: grid tile (x, y) is canvas tile
+    // (grid_tile_x + x, grid_tile_y + y), and lives in tiles[tile_slots[y*width_in_tiles + x]].
+    uint32_t *tile_slots;
+    bool tile_slots_valid;
+    struct UIR_TileSlot *slots;
+    uint32_t *slot_table;        // open addressed, canvas tile -> slot + 1
+    uint32_t slot_table_mask;
+    uint32_t lru_head, lru_tail; // most and least recently used slots
+
+    int64_t viewport_x, viewport_y; // canvas px of the viewport's top left
+    int64_t anchor_x, anchor_y;     // canvas px of command coordinate (0, 0)
+    int64_t grid_tile_x, grid_tile_y;
+
+    // Command coordinates of the grid's top left, and where the viewport starts inside the grid.
+    // Both are zero for regular panels.
+    float grid_x, grid_y;
+    uint32_t scroll_x, scroll_y;
+
+    // Counts draws, see UIR_tiles_changed_since.
+    uint32_t generation;
+    uint32_t layout_generation; // the first draw after the grid was resized, or scrolled to other tiles
+
     // ----------------------
     // Read/Write
 
     uint32_t error_flags;
+    uint32_t debug_flags; // UIR_DEBUG_*
     RGBA clear_colour;
+    uint32_t dither; // UIR_Dither, for UIR_TILE_FORMAT_MONO tiles. Changing it redraws every tile.
+
+    // Optional.
+    UIR_Trace *trace;
+
+    // Optional memory used by UIR_draw for per-frame data, such as binning path segments into tiles.
+    // Without it (or if it runs out), paths are still drawn, but every tile visits every segment.
+    // Roughly 16 bytes per path segment plus 4 bytes per (segment, tile) pair is needed.
+    unsigned char *scratch;
+    size_t scratch_size;
 } UIR;
 
 // Returns minimum memory size that can fit this panel.
@@ -71,17 +172,158 @@ bool UIR_resize(
     uint32_t height_in_px
 );
 
+// ----------------------
+// Packed panels
+//
+// Panels for grayscale and monochrome displays, such as e-ink and OLED, storing each tile in
+// UIR_TILE_FORMAT_L8 or UIR_TILE_FORMAT_MONO: 4 or 32 times less than RGBA. Every command draws as
+// on an RGBA panel, into one RGBA tile on the stack, and each redrawn tile is then packed, so only
+// the packed tiles are kept. Luminance weighs red, green and blue as in Rec. 709, ignoring alpha.
+// Read pixels with UIR_write_buffer_l8 and UIR_write_buffer_mono, or the rect variants, which
+// pair with UIR_changed_rects_since for partial refreshes.
+
+// Returns minimum memory size that can fit this panel.
+size_t UIR_packed_memory_size(
+    uint32_t width_in_px,
+    uint32_t height_in_px,
+    uint32_t tile_format
+);
+
+// !!!You must ensure that the memory is zeroed!!!
+// Like UIR_new, storing tiles in tile_format.
+UIR *UIR_new_packed(
+    uint32_t width_in_px,
+    uint32_t height_in_px,
+    uint32_t tile_format,
+    unsigned char *memory,
+    size_t memory_size
+);
+
+// ----------------------
+// Idle panels
+//
+// An idle panel can compress its tiles into a smaller block. The app may then release the pages
+// of the tile store, uir->tiles up to uir->tiles + uir->tile_count, such as with
+// madvise(MADV_DONTNEED), as long as they read back as zeros. Each tile is decompressed back into
+// the store when it is next read, by a write or a thumbnail update. Tiles about to be redrawn drop
+// their compressed copies before any tile is drawn, so UIR_draw_tiles stays safe to call from
+// several threads. Once compressed_count is 0, the block is no longer used. Apps reading
+// uir->tiles directly should call UIR_decompress_tiles first.
+//
+// Each tile is stored as one colour, as 2, 4 or 16 colours with packed indices, as runs of equal
+// pixels, or raw, whichever is smallest. Only RGBA panels are compressed.
+
+// Returns the memory UIR_compress_tiles needs for the tiles as they are now.
+size_t UIR_compressed_size(
+    UIR *uir
+);
+
+// Compresses every tile into memory, which must stay valid until compressed_count is 0. If tiles
+// are still compressed from an earlier call, memory must be another block than uir->compressed.
+// Returns false, compressing nothing, if memory is too small or the panel is packed.
+bool UIR_compress_tiles(
+    UIR *uir,
+    unsigned char *memory,
+    size_t memory_size
+);
+
+// Decompresses every tile still compressed.
+void UIR_decompress_tiles(
+    UIR *uir
+);
+
+// ----------------------
+// Virtual canvases
+//
+// A canvas of any size, seen through a viewport. Canvas coordinates are 64-bit, while draw
+// commands stay in floats relative to an anchor that the app keeps near the viewport.
+// Tiles are taken from a fixed pool as they scroll into view, and evicted least recently used,
+// so memory scales with the viewport rather than the canvas. Tiles that scroll back into view
+// before they are evicted are not redrawn.
+//
+// Width and height are those of the viewport, and UIR_resize resizes the viewport.
+
+// Returns minimum memory size for a viewport of this size with a pool of pool_tile_count tiles.
+// The pool is grown to cover the viewport if needed, and anything beyond that caches offscreen tiles.
+size_t UIR_virtual_memory_size(
+    uint32_t viewport_width_in_px,
+    uint32_t viewport_height_in_px,
+    uint32_t pool_tile_count
+);
+
+// !!!You must ensure that the memory is zeroed!!!
+// Returns NULL if memory is too small for a UIR.
+// Sets NO_MEM error_flag if the pool is too small to cover the viewport.
+UIR *UIR_new_virtual(
+    uint32_t viewport_width_in_px,
+    uint32_t viewport_height_in_px,
+    unsigned char *memory,
+    size_t memory_size
+);
+
+// Moves the top left of the viewport to canvas px (x, y).
+void UIR_set_viewport(
+    UIR *uir,
+    int64_t x,
+    int64_t y
+);
+
+// Draw commands are placed with command coordinate (0, 0) at canvas px (x, y).
+// Keep the anchor within a few million px of the viewport, so floats stay exact.
+// Moving the anchor redraws every tile.
+void UIR_set_anchor(
+    UIR *uir,
+    int64_t x,
+    int64_t y
+);
+
 typedef enum UIR_DrawCmdType {
     UIR_DRAW_SHAPE_RECT,
     UIR_DRAW_SHAPE_CIRCLE,
     UIR_DRAW_IMAGE_A,
     UIR_DRAW_IMAGE_RGBA,
+    UIR_DRAW_PATH_STROKE,
+    UIR_DRAW_PATH_FILL,
+    UIR_DRAW_SHAPE_SHADOW,
+    UIR_DRAW_GROUP,
 } UIR_DrawCmdType;
 
 typedef struct UIR_Rect {
     float x0, y0, x1, y1;
 } UIR_Rect;
 
+typedef struct UIR_Point {
+    float x, y;
+} UIR_Point;
+
+typedef enum UIR_PathVerb {
+    UIR_PATH_MOVE,  // consumes 1 point
+    UIR_PATH_LINE,  // consumes 1 point
+    UIR_PATH_QUAD,  // consumes 2 points: control, end
+    UIR_PATH_CUBIC, // consumes 3 points: control, control, end
+    UIR_PATH_CLOSE, // consumes no points
+} UIR_PathVerb;
+
+#define UIR_GRADIENT_MAX_STOPS 4
+
+typedef enum UIR_GradientType {
+    UIR_GRADIENT_NONE,
+    UIR_GRADIENT_LINEAR,
+    UIR_GRADIENT_RADIAL,
+} UIR_GradientType;
+
+// Linear gradients run from p0 to p1.
+// Radial gradients are centred on p0, and reach their last stop at the distance to p1.
+// Stop offsets must be increasing, and stop colours are premultiplied.
+typedef struct UIR_Gradient {
+    uint32_t type;
+    UIR_Point p0;
+    UIR_Point p1;
+    uint32_t stop_count; // up to UIR_GRADIENT_MAX_STOPS, more are ignored
+    float stop_offsets[UIR_GRADIENT_MAX_STOPS];
+    RGBA stop_colours[UIR_GRADIENT_MAX_STOPS];
+} UIR_Gradient;
+
 typedef struct UIR_DrawCmd_Shape {
     uint32_t type;
     UIR_Rect rect;
@@ -89,8 +331,79 @@ typedef struct UIR_DrawCmd_Shape {
     RGBA outline_colour;
     float outline_radius;
     float corner_radius;
+    UIR_Gradient fill_gradient; // Replaces fill_colour unless type is UIR_GRADIENT_NONE.
+    uint32_t kernel; // Written by UIR_draw.
 } UIR_DrawCmd_Shape;
 
+// A rect or rounded rect blurred by a gaussian, e.g. for drop shadows.
+typedef struct UIR_DrawCmd_Shadow {
+    uint32_t type;
+    UIR_Rect rect; // Written by UIR_draw: shape_rect grown by the extent of the blur.
+    RGBA colour;
+    UIR_Rect shape_rect;
+    float corner_radius;
+    float blur_radius; // Standard deviation of the blur.
+} UIR_DrawCmd_Shadow;
+
+// Each block of an image's pixels remembers the generation that last changed it.
+#define UIR_IMAGE_BLOCK_SIZE 16
+
+// A handle for image pixels that change over time, such as video frames or live thumbnails.
+// Call UIR_image_mark_dirty after changing pixels, and UIR_draw redraws the tiles showing them.
+typedef struct UIR_Image {
+    uint8_t *data;
+    uint32_t data_stride;
+    uint32_t width;
+    uint32_t height;
+    uint32_t generation;
+
+    // Optional, UIR_image_block_count entries.
+    // Without it, any change to the image redraws every tile that shows it.
+    uint32_t *block_generations;
+} UIR_Image;
+
+// Returns the number of block generations an image of this size needs.
+size_t UIR_image_block_count(
+    uint32_t width,
+    uint32_t height
+);
+
+// block_generations may be NULL.
+void UIR_image_init(
+    UIR_Image *image,
+    uint8_t *data,
+    uint32_t data_stride,
+    uint32_t width,
+    uint32_t height,
+    uint32_t *block_generations
+);
+
+// Marks the pixels in [x0, x1) x [y0, y1) as changed.
+void UIR_image_mark_dirty(
+    UIR_Image *image,
+    uint32_t x0,
+    uint32_t y0,
+    uint32_t x1,
+    uint32_t y1
+);
+
+enum {
+    // Every pixel of the image has alpha 255.
+    // Together with a zero tint_colour this lets UIR_DRAW_IMAGE_RGBA copy instead of blend.
+    UIR_IMAGE_OPAQUE = (1u << 0),
+};
+
+// Pixel layouts UIR_DRAW_IMAGE_RGBA samples directly, converting each pixel to premultiplied RGBA
+// as it is drawn, so sources such as video frames need no conversion pass.
+typedef enum UIR_ImageFormat {
+    UIR_IMAGE_FORMAT_RGBA,          // premultiplied
+    UIR_IMAGE_FORMAT_BGRA,          // premultiplied
+    UIR_IMAGE_FORMAT_RGBA_STRAIGHT, // not premultiplied
+    UIR_IMAGE_FORMAT_BGRA_STRAIGHT, // not premultiplied
+    UIR_IMAGE_FORMAT_RGB,           // 3 bytes per pixel, opaque
+    UIR_IMAGE_FORMAT_INDEXED,       // 1 byte per pixel, an index into palette
+} UIR_ImageFormat;
+
 typedef struct UIR_DrawCmd_Image {
     uint32_t type;
     UIR_Rect rect;
@@ -98,8 +411,49 @@ typedef struct UIR_DrawCmd_Image {
     uint8_t *data;
     uint32_t data_stride;
     float scale;
+    uint32_t flags;  // UIR_IMAGE_*
+    uint32_t format; // UIR_ImageFormat, for UIR_DRAW_IMAGE_RGBA.
+
+    // UIR_IMAGE_FORMAT_INDEXED only: 256 premultiplied colours. Like data, it is hashed by address,
+    // so after changing colours in place, mark the whole handle dirty.
+    RGBA *palette;
+
+    // Optional. If set, data must point into handle's pixels, with the same data_stride.
+    UIR_Image *handle;
 } UIR_DrawCmd_Image;
 
+// Points and verbs are hashed by value, so they may be rewritten in place between draws.
+// If verbs is NULL, the points form a single polyline.
+// Fills close every subpath and use the nonzero winding rule.
+struct UIR_PathBins;
+
+typedef struct UIR_DrawCmd_Path {
+    uint32_t type;
+    UIR_Rect rect; // Written by UIR_draw: the bounding box of the path, including the stroke.
+    RGBA colour;
+    float stroke_width; // Ignored by UIR_DRAW_PATH_FILL.
+    uint32_t point_count;
+    UIR_Point *points;
+    uint8_t *verbs; // UIR_PathVerb
+    uint32_t verb_count;
+    struct UIR_PathBins *bins; // Written by UIR_draw.
+} UIR_DrawCmd_Path;
+
+// The next cmd_count commands form a group, such as a panel or a list row.
+// While hash is set, UIR_draw skips the group's commands when finding which tiles changed,
+// and only looks at them to draw tiles inside rect. So after changing any of them, set hash to 0,
+// and UIR_draw fills in hash and rect again. A hash set by the app must come with rect.
+// A group command inside a group is ignored, and its commands belong to the outer group. Groups showing UIR_Image handles still check them every frame.
+typedef struct UIR_DrawCmd_Group {
+    uint32_t type;
+    UIR_Rect rect;
+    uint32_t cmd_count;
+    UIR_Hash hash;
+    bool prepared; // Written by UIR_draw.
+    bool live;     // Written by UIR_draw: the group shows image handles.
+    UIR_Hash live_hash; // Written by UIR_draw: the hash live was found for.
+} UIR_DrawCmd_Group;
+
 typedef union UIR_DrawCmd {
     struct {
         uint32_t type;
@@ -107,6 +461,9 @@ typedef union UIR_DrawCmd {
     } common;
     UIR_DrawCmd_Shape shape;
     UIR_DrawCmd_Image image;
+    UIR_DrawCmd_Path path;
+    UIR_DrawCmd_Shadow shadow;
+    UIR_DrawCmd_Group group;
 } UIR_DrawCmd;
 
 // returns the number of tiles redrawn
@@ -116,6 +473,307 @@ uint32_t UIR_draw(
     uint32_t draw_cmd_count
 );
 
+// ----------------------
+// Drawing in parts
+//
+// UIR_draw is UIR_draw_prepare followed by UIR_draw_tiles over every tile. After UIR_draw_prepare,
+// UIR_draw_tiles may be called from several threads at once, for ranges of tiles that don't overlap.
+// See UIR_draw_batch in uir_thread.h. Tiles drawn this way emit no trace spans.
+
+// Returns the number of tiles UIR_draw_tiles will redraw.
+uint32_t UIR_draw_prepare(
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count
+);
+
+// Draws the changed tiles among [first_tile, end_tile), numbering tiles y * width_in_tiles + x.
+// Takes the commands given to UIR_draw_prepare. Returns the number of tiles redrawn.
+uint32_t UIR_draw_tiles(
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count,
+    uint32_t first_tile,
+    uint32_t end_tile
+);
+
+// ----------------------
+// Progressive drawing
+//
+// Spreads a large redraw, such as a theme switch, over several frames. UIR_draw_progressive draws
+// changed tiles until a tile count or deadline is reached, nearest the focus first, and leaves the
+// rest for later calls. Tiles it skips keep their old hash, so the next call, with the same commands
+// or newer ones, finds them changed again. Until a call leaves none remaining, some tiles show older frames.
+// With UIR_DEBUG_REFERENCE every tile counts as changed on every call, so the budget is ignored.
+
+typedef struct UIR_DrawBudget {
+    // Stop after this many tiles. 0 for no limit.
+    uint32_t max_tiles;
+
+    // Optional. Stop before the next tile would end past deadline, judging by the slowest tile so far.
+    uint64_t (*now)(void *user_data); // nanoseconds
+    void *user_data;
+    uint64_t deadline;
+
+    // Tiles touching focus go first, then rings of tiles one wider at a time.
+    // In command coordinates. An empty rect focuses on a point, such as the cursor.
+    UIR_Rect focus;
+} UIR_DrawBudget;
+
+// Like UIR_draw, within budget. At least one changed tile is drawn, so repeated calls finish.
+// Returns the number of tiles redrawn, and writes the number of changed tiles left to remaining.
+uint32_t UIR_draw_progressive(
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count,
+    const UIR_DrawBudget *budget,
+    uint32_t *remaining
+);
+
+// ----------------------
+// Command streams
+//
+// A packed alternative to arrays of UIR_DrawCmd, for scenes of many thousands of commands.
+// Bounding boxes live in their own arrays, so finding the commands touching a tile only reads
+// those, and each command is stored at the size of its type instead of the size of the union.
+// Shapes without a gradient are stored without it.
+// Streams are rebuilt by clearing and pushing again. Groups can't be pushed.
+
+typedef struct UIR_CmdStream {
+    // ----------------------
+    // Read Only!
+
+    // Bounding boxes, updated by UIR_draw_stream as UIR_draw updates rect.
+    float *x0, *y0, *x1, *y1;
+
+    uint32_t *offsets; // where each command starts in payload, and where the next would go
+    unsigned char *payload;
+    size_t payload_capacity;
+
+    uint32_t count;
+    uint32_t capacity;
+
+    // ----------------------
+    // Read/Write
+
+    // UIR_ERROR_NO_MEM once a push didn't fit.
+    uint32_t error_flags;
+} UIR_CmdStream;
+
+// Returns minimum memory size for a stream of capacity commands in payload_capacity bytes.
+// capacity * sizeof(UIR_DrawCmd) bytes of payload always fit.
+size_t UIR_cmd_stream_memory_size(
+    uint32_t capacity,
+    size_t payload_capacity
+);
+
+// Returns NULL if memory is too small.
+UIR_CmdStream *UIR_cmd_stream_new(
+    uint32_t capacity,
+    size_t payload_capacity,
+    unsigned char *memory,
+    size_t memory_size
+);
+
+void UIR_cmd_stream_clear(
+    UIR_CmdStream *stream
+);
+
+// Returns false if cmd is a group, or if the stream is full, which also sets UIR_ERROR_NO_MEM.
+bool UIR_cmd_stream_push(
+    UIR_CmdStream *stream,
+    const UIR_DrawCmd *cmd
+);
+
+// Returns the number of commands pushed, stopping at the first that isn't.
+uint32_t UIR_cmd_stream_push_array(
+    UIR_CmdStream *stream,
+    const UIR_DrawCmd *cmds,
+    uint32_t cmd_count
+);
+
+// Like UIR_draw, and draws the same pixels.
+// returns the number of tiles redrawn
+uint32_t UIR_draw_stream(
+    UIR *uir,
+    UIR_CmdStream *stream
+);
+
+// ----------------------
+// Command builders
+//
+// Builds a frame's commands one push at a time. Each command is prepared, has its paths binned
+// and is hashed into the tiles it touches as it is pushed, while it is still in cache, so that
+// work overlaps the app's layout, and UIR_builder_draw only draws the changed tiles. The pixels
+// are the same as UIR_draw of the pushed commands.
+//
+// UIR_builder_begin reads the panel's size, viewport, anchor, clear colour and debug flags, so
+// leave them alone until UIR_builder_draw. Pushed commands are final: images and paths they point
+// to may change before the draw, but the hash won't see it. Groups can't be pushed, and the
+// prepass and hash phases emit no trace spans.
+
+typedef struct UIR_Builder {
+    // ----------------------
+    // Read Only!
+
+    UIR *uir;
+    UIR_DrawCmd *cmds;
+    uint32_t cmd_count;
+    uint32_t cmd_capacity;
+    bool ready;             // there are tiles to draw into, and the builder hasn't drawn yet
+    unsigned char *scratch; // the part of uir->scratch left for path bins
+
+    // ----------------------
+    // Read/Write
+
+    // UIR_ERROR_NO_MEM once a push didn't fit.
+    uint32_t error_flags;
+} UIR_Builder;
+
+// Starts a frame, whose commands are written to cmd_memory, which holds cmd_capacity commands.
+void UIR_builder_begin(
+    UIR_Builder *builder,
+    UIR *uir,
+    UIR_DrawCmd *cmd_memory,
+    uint32_t cmd_capacity
+);
+
+// Returns the command as pushed, or NULL if cmd is a group, or if the builder is full,
+// which also sets UIR_ERROR_NO_MEM.
+const UIR_DrawCmd *UIR_builder_push(
+    UIR_Builder *builder,
+    const UIR_DrawCmd *cmd
+);
+
+// Shorthands for UIR_builder_push. Return false if the command wasn't pushed.
+bool UIR_push_rect(
+    UIR_Builder *builder,
+    UIR_Rect rect,
+    RGBA fill_colour,
+    RGBA outline_colour,
+    float outline_radius,
+    float corner_radius
+);
+
+bool UIR_push_circle(
+    UIR_Builder *builder,
+    UIR_Rect rect,
+    RGBA fill_colour,
+    RGBA outline_colour,
+    float outline_radius
+);
+
+// A premultiplied RGBA image.
+bool UIR_push_image(
+    UIR_Builder *builder,
+    UIR_Rect rect,
+    uint8_t *data,
+    uint32_t data_stride,
+    float scale
+);
+
+// Draws the changed tiles, once per UIR_builder_begin.
+// returns the number of tiles redrawn
+uint32_t UIR_builder_draw(
+    UIR_Builder *builder
+);
+
+// ----------------------
+// Changed tiles
+//
+// Each draw is a new generation, and tiles remember the generation that last redrew them. Consumers
+// copying tiles out at different rates, such as a local display and a remote viewer, each keep the
+// generation they last copied, and ask for the tiles changed since, including those of skipped draws.
+// Generations wrap, so a consumer must catch up within 2^31 draws.
+
+// Writes the grid tiles, numbered y * width_in_tiles + x, redrawn after generation to tile_indices,
+// up to capacity. Every tile has changed once the grid was resized or scrolled to other tiles.
+// Returns the number of tiles changed. Start a consumer at generation 0, and keep uir->generation.
+uint32_t UIR_tiles_changed_since(
+    UIR *uir,
+    uint32_t generation,
+    uint32_t *tile_indices,
+    uint32_t capacity
+);
+
+// In px of the panel, or of the viewport of a virtual canvas.
+typedef struct UIR_PixelRect {
+    uint32_t x0, y0, x1, y1;
+} UIR_PixelRect;
+
+// Covers the tiles changed since generation with up to max_rects rects, such as the windows of
+// a display's partial refresh. Runs of changed tiles in a row become a rect, and stack onto the
+// rect of the row above if they span the same columns. Beyond max_rects, rects are merged into
+// the one they grow least, so they may overlap, or cover tiles that did not change.
+// Returns the number of rects written.
+uint32_t UIR_changed_rects_since(
+    UIR *uir,
+    uint32_t generation,
+    UIR_PixelRect *rects,
+    uint32_t max_rects
+);
+
+// ----------------------
+// Thumbnails
+//
+// Quarter and eighth size copies of a panel, such as the live previews of a window switcher, kept
+// in their own memory. Each update box filters only the tiles redrawn since the last one, so a
+// preview costs a small fraction of downscaling the whole panel. Each pixel is the rounded average
+// of the 4x4 or 8x8 panel pixels it covers, in premultiplied RGBA. Packed panels are filtered from
+// their luminance or bits, as opaque grays.
+//
+// Thumbnails cover the tile grid, so the viewport of a virtual canvas starts scroll_x / 4 px in.
+
+#define UIR_THUMBNAIL_LEVELS 2
+
+typedef struct UIR_Thumbnail {
+    // ----------------------
+    // Read Only!
+
+    unsigned char *memory;
+    size_t memory_size;
+
+    uint32_t width_in_tiles;
+    uint32_t height_in_tiles;
+
+    // Level 0 is a quarter of the grid's size, level 1 an eighth. Rows are level_widths[i] px apart.
+    RGBA *levels[UIR_THUMBNAIL_LEVELS];
+    uint32_t level_widths[UIR_THUMBNAIL_LEVELS];
+    uint32_t level_heights[UIR_THUMBNAIL_LEVELS];
+
+    // Of the panel, at the last update.
+    uint32_t generation;
+
+    // ----------------------
+    // Read/Write
+
+    // UIR_ERROR_NO_MEM once the panel grew past what memory fits.
+    uint32_t error_flags;
+} UIR_Thumbnail;
+
+// Returns minimum memory size for thumbnails of a panel of this size. For a virtual canvas, pass
+// the grid size, width_in_tiles * UIR_TILE_SIZE by height_in_tiles * UIR_TILE_SIZE.
+size_t UIR_thumbnail_memory_size(
+    uint32_t width_in_px,
+    uint32_t height_in_px
+);
+
+// Returns false if memory is too small for thumbnails of uir.
+// Memory needn't be zeroed, as every tile is filtered here.
+bool UIR_thumbnail_init(
+    UIR_Thumbnail *thumbnail,
+    UIR *uir,
+    unsigned char *memory,
+    size_t memory_size
+);
+
+// Filters the tiles uir redrew since the last update, or every tile once the grid was resized
+// or scrolled to other tiles. Returns the number of tiles filtered.
+uint32_t UIR_thumbnail_update(
+    UIR_Thumbnail *thumbnail,
+    UIR *uir
+);
+
 void UIR_write_buffer_rgba(
     UIR *uir,
     unsigned char *rgba_buffer,
@@ -134,4 +792,37 @@ void UIR_write_buffer_bgra(
     size_t row_stride_in_bytes
 );
 
+// 1 byte of luminance per pixel.
+void UIR_write_buffer_l8(
+    UIR *uir,
+    unsigned char *l8_buffer,
+    size_t row_stride_in_bytes
+);
+
+// 1 bit per pixel, set for light pixels, leftmost pixel in the top bit. Panels that aren't
+// UIR_TILE_FORMAT_MONO are dithered ordered as they are written, unless dither is UIR_DITHER_NONE.
+void UIR_write_buffer_mono(
+    UIR *uir,
+    unsigned char *mono_buffer,
+    size_t row_stride_in_bytes
+);
+
+// Like UIR_write_buffer_l8, for the pixels inside rect. The first row of the buffer is rect->y0,
+// starting with pixel rect->x0.
+void UIR_write_rect_l8(
+    UIR *uir,
+    const UIR_PixelRect *rect,
+    unsigned char *l8_buffer,
+    size_t row_stride_in_bytes
+);
+
+// Like UIR_write_buffer_mono, for the pixels inside rect. The first row of the buffer is rect->y0,
+// with pixel rect->x0 in the top bit of its first byte.
+void UIR_write_rect_mono(
+    UIR *uir,
+    const UIR_PixelRect *rect,
+    unsigned char *mono_buffer,
+    size_t row_stride_in_bytes
+);
+
 #endif
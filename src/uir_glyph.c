@@ -0,0 +1,383 @@
+
+#include "uir_glyph.h"
+
+#include <stdalign.h>
+#include <string.h>
+#include <math.h>
+
+#define ALIGN_UP(p, align) (void*)(((uintptr_t)(p) + ((uintptr_t)align) - 1) & ~(((uintptr_t)align) - 1))
+
+// Shelf heights are rounded up to this, so glyphs of similar sizes share shelves.
+#define UIR_GLYPH_SHELF_ROUND 4
+// Empty px right of and below every glyph.
+#define UIR_GLYPH_PADDING 1
+
+static uint32_t UIR_glyph_table_size(uint32_t glyph_capacity) {
+    uint32_t size = 2;
+    while (size < glyph_capacity * 2)
+        size *= 2;
+    return size;
+}
+
+size_t UIR_glyph_cache_memory_size(
+    uint32_t atlas_width,
+    uint32_t atlas_height,
+    uint32_t glyph_capacity
+) {
+    uint32_t shelf_capacity = atlas_height / UIR_GLYPH_SHELF_ROUND;
+
+    return sizeof(UIR_GlyphCache) + alignof(UIR_GlyphCache) // add to ensure we can align the cache upwards
+        + (size_t)glyph_capacity * sizeof(UIR_Glyph)
+        + (size_t)shelf_capacity * sizeof(UIR_GlyphShelf)
+        + (size_t)UIR_glyph_table_size(glyph_capacity) * sizeof(uint32_t)
+        + UIR_image_block_count(atlas_width, atlas_height) * sizeof(uint32_t)
+        + (size_t)atlas_width * atlas_height;
+}
+
+UIR_GlyphCache *UIR_glyph_cache_new(
+    uint32_t atlas_width,
+    uint32_t atlas_height,
+    uint32_t glyph_capacity,
+    unsigned char *memory,
+    size_t memory_size
+) {
+    unsigned char *memory_end = memory + memory_size;
+    unsigned char *cache_addr = ALIGN_UP(memory, alignof(UIR_GlyphCache));
+    size_t size = UIR_glyph_cache_memory_size(atlas_width, atlas_height, glyph_capacity);
+    if (cache_addr + size - alignof(UIR_GlyphCache) > memory_end)
+        return NULL;
+
+    // -----------------------------
+    // split memory between the cache, glyphs, shelves, the table and the atlas.
+    // Everything after the cache has 4 byte alignment or less, and sizes that keep it.
+
+    UIR_GlyphCache *cache = (UIR_GlyphCache*)cache_addr;
+    unsigned char *memory_left = cache_addr + sizeof(UIR_GlyphCache);
+
+    UIR_Glyph *glyphs = (UIR_Glyph*)memory_left;
+    memory_left += (size_t)glyph_capacity * sizeof(UIR_Glyph);
+
+    uint32_t shelf_capacity = atlas_height / UIR_GLYPH_SHELF_ROUND;
+    UIR_GlyphShelf *shelves = (UIR_GlyphShelf*)memory_left;
+    memory_left += (size_t)shelf_capacity * sizeof(UIR_GlyphShelf);
+
+    uint32_t table_size = UIR_glyph_table_size(glyph_capacity);
+    uint32_t *table = (uint32_t*)memory_left;
+    memory_left += (size_t)table_size * sizeof(uint32_t);
+    memset(table, 0, (size_t)table_size * sizeof(uint32_t));
+
+    uint32_t *block_generations = (uint32_t*)memory_left;
+    memory_left += UIR_image_block_count(atlas_width, atlas_height) * sizeof(uint32_t);
+
+    *cache = (UIR_GlyphCache) {
+        .glyphs = glyphs,
+        .glyph_capacity = glyph_capacity,
+        .free_glyph = glyph_capacity ? 0 : UIR_GLYPH_NONE,
+        .first_blank = UIR_GLYPH_NONE,
+        .table = table,
+        .table_mask = table_size - 1,
+        .shelves = shelves,
+        .shelf_capacity = shelf_capacity,
+    };
+    UIR_image_init(&cache->atlas, memory_left, atlas_width, atlas_width, atlas_height, block_generations);
+
+    for (uint32_t i = 0; i < glyph_capacity; ++i)
+        glyphs[i].next = i + 1 < glyph_capacity ? i + 1 : UIR_GLYPH_NONE;
+
+    return cache;
+}
+
+void UIR_glyph_cache_next_frame(
+    UIR_GlyphCache *cache
+) {
+    cache->frame++;
+}
+
+// ------------------------------
+// Glyph table
+
+static uint32_t UIR_glyph_home(
+    UIR_GlyphCache *cache,
+    const stbtt_fontinfo *font,
+    float size,
+    uint32_t codepoint
+) {
+    uint32_t size_bits;
+    memcpy(&size_bits, &size, sizeof(size_bits));
+    uint64_t h = (uint64_t)(uintptr_t)font * 0x9e3779b97f4a7c15ull
+        ^ (uint64_t)size_bits * 0xc2b2ae3d27d4eb4full
+        ^ (uint64_t)codepoint * 0x165667b19e3779f9ull;
+    return (uint32_t)(h ^ (h >> 32)) & cache->table_mask;
+}
+
+// Returns the table position holding this glyph, or the empty position it would go in.
+static uint32_t UIR_glyph_find(
+    UIR_GlyphCache *cache,
+    const stbtt_fontinfo *font,
+    float size,
+    uint32_t codepoint
+) {
+    uint32_t i = UIR_glyph_home(cache, font, size, codepoint);
+    while (cache->table[i]) {
+        UIR_Glyph *glyph = &cache->glyphs[cache->table[i] - 1];
+        if (glyph->font == font && glyph->size == size && glyph->codepoint == codepoint)
+            break;
+        i = (i + 1) & cache->table_mask;
+    }
+    return i;
+}
+
+// Backward shift deletion keeps probe sequences unbroken without tombstones.
+static void UIR_glyph_table_remove(
+    UIR_GlyphCache *cache,
+    uint32_t i
+) {
+    uint32_t mask = cache->table_mask;
+    for (uint32_t j = (i + 1) & mask; cache->table[j]; j = (j + 1) & mask) {
+        UIR_Glyph *glyph = &cache->glyphs[cache->table[j] - 1];
+        uint32_t home = UIR_glyph_home(cache, glyph->font, glyph->size, glyph->codepoint);
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            cache->table[i] = cache->table[j];
+            i = j;
+        }
+    }
+    cache->table[i] = 0;
+}
+
+// ------------------------------
+// Shelves
+
+static void UIR_glyph_shelf_evict(
+    UIR_GlyphCache *cache,
+    uint32_t s
+) {
+    UIR_GlyphShelf *shelf = &cache->shelves[s];
+    uint32_t g = shelf->first_glyph;
+    while (g != UIR_GLYPH_NONE) {
+        UIR_Glyph *glyph = &cache->glyphs[g];
+        uint32_t next = glyph->next;
+        UIR_glyph_table_remove(cache, UIR_glyph_find(cache, glyph->font, glyph->size, glyph->codepoint));
+        glyph->next = cache->free_glyph;
+        cache->free_glyph = g;
+        g = next;
+    }
+
+    shelf->first_glyph = UIR_GLYPH_NONE;
+    shelf->used_width = 0;
+    cache->evicted_count++;
+}
+
+// Returns the least recently used shelf that wasn't used this frame and is at least height tall,
+// and optionally holds glyphs, or UIR_GLYPH_NONE.
+static uint32_t UIR_glyph_shelf_lru(
+    UIR_GlyphCache *cache,
+    uint32_t height,
+    bool with_glyphs
+) {
+    uint32_t best = UIR_GLYPH_NONE;
+    for (uint32_t s = 0; s < cache->shelf_count; ++s) {
+        UIR_GlyphShelf *shelf = &cache->shelves[s];
+        if (shelf->last_used == cache->frame || shelf->height < height)
+            continue;
+        if (with_glyphs && shelf->first_glyph == UIR_GLYPH_NONE)
+            continue;
+        if (best == UIR_GLYPH_NONE || shelf->last_used < cache->shelves[best].last_used)
+            best = s;
+    }
+    return best;
+}
+
+// Returns a shelf with room for width x height px, evicting one if needed, or UIR_GLYPH_NONE.
+static uint32_t UIR_glyph_shelf_find(
+    UIR_GlyphCache *cache,
+    uint32_t width,
+    uint32_t height
+) {
+    if (width > cache->atlas.width)
+        return UIR_GLYPH_NONE;
+
+    // the tightest open shelf, not wasting more than half of it
+    uint32_t best = UIR_GLYPH_NONE;
+    for (uint32_t s = 0; s < cache->shelf_count; ++s) {
+        UIR_GlyphShelf *shelf = &cache->shelves[s];
+        if (shelf->height < height || shelf->height > height * 2)
+            continue;
+        if (cache->atlas.width - shelf->used_width < width)
+            continue;
+        if (best == UIR_GLYPH_NONE || shelf->height < cache->shelves[best].height)
+            best = s;
+    }
+    if (best != UIR_GLYPH_NONE)
+        return best;
+
+    // a new shelf below the others
+    UIR_GlyphShelf *last = cache->shelf_count ? &cache->shelves[cache->shelf_count - 1] : NULL;
+    uint32_t top = last ? last->y + last->height : 0;
+    if (cache->shelf_count < cache->shelf_capacity && top + height <= cache->atlas.height) {
+        cache->shelves[cache->shelf_count] = (UIR_GlyphShelf) {
+            .y = top,
+            .height = height,
+            .first_glyph = UIR_GLYPH_NONE,
+        };
+        return cache->shelf_count++;
+    }
+
+    // reuse the least recently used shelf
+    best = UIR_glyph_shelf_lru(cache, height, false);
+    if (best != UIR_GLYPH_NONE)
+        UIR_glyph_shelf_evict(cache, best);
+    return best;
+}
+
+// ------------------------------
+// Blank glyphs
+
+// Frees the blank glyphs not used this frame. Returns false if there were none.
+static bool UIR_glyph_blank_evict(
+    UIR_GlyphCache *cache
+) {
+    bool evicted = false;
+    uint32_t *link = &cache->first_blank;
+    while (*link != UIR_GLYPH_NONE) {
+        uint32_t g = *link;
+        UIR_Glyph *glyph = &cache->glyphs[g];
+        if (glyph->last_used == cache->frame) {
+            link = &glyph->next;
+            continue;
+        }
+
+        *link = glyph->next;
+        UIR_glyph_table_remove(cache, UIR_glyph_find(cache, glyph->font, glyph->size, glyph->codepoint));
+        glyph->next = cache->free_glyph;
+        cache->free_glyph = g;
+        evicted = true;
+    }
+    return evicted;
+}
+
+// ------------------------------
+// Glyphs
+
+UIR_Glyph *UIR_glyph_cache_get(
+    UIR_GlyphCache *cache,
+    const stbtt_fontinfo *font,
+    float size,
+    uint32_t codepoint
+) {
+    uint32_t i = UIR_glyph_find(cache, font, size, codepoint);
+    if (cache->table[i]) {
+        UIR_Glyph *glyph = &cache->glyphs[cache->table[i] - 1];
+        if (glyph->shelf != UIR_GLYPH_NONE)
+            cache->shelves[glyph->shelf].last_used = cache->frame;
+        else
+            glyph->last_used = cache->frame;
+        return glyph;
+    }
+
+    // ------------------------------
+    // measure
+
+    float scale = stbtt_ScaleForPixelHeight(font, size);
+    int x0, y0, x1, y1;
+    stbtt_GetCodepointBitmapBox(font, (int)codepoint, scale, scale, &x0, &y0, &x1, &y1);
+    int advance, left_side_bearing;
+    stbtt_GetCodepointHMetrics(font, (int)codepoint, &advance, &left_side_bearing);
+
+    uint32_t width = x1 > x0 ? (uint32_t)(x1 - x0) : 0;
+    uint32_t height = y1 > y0 ? (uint32_t)(y1 - y0) : 0;
+    if (!width || !height)
+        width = height = 0;
+
+    // ------------------------------
+    // find room, evicting blank glyphs, then shelves, if needed
+
+    if (cache->free_glyph == UIR_GLYPH_NONE && !UIR_glyph_blank_evict(cache)) {
+        uint32_t s = UIR_glyph_shelf_lru(cache, 0, true);
+        if (s == UIR_GLYPH_NONE)
+            return NULL;
+        UIR_glyph_shelf_evict(cache, s);
+    }
+
+    uint32_t s = UIR_GLYPH_NONE;
+    if (width) {
+        uint32_t shelf_height = height + UIR_GLYPH_PADDING;
+        shelf_height = (shelf_height + UIR_GLYPH_SHELF_ROUND - 1) / UIR_GLYPH_SHELF_ROUND * UIR_GLYPH_SHELF_ROUND;
+        s = UIR_glyph_shelf_find(cache, width + UIR_GLYPH_PADDING, shelf_height);
+        if (s == UIR_GLYPH_NONE)
+            return NULL;
+    }
+
+    uint32_t g = cache->free_glyph;
+    UIR_Glyph *glyph = &cache->glyphs[g];
+    cache->free_glyph = glyph->next;
+
+    *glyph = (UIR_Glyph) {
+        .width = width,
+        .height = height,
+        .offset_x = (float)x0,
+        .offset_y = (float)y0,
+        .advance = (float)advance * scale,
+        .font = font,
+        .size = size,
+        .codepoint = codepoint,
+        .shelf = s,
+        .last_used = cache->frame,
+        .next = UIR_GLYPH_NONE,
+    };
+
+    if (s == UIR_GLYPH_NONE) {
+        glyph->next = cache->first_blank;
+        cache->first_blank = g;
+    }
+
+    // ------------------------------
+    // rasterize into the shelf
+
+    if (s != UIR_GLYPH_NONE) {
+        UIR_GlyphShelf *shelf = &cache->shelves[s];
+        glyph->x = shelf->used_width;
+        glyph->y = shelf->y;
+        glyph->next = shelf->first_glyph;
+        shelf->first_glyph = g;
+        shelf->used_width += width + UIR_GLYPH_PADDING;
+        shelf->last_used = cache->frame;
+
+        UIR_Image *atlas = &cache->atlas;
+        stbtt_MakeCodepointBitmap(
+            font,
+            &atlas->data[glyph->y * atlas->data_stride + glyph->x],
+            (int)width, (int)height, (int)atlas->data_stride,
+            scale, scale,
+            (int)codepoint
+        );
+        UIR_image_mark_dirty(atlas, glyph->x, glyph->y, glyph->x + width, glyph->y + height);
+        cache->rasterized_count++;
+    }
+
+    // evictions may have moved entries, so find the slot again
+    cache->table[UIR_glyph_find(cache, font, size, codepoint)] = g + 1;
+    return glyph;
+}
+
+UIR_DrawCmd UIR_glyph_draw_cmd(
+    UIR_GlyphCache *cache,
+    UIR_Glyph *glyph,
+    float pen_x,
+    float pen_y,
+    RGBA colour
+) {
+    float x = floorf(pen_x + 0.5f) + glyph->offset_x;
+    float y = floorf(pen_y + 0.5f) + glyph->offset_y;
+    UIR_Image *atlas = &cache->atlas;
+
+    return (UIR_DrawCmd) { .image = {
+        .type = UIR_DRAW_IMAGE_A,
+        .rect = { x, y, x + (float)glyph->width, y + (float)glyph->height },
+        .tint_colour = colour,
+        .data = &atlas->data[glyph->y * atlas->data_stride + glyph->x],
+        .data_stride = atlas->data_stride,
+        .scale = 1,
+        .handle = atlas,
+    }};
+}
@@ -0,0 +1,114 @@
+#ifndef UIR_GLYPH_H
+#define UIR_GLYPH_H
+
+#include "uir.h"
+#include "../vendor/stb_truetype.h"
+
+// ----------------------
+// Glyph cache
+//
+// Rasterizes glyphs with stb_truetype the first time they are asked for, keyed by font, pixel
+// size and codepoint, and packs them into an A8 atlas. The atlas is split into shelves: rows of
+// glyphs of similar height. When it fills up, the least recently used shelf is evicted.
+//
+// A glyph's atlas coordinates stay the same until it is evicted, and glyphs used since the last
+// UIR_glyph_cache_next_frame are never evicted, so commands built this frame stay valid.
+// The atlas is a UIR_Image, so reusing atlas space only redraws tiles showing the changed pixels.
+// Blank glyphs take no atlas space. They are kept on a list of their own, and are evicted first
+// when every glyph is taken, since measuring them again is cheap.
+
+#define UIR_GLYPH_NONE UINT32_MAX
+
+typedef struct UIR_Glyph {
+    // Where the glyph's coverage is in the atlas. Zero size for blank glyphs, such as spaces.
+    uint32_t x, y;
+    uint32_t width, height;
+
+    // From the pen position on the baseline to the top left of the coverage, in px.
+    float offset_x, offset_y;
+    float advance;
+
+    // Internal.
+    const stbtt_fontinfo *font;
+    float size;
+    uint32_t codepoint;
+    uint32_t shelf;
+    uint32_t last_used; // frame, for blank glyphs
+    uint32_t next; // next glyph on the same shelf, in the blank list, or in the free list
+} UIR_Glyph;
+
+typedef struct UIR_GlyphShelf {
+    uint32_t y, height;
+    uint32_t used_width;
+    uint32_t first_glyph;
+    uint32_t last_used; // frame
+} UIR_GlyphShelf;
+
+typedef struct UIR_GlyphCache {
+    // ----------------------
+    // Read Only!
+
+    UIR_Image atlas;
+
+    UIR_Glyph *glyphs;
+    uint32_t glyph_capacity;
+    uint32_t free_glyph;
+    uint32_t first_blank;
+
+    uint32_t *table; // open addressed, key -> glyph + 1
+    uint32_t table_mask;
+
+    UIR_GlyphShelf *shelves;
+    uint32_t shelf_count;
+    uint32_t shelf_capacity;
+
+    uint32_t frame;
+
+    // ----------------------
+    // Read/Write
+
+    // Counters, for tuning the atlas size.
+    uint32_t rasterized_count;
+    uint32_t evicted_count;
+} UIR_GlyphCache;
+
+// Returns minimum memory size for a cache of glyph_capacity glyphs in an atlas of this size.
+size_t UIR_glyph_cache_memory_size(
+    uint32_t atlas_width,
+    uint32_t atlas_height,
+    uint32_t glyph_capacity
+);
+
+// Returns NULL if memory is too small.
+UIR_GlyphCache *UIR_glyph_cache_new(
+    uint32_t atlas_width,
+    uint32_t atlas_height,
+    uint32_t glyph_capacity,
+    unsigned char *memory,
+    size_t memory_size
+);
+
+// Glyphs used before this call may be evicted after it.
+void UIR_glyph_cache_next_frame(
+    UIR_GlyphCache *cache
+);
+
+// size is the pixel height, as for stbtt_ScaleForPixelHeight.
+// Returns NULL if the glyph doesn't fit, because every shelf it could use was used this frame.
+UIR_Glyph *UIR_glyph_cache_get(
+    UIR_GlyphCache *cache,
+    const stbtt_fontinfo *font,
+    float size,
+    uint32_t codepoint
+);
+
+// Returns a UIR_DRAW_IMAGE_A command drawing glyph with its pen at (pen_x, pen_y), snapped to whole pixels.
+UIR_DrawCmd UIR_glyph_draw_cmd(
+    UIR_GlyphCache *cache,
+    UIR_Glyph *glyph,
+    float pen_x,
+    float pen_y,
+    RGBA colour
+);
+
+#endif
@@ -0,0 +1,392 @@
+#include "uir_record.h"
+
+#include <stdalign.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+#define ALIGN_UP(p, align) (void*)(((uintptr_t)(p) + ((uintptr_t)align) - 1) & ~(((uintptr_t)align) - 1))
+
+// Every record starts on this alignment, so commands and blobs can be used in place.
+#define UIR_RECORD_ALIGN 8
+
+static const char UIR_RECORD_MAGIC[8] = { 'U', 'I', 'R', 'R', 'E', 'C', 0, 0 };
+
+enum {
+    UIR_RECORD_BLOB = 1,
+    UIR_RECORD_FRAME,
+    UIR_RECORD_CMD,
+};
+
+// A capture is the header, then records. Each frame is a frame record followed by one command
+// record per command, each preceded by records for the blobs it references first.
+typedef struct UIR_RecordHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t cmd_size; // sizeof(UIR_DrawCmd) of the recording build
+    uint32_t frame_count;
+    uint32_t max_cmd_count;
+} UIR_RecordHeader;
+
+typedef struct UIR_RecordChunk {
+    uint32_t type;
+    uint32_t size; // excluding padding
+} UIR_RecordChunk;
+
+typedef struct UIR_RecordFrame {
+    uint32_t width, height;
+    RGBA clear_colour;
+    uint32_t debug_flags;
+    uint32_t cmd_count;
+    uint32_t padding;
+} UIR_RecordFrame;
+
+// ------------------------------
+// Recording
+
+static uint32_t UIR_record_table_size(uint32_t blob_capacity) {
+    uint32_t size = 2;
+    while (size < blob_capacity * 2)
+        size *= 2;
+    return size;
+}
+
+// 64 bits, as blobs with equal hashes are taken to be equal.
+static uint64_t UIR_record_hash(
+    const unsigned char *data,
+    size_t size
+) {
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+    uint64_t k;
+    for (size_t i = size >> 3; i; i--) {
+        memcpy(&k, data, sizeof(k));
+        data += sizeof(k);
+        h ^= k * 0xbf58476d1ce4e5b9ull;
+        h = ((h << 27) | (h >> 37)) * 0x94d049bb133111ebull;
+    }
+    k = 0;
+    for (size_t i = size & 7; i; i--) {
+        k <<= 8;
+        k |= data[i - 1];
+    }
+    h ^= k * 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 31;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 29;
+    return h;
+}
+
+static void UIR_recorder_write(
+    UIR_Recorder *recorder,
+    const void *data,
+    size_t size
+) {
+    if (size && fwrite(data, 1, size, recorder->file) != size)
+        recorder->error_flags |= UIR_ERROR_NO_MEM;
+    recorder->offset += size;
+}
+
+// Writes a record header, and returns the offset of its payload.
+static uint64_t UIR_recorder_chunk(
+    UIR_Recorder *recorder,
+    uint32_t type,
+    const void *data,
+    size_t size
+) {
+    static const unsigned char zeros[UIR_RECORD_ALIGN] = { 0 };
+
+    UIR_RecordChunk chunk = { type, (uint32_t)size };
+    UIR_recorder_write(recorder, &chunk, sizeof(chunk));
+    uint64_t offset = recorder->offset;
+    UIR_recorder_write(recorder, data, size);
+    UIR_recorder_write(recorder, zeros, (UIR_RECORD_ALIGN - size % UIR_RECORD_ALIGN) % UIR_RECORD_ALIGN);
+    return offset;
+}
+
+// Returns the offset of a blob with this content, writing it if it is new. NULL data is offset 0.
+static uint64_t UIR_recorder_blob(
+    UIR_Recorder *recorder,
+    const void *data,
+    size_t size
+) {
+    if (!data || !size || size > UINT32_MAX)
+        return 0;
+
+    uint64_t hash = UIR_record_hash(data, size);
+    uint32_t slot = (uint32_t)hash & recorder->blob_mask;
+    while (recorder->blobs[slot].offset) {
+        if (recorder->blobs[slot].hash == hash) {
+            recorder->blob_bytes_saved += size;
+            return recorder->blobs[slot].offset;
+        }
+        slot = (slot + 1) & recorder->blob_mask;
+    }
+
+    uint64_t offset = UIR_recorder_chunk(recorder, UIR_RECORD_BLOB, data, size);
+    recorder->blob_bytes += size;
+
+    // past capacity, new blobs are only written
+    if (recorder->blob_count < (recorder->blob_mask + 1) / 2) {
+        recorder->blobs[slot] = (UIR_RecordBlob) { hash, offset };
+        recorder->blob_count++;
+    }
+    return offset;
+}
+
+// Pointers are stored as offsets into the capture.
+static void *UIR_record_offset_ptr(uint64_t offset) {
+    return (void*)(uintptr_t)offset;
+}
+
+size_t UIR_recorder_memory_size(
+    uint32_t blob_capacity
+) {
+    return alignof(UIR_RecordBlob) + (size_t)UIR_record_table_size(blob_capacity) * sizeof(UIR_RecordBlob);
+}
+
+bool UIR_recorder_begin(
+    UIR_Recorder *recorder,
+    FILE *file,
+    uint32_t blob_capacity,
+    unsigned char *memory,
+    size_t memory_size
+) {
+    if (memory_size < UIR_recorder_memory_size(blob_capacity))
+        return false;
+
+    uint32_t table_size = UIR_record_table_size(blob_capacity);
+    UIR_RecordBlob *blobs = ALIGN_UP(memory, alignof(UIR_RecordBlob));
+    memset(blobs, 0, (size_t)table_size * sizeof(UIR_RecordBlob));
+
+    *recorder = (UIR_Recorder) {
+        .file = file,
+        .blobs = blobs,
+        .blob_mask = table_size - 1,
+    };
+
+    UIR_RecordHeader header = {
+        .version = UIR_RECORD_VERSION,
+        .cmd_size = sizeof(UIR_DrawCmd),
+    };
+    memcpy(header.magic, UIR_RECORD_MAGIC, sizeof(header.magic));
+    UIR_recorder_write(recorder, &header, sizeof(header));
+    return true;
+}
+
+// The bytes of data the rect shows, as the renderer samples them, or SIZE_MAX if that overflows.
+static size_t UIR_record_image_size(
+    const UIR_DrawCmd_Image *image
+) {
+    if (!(image->scale > 0.f && image->rect.x1 > image->rect.x0 && image->rect.y1 > image->rect.y0))
+        return 0;
+
+    size_t bytes_per_pixel = 4;
+    if (image->type == UIR_DRAW_IMAGE_A || image->format == UIR_IMAGE_FORMAT_INDEXED)
+        bytes_per_pixel = 1;
+    else if (image->format == UIR_IMAGE_FORMAT_RGB)
+        bytes_per_pixel = 3;
+
+    // a replayed command may hold any rect, so the size is checked before it is computed in size_t
+    float columns = ceilf((image->rect.x1 - image->rect.x0) / image->scale);
+    float rows = ceilf((image->rect.y1 - image->rect.y0) / image->scale);
+    double size = ((double)rows - 1.0) * image->data_stride + (double)columns * (double)bytes_per_pixel;
+    if (!(size < (double)(SIZE_MAX / 2)))
+        return SIZE_MAX;
+    return ((size_t)rows - 1) * image->data_stride + (size_t)columns * bytes_per_pixel;
+}
+
+uint32_t UIR_record_draw(
+    UIR_Recorder *recorder,
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count
+) {
+    UIR_RecordFrame frame = {
+        .width = uir->width_in_px,
+        .height = uir->height_in_px,
+        .clear_colour = uir->clear_colour,
+        .debug_flags = uir->debug_flags,
+        .cmd_count = draw_cmd_count,
+    };
+    UIR_recorder_chunk(recorder, UIR_RECORD_FRAME, &frame, sizeof(frame));
+
+    for (uint32_t i = 0; i < draw_cmd_count; ++i) {
+        UIR_DrawCmd cmd = draw_cmds[i];
+
+        switch (cmd.common.type) {
+            case UIR_DRAW_IMAGE_A:
+            case UIR_DRAW_IMAGE_RGBA: {
+                UIR_DrawCmd_Image *image = &cmd.image;
+                size_t size = UIR_record_image_size(image);
+                image->data = UIR_record_offset_ptr(UIR_recorder_blob(recorder, image->data, size));
+                if (image->type == UIR_DRAW_IMAGE_RGBA && image->format == UIR_IMAGE_FORMAT_INDEXED)
+                    image->palette = UIR_record_offset_ptr(UIR_recorder_blob(recorder, image->palette, 256 * sizeof(RGBA)));
+                else
+                    image->palette = NULL;
+                image->handle = NULL;
+            } break;
+
+            case UIR_DRAW_PATH_STROKE:
+            case UIR_DRAW_PATH_FILL: {
+                UIR_DrawCmd_Path *path = &cmd.path;
+                path->points = UIR_record_offset_ptr(UIR_recorder_blob(recorder, path->points, path->point_count * sizeof(UIR_Point)));
+                path->verbs = UIR_record_offset_ptr(UIR_recorder_blob(recorder, path->verbs, path->verb_count));
+                path->bins = NULL;
+            } break;
+
+            default:
+                break;
+        }
+
+        UIR_recorder_chunk(recorder, UIR_RECORD_CMD, &cmd, sizeof(cmd));
+    }
+
+    recorder->frame_count++;
+    if (draw_cmd_count > recorder->max_cmd_count)
+        recorder->max_cmd_count = draw_cmd_count;
+    return UIR_draw(uir, draw_cmds, draw_cmd_count);
+}
+
+void UIR_recorder_end(
+    UIR_Recorder *recorder
+) {
+    long end = ftell(recorder->file);
+    if (end < (long)recorder->offset)
+        return;
+
+    // the header starts where recording began
+    long counts = end - (long)recorder->offset + (long)offsetof(UIR_RecordHeader, frame_count);
+    uint32_t values[2] = { recorder->frame_count, recorder->max_cmd_count };
+    if (fseek(recorder->file, counts, SEEK_SET) == 0 && fwrite(values, sizeof(values), 1, recorder->file) != 1)
+        recorder->error_flags |= UIR_ERROR_NO_MEM;
+    fseek(recorder->file, end, SEEK_SET);
+}
+
+// ------------------------------
+// Replay
+
+// Returns the payload of the record at replay->offset, and moves past it. NULL if it runs off the end.
+static const unsigned char *UIR_replay_chunk(
+    UIR_Replay *replay,
+    UIR_RecordChunk *chunk
+) {
+    if (replay->size - replay->offset < sizeof(*chunk))
+        return NULL;
+    memcpy(chunk, replay->data + replay->offset, sizeof(*chunk));
+
+    size_t payload = replay->offset + sizeof(*chunk);
+    size_t padded = ((size_t)chunk->size + UIR_RECORD_ALIGN - 1) / UIR_RECORD_ALIGN * UIR_RECORD_ALIGN;
+    if (replay->size - payload < padded)
+        return NULL;
+
+    replay->offset = payload + padded;
+    return replay->data + payload;
+}
+
+// Turns an offset stored by UIR_record_draw back into a pointer into the capture.
+static bool UIR_replay_ptr(
+    UIR_Replay *replay,
+    void *ptr,
+    size_t size
+) {
+    uintptr_t offset;
+    memcpy(&offset, ptr, sizeof(offset));
+    if (!offset)
+        return true;
+    if (offset > replay->size || replay->size - offset < size)
+        return false;
+
+    uint8_t *p = (uint8_t*)(uintptr_t)(replay->data + offset);
+    memcpy(ptr, &p, sizeof(p));
+    return true;
+}
+
+bool UIR_replay_open(
+    UIR_Replay *replay,
+    const unsigned char *data,
+    size_t size
+) {
+    UIR_RecordHeader header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, UIR_RECORD_MAGIC, sizeof(header.magic)) != 0
+        || header.version != UIR_RECORD_VERSION
+        || header.cmd_size != sizeof(UIR_DrawCmd)
+    )
+        return false;
+
+    *replay = (UIR_Replay) {
+        .data = data,
+        .size = size,
+        .offset = sizeof(header),
+        .frame_count = header.frame_count,
+        .max_cmd_count = header.max_cmd_count,
+    };
+    return true;
+}
+
+bool UIR_replay_next(
+    UIR_Replay *replay,
+    UIR_ReplayFrame *frame,
+    UIR_DrawCmd *cmds,
+    uint32_t cmd_capacity
+) {
+    UIR_RecordChunk chunk;
+    const unsigned char *payload;
+    do {
+        payload = UIR_replay_chunk(replay, &chunk);
+        if (!payload)
+            return false;
+    } while (chunk.type != UIR_RECORD_FRAME);
+
+    UIR_RecordFrame recorded;
+    if (chunk.size < sizeof(recorded))
+        return false;
+    memcpy(&recorded, payload, sizeof(recorded));
+
+    *frame = (UIR_ReplayFrame) {
+        .width = recorded.width,
+        .height = recorded.height,
+        .clear_colour = recorded.clear_colour,
+        .debug_flags = recorded.debug_flags,
+        .cmd_count = recorded.cmd_count,
+    };
+    if (recorded.cmd_count > cmd_capacity)
+        return false;
+
+    for (uint32_t i = 0; i < recorded.cmd_count;) {
+        payload = UIR_replay_chunk(replay, &chunk);
+        if (!payload)
+            return false;
+        if (chunk.type != UIR_RECORD_CMD)
+            continue;
+        if (chunk.size != sizeof(UIR_DrawCmd))
+            return false;
+
+        UIR_DrawCmd *cmd = &cmds[i++];
+        memcpy(cmd, payload, sizeof(*cmd));
+
+        bool valid = true;
+        switch (cmd->common.type) {
+            case UIR_DRAW_IMAGE_A:
+            case UIR_DRAW_IMAGE_RGBA:
+                valid = UIR_replay_ptr(replay, &cmd->image.data, UIR_record_image_size(&cmd->image))
+                    && UIR_replay_ptr(replay, &cmd->image.palette, 256 * sizeof(RGBA));
+                break;
+
+            case UIR_DRAW_PATH_STROKE:
+            case UIR_DRAW_PATH_FILL:
+                valid = UIR_replay_ptr(replay, &cmd->path.points, cmd->path.point_count * sizeof(UIR_Point))
+                    && UIR_replay_ptr(replay, &cmd->path.verbs, cmd->path.verb_count);
+                break;
+
+            default:
+                break;
+        }
+        if (!valid)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,117 @@
+#ifndef UIR_RECORD_H
+#define UIR_RECORD_H
+
+#include "uir.h"
+
+#include <stdio.h>
+
+// ----------------------
+// Recording and replay
+//
+// Captures UIR_draw calls into a file: the panel size, clear colour and debug flags, and the
+// commands. Image pixels, path points and verbs are stored once per distinct content, so a
+// capture of a static scene grows by about the size of its commands per frame.
+//
+// A capture is one block of memory, meant to be mapped: commands are replayed pointing
+// straight into it. It stores UIR_DrawCmd as laid out by the build that recorded it, so it
+// only replays in builds with the same layout.
+//
+// Image handles are not recorded. Replayed images are plain pixels, and still redraw when
+// their content changes, as changed pixels are stored at a new offset. Virtual canvases are
+// recorded as panels of their viewport size, without the anchor.
+
+#define UIR_RECORD_VERSION 2
+
+typedef struct UIR_RecordBlob {
+    uint64_t hash;
+    uint64_t offset; // in the file, 0 if the slot is empty
+} UIR_RecordBlob;
+
+typedef struct UIR_Recorder {
+    // ----------------------
+    // Read Only!
+
+    FILE *file;
+    uint64_t offset;
+
+    // open addressed by content hash
+    UIR_RecordBlob *blobs;
+    uint32_t blob_mask;
+    uint32_t blob_count;
+
+    // ----------------------
+    // Read/Write
+
+    // Counters.
+    uint32_t frame_count;
+    uint32_t max_cmd_count;    // in one frame
+    uint64_t blob_bytes;       // written
+    uint64_t blob_bytes_saved; // not written, as the same content was already stored
+
+    // UIR_ERROR_NO_MEM once a write failed.
+    uint32_t error_flags;
+} UIR_Recorder;
+
+typedef struct UIR_ReplayFrame {
+    uint32_t width, height;
+    RGBA clear_colour;
+    uint32_t debug_flags;
+    uint32_t cmd_count;
+} UIR_ReplayFrame;
+
+typedef struct UIR_Replay {
+    const unsigned char *data;
+    size_t size;
+    size_t offset; // of the next record
+
+    // From the header. Both are 0 if the recorder's file couldn't seek back to write them.
+    uint32_t frame_count;
+    uint32_t max_cmd_count;
+} UIR_Replay;
+
+// Returns minimum memory size for remembering blob_capacity distinct blobs.
+// Once more are recorded, the rest are stored without looking for copies.
+size_t UIR_recorder_memory_size(
+    uint32_t blob_capacity
+);
+
+// Writes the header. Returns false if memory is too small.
+bool UIR_recorder_begin(
+    UIR_Recorder *recorder,
+    FILE *file,
+    uint32_t blob_capacity,
+    unsigned char *memory,
+    size_t memory_size
+);
+
+// Records the frame, then draws it. Returns what UIR_draw returns.
+uint32_t UIR_record_draw(
+    UIR_Recorder *recorder,
+    UIR *uir,
+    UIR_DrawCmd *draw_cmds,
+    uint32_t draw_cmd_count
+);
+
+// Writes the frame and command counts into the header, if the file can seek. Does not close the file.
+void UIR_recorder_end(
+    UIR_Recorder *recorder
+);
+
+// data is the whole capture, and must stay valid while replayed commands are drawn.
+// Returns false if it isn't a capture, or was recorded with another UIR_DrawCmd layout.
+bool UIR_replay_open(
+    UIR_Replay *replay,
+    const unsigned char *data,
+    size_t size
+);
+
+// Reads the next frame into frame, and its commands into cmds.
+// Returns false at the end, or if cmds can't hold frame->cmd_count commands.
+bool UIR_replay_next(
+    UIR_Replay *replay,
+    UIR_ReplayFrame *frame,
+    UIR_DrawCmd *cmds,
+    uint32_t cmd_capacity
+);
+
+#endif
@@ -0,0 +1,322 @@
+
+#include "uir_thread.h"
+
+#include <string.h>
+
+#define UIR_RENDER_FRAME_INDEX_MASK 3u
+#define UIR_RENDER_FRAME_FRESH 4u
+
+static void *UIR_render_thread_main(void *arg) {
+    UIR_RenderThread *rt = arg;
+
+    for (;;) {
+        // ------------------------------
+        // sleep until a frame is published
+
+        pthread_mutex_lock(&rt->mutex);
+        while (!rt->quit && !(__atomic_load_n(&rt->middle, __ATOMIC_ACQUIRE) & UIR_RENDER_FRAME_FRESH))
+            pthread_cond_wait(&rt->wake, &rt->mutex);
+        bool quit = rt->quit;
+        pthread_mutex_unlock(&rt->mutex);
+
+        if (quit)
+            break;
+
+        // ------------------------------
+        // take the latest frame, handing back the one we drew last
+
+        uint32_t middle = __atomic_exchange_n(&rt->middle, rt->read_index, __ATOMIC_ACQ_REL);
+        rt->read_index = middle & UIR_RENDER_FRAME_INDEX_MASK;
+
+        UIR_RenderFrame *frame = &rt->frames[rt->read_index];
+        uint32_t redrawn = UIR_draw(rt->uir, frame->cmds, frame->cmd_count);
+
+        if (rt->present)
+            rt->present(rt->present_user_data, rt->uir, frame->id, redrawn);
+
+        // ------------------------------
+        // signal completion
+
+        pthread_mutex_lock(&rt->mutex);
+        rt->completed_id = frame->id;
+        rt->last_redrawn = redrawn;
+        pthread_cond_broadcast(&rt->done);
+        pthread_mutex_unlock(&rt->mutex);
+    }
+
+    return NULL;
+}
+
+bool UIR_render_thread_start(
+    UIR_RenderThread *rt,
+    UIR *uir,
+    UIR_DrawCmd *cmd_memory,
+    uint32_t cmd_capacity
+) {
+    rt->uir = uir;
+    rt->cmd_capacity = cmd_capacity;
+    for (uint32_t i = 0; i < UIR_RENDER_THREAD_FRAMES; ++i) {
+        rt->frames[i] = (UIR_RenderFrame) {
+            .cmds = cmd_memory + (size_t)i * cmd_capacity,
+        };
+    }
+
+    rt->write_index = 0;
+    rt->middle = 1;
+    rt->read_index = 2;
+    rt->published_id = 0;
+    rt->completed_id = 0;
+    rt->last_redrawn = 0;
+    rt->quit = false;
+
+    if (pthread_mutex_init(&rt->mutex, NULL) != 0)
+        return false;
+    if (pthread_cond_init(&rt->wake, NULL) != 0) {
+        pthread_mutex_destroy(&rt->mutex);
+        return false;
+    }
+    if (pthread_cond_init(&rt->done, NULL) != 0) {
+        pthread_cond_destroy(&rt->wake);
+        pthread_mutex_destroy(&rt->mutex);
+        return false;
+    }
+    if (pthread_create(&rt->thread, NULL, UIR_render_thread_main, rt) != 0) {
+        pthread_cond_destroy(&rt->done);
+        pthread_cond_destroy(&rt->wake);
+        pthread_mutex_destroy(&rt->mutex);
+        return false;
+    }
+
+    return true;
+}
+
+UIR_DrawCmd *UIR_render_thread_commands(
+    UIR_RenderThread *rt
+) {
+    return rt->frames[rt->write_index].cmds;
+}
+
+uint64_t UIR_render_thread_publish(
+    UIR_RenderThread *rt,
+    uint32_t cmd_count
+) {
+    UIR_RenderFrame *frame = &rt->frames[rt->write_index];
+    frame->cmd_count = cmd_count < rt->cmd_capacity ? cmd_count : rt->cmd_capacity;
+    frame->id = ++rt->published_id;
+
+    // Swap our frame into the middle. If the renderer never took the previous one, it is dropped.
+    uint32_t middle = __atomic_exchange_n(&rt->middle, rt->write_index | UIR_RENDER_FRAME_FRESH, __ATOMIC_ACQ_REL);
+    rt->write_index = middle & UIR_RENDER_FRAME_INDEX_MASK;
+
+    // The mutex only guards sleeping, never the frames themselves.
+    pthread_mutex_lock(&rt->mutex);
+    pthread_cond_signal(&rt->wake);
+    pthread_mutex_unlock(&rt->mutex);
+
+    return frame->id;
+}
+
+uint64_t UIR_render_thread_wait(
+    UIR_RenderThread *rt,
+    uint64_t frame_id,
+    uint32_t *redrawn
+) {
+    pthread_mutex_lock(&rt->mutex);
+    while (rt->completed_id < frame_id && !rt->quit)
+        pthread_cond_wait(&rt->done, &rt->mutex);
+
+    uint64_t completed_id = rt->completed_id;
+    if (redrawn)
+        *redrawn = rt->last_redrawn;
+    pthread_mutex_unlock(&rt->mutex);
+
+    return completed_id;
+}
+
+void UIR_render_thread_stop(
+    UIR_RenderThread *rt
+) {
+    pthread_mutex_lock(&rt->mutex);
+    rt->quit = true;
+    pthread_cond_signal(&rt->wake);
+    pthread_cond_broadcast(&rt->done);
+    pthread_mutex_unlock(&rt->mutex);
+
+    pthread_join(rt->thread, NULL);
+
+    pthread_cond_destroy(&rt->done);
+    pthread_cond_destroy(&rt->wake);
+    pthread_mutex_destroy(&rt->mutex);
+}
+
+// ------------------------------
+// Batches
+
+// Returns the panel that job belongs to: the last panel with jobs starting at or before it.
+static UIR_BatchPanel *UIR_batch_job_panel(
+    UIR_WorkerPool *pool,
+    uint32_t job
+) {
+    uint32_t lo = 0;
+    uint32_t hi = pool->panel_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (pool->panels[mid].first_job <= job)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return &pool->panels[lo - 1];
+}
+
+// Runs jobs of the current phase until none are left.
+static void UIR_worker_pool_run_jobs(
+    UIR_WorkerPool *pool
+) {
+    for (;;) {
+        uint32_t job = __atomic_fetch_add(&pool->next_job, 1, __ATOMIC_RELAXED);
+        if (job >= pool->job_count)
+            break;
+
+        if (!pool->drawing) {
+            UIR_BatchPanel *panel = &pool->panels[job];
+            panel->redrawn = UIR_draw_prepare(panel->uir, panel->cmds, panel->cmd_count);
+            continue;
+        }
+
+        UIR_BatchPanel *panel = UIR_batch_job_panel(pool, job);
+        uint32_t first_tile = (job - panel->first_job) * UIR_BATCH_JOB_TILES;
+        uint32_t redrawn = UIR_draw_tiles(panel->uir, panel->cmds, panel->cmd_count, first_tile, first_tile + UIR_BATCH_JOB_TILES);
+        __atomic_fetch_add(&panel->redrawn, redrawn, __ATOMIC_RELAXED);
+    }
+}
+
+static void *UIR_worker_main(void *arg) {
+    UIR_WorkerPool *pool = arg;
+    uint64_t seen_phase_id = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->quit && pool->phase_id == seen_phase_id)
+            pthread_cond_wait(&pool->wake, &pool->mutex);
+        bool quit = pool->quit;
+        seen_phase_id = pool->phase_id;
+        pthread_mutex_unlock(&pool->mutex);
+
+        if (quit)
+            break;
+
+        UIR_worker_pool_run_jobs(pool);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return NULL;
+}
+
+// Runs job_count jobs on the workers and this thread, and waits for all of them.
+static void UIR_worker_pool_run_phase(
+    UIR_WorkerPool *pool,
+    bool drawing,
+    uint32_t job_count
+) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->drawing = drawing;
+    pool->job_count = job_count;
+    pool->next_job = 0;
+    pool->busy = pool->thread_count;
+    pool->phase_id++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    UIR_worker_pool_run_jobs(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->busy)
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+bool UIR_worker_pool_start(
+    UIR_WorkerPool *pool,
+    uint32_t thread_count
+) {
+    *pool = (UIR_WorkerPool) { 0 };
+    if (thread_count > UIR_WORKER_POOL_MAX_THREADS)
+        thread_count = UIR_WORKER_POOL_MAX_THREADS;
+
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+        return false;
+    if (pthread_cond_init(&pool->wake, NULL) != 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        return false;
+    }
+    if (pthread_cond_init(&pool->done, NULL) != 0) {
+        pthread_cond_destroy(&pool->wake);
+        pthread_mutex_destroy(&pool->mutex);
+        return false;
+    }
+
+    for (; pool->thread_count < thread_count; pool->thread_count++) {
+        if (pthread_create(&pool->threads[pool->thread_count], NULL, UIR_worker_main, pool) != 0) {
+            UIR_worker_pool_stop(pool);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void UIR_worker_pool_stop(
+    UIR_WorkerPool *pool
+) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint32_t i = 0; i < pool->thread_count; ++i)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+uint32_t UIR_draw_batch(
+    UIR_WorkerPool *pool,
+    UIR_BatchPanel *panels,
+    uint32_t panel_count
+) {
+    pool->panels = panels;
+    pool->panel_count = panel_count;
+
+    // ------------------------------
+    // prepare every panel, one job each
+
+    UIR_worker_pool_run_phase(pool, false, panel_count);
+
+    // ------------------------------
+    // split the grid of each panel with changed tiles into jobs
+
+    uint32_t job_count = 0;
+    for (uint32_t i = 0; i < panel_count; ++i) {
+        UIR_BatchPanel *panel = &panels[i];
+        panel->first_job = job_count;
+        if (panel->redrawn) {
+            uint32_t grid_tile_count = panel->uir->width_in_tiles * panel->uir->height_in_tiles;
+            job_count += (grid_tile_count + UIR_BATCH_JOB_TILES - 1) / UIR_BATCH_JOB_TILES;
+        }
+        panel->redrawn = 0;
+    }
+
+    UIR_worker_pool_run_phase(pool, true, job_count);
+
+    uint32_t redrawn = 0;
+    for (uint32_t i = 0; i < panel_count; ++i)
+        redrawn += panels[i].redrawn;
+    return redrawn;
+}
@@ -0,0 +1,161 @@
+#ifndef UIR_THREAD_H
+#define UIR_THREAD_H
+
+#include "uir.h"
+
+#include <pthread.h>
+
+// ----------------------
+// Render thread
+//
+// Runs UIR_draw on its own thread. The app fills a command list, publishes it, and continues
+// immediately. Command lists are handed over through a lock-free triple buffer: if the app
+// publishes faster than the renderer draws, stale frames are skipped and the latest is drawn.
+//
+// While the thread runs, the UIR belongs to it. Only touch the UIR's tiles inside the present
+// callback, or after UIR_render_thread_wait when no newer frame has been published.
+// Images and paths referenced by published commands must stay valid until their frame completes.
+
+#define UIR_RENDER_THREAD_FRAMES 3
+
+typedef void (*UIR_PresentFn)(void *user_data, UIR *uir, uint64_t frame_id, uint32_t redrawn);
+
+typedef struct UIR_RenderFrame {
+    UIR_DrawCmd *cmds;
+    uint32_t cmd_count;
+    uint64_t id;
+} UIR_RenderFrame;
+
+typedef struct UIR_RenderThread {
+    // ----------------------
+    // Read Only!
+
+    UIR *uir;
+    UIR_RenderFrame frames[UIR_RENDER_THREAD_FRAMES];
+    uint32_t cmd_capacity; // per frame
+
+    uint32_t write_index;  // owned by the app
+    uint32_t read_index;   // owned by the render thread
+    uint32_t middle;       // atomic, the frame in between, with UIR_RENDER_FRAME_FRESH if unread
+
+    uint64_t published_id; // owned by the app
+    uint64_t completed_id; // guarded by mutex
+    uint32_t last_redrawn; // guarded by mutex
+    bool quit;             // guarded by mutex
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+
+    // ----------------------
+    // Read/Write, before UIR_render_thread_start
+
+    // Optional. Called on the render thread after each frame, while the tiles are stable.
+    UIR_PresentFn present;
+    void *present_user_data;
+} UIR_RenderThread;
+
+// cmd_memory must fit UIR_RENDER_THREAD_FRAMES * cmd_capacity commands.
+// Returns false if the thread could not be created.
+bool UIR_render_thread_start(
+    UIR_RenderThread *rt,
+    UIR *uir,
+    UIR_DrawCmd *cmd_memory,
+    uint32_t cmd_capacity
+);
+
+// Returns the command list the app may fill for its next frame, which holds cmd_capacity commands.
+UIR_DrawCmd *UIR_render_thread_commands(
+    UIR_RenderThread *rt
+);
+
+// Hands the commands written to UIR_render_thread_commands to the renderer.
+// Does not wait for the renderer, even if it is mid-frame.
+// Returns the id of the published frame.
+uint64_t UIR_render_thread_publish(
+    UIR_RenderThread *rt,
+    uint32_t cmd_count
+);
+
+// Blocks until frame_id, or a newer frame, has been drawn.
+// Returns the id of the last completed frame, and the number of tiles it redrew.
+uint64_t UIR_render_thread_wait(
+    UIR_RenderThread *rt,
+    uint64_t frame_id,
+    uint32_t *redrawn
+);
+
+// Finishes the frame being drawn, if any, and joins the thread.
+void UIR_render_thread_stop(
+    UIR_RenderThread *rt
+);
+
+// ----------------------
+// Batches
+//
+// Draws many independent panels, each with its own UIR and commands, on a pool of worker threads.
+// Every panel is prepared on whichever thread is free, then the changed tiles of all panels are
+// split into jobs of UIR_BATCH_JOB_TILES grid tiles, which free threads take one at a time, so
+// small panels and large ones spread over the threads alike.
+//
+// Images and glyph atlases may be shared by panels, as drawing only reads them. UIR_draw writes
+// to commands, so panels must not share commands, nor a UIR, scratch memory or UIR_Trace.
+
+#define UIR_WORKER_POOL_MAX_THREADS 64
+#define UIR_BATCH_JOB_TILES 32
+
+typedef struct UIR_BatchPanel {
+    UIR *uir;
+    UIR_DrawCmd *cmds;
+    uint32_t cmd_count;
+
+    uint32_t redrawn;   // Written by UIR_draw_batch.
+    uint32_t first_job; // Internal.
+} UIR_BatchPanel;
+
+typedef struct UIR_WorkerPool {
+    // ----------------------
+    // Read Only!
+
+    pthread_t threads[UIR_WORKER_POOL_MAX_THREADS];
+    uint32_t thread_count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+
+    // The phase being run. Set while no worker is busy, then read by the workers.
+    UIR_BatchPanel *panels;
+    uint32_t panel_count;
+    bool drawing;        // drawing tiles, rather than preparing panels
+    uint32_t job_count;
+    uint32_t next_job;   // atomic
+
+    uint64_t phase_id;   // guarded by mutex
+    uint32_t busy;       // guarded by mutex, workers still running the phase
+    bool quit;           // guarded by mutex
+} UIR_WorkerPool;
+
+// Starts thread_count workers, up to UIR_WORKER_POOL_MAX_THREADS. The thread calling
+// UIR_draw_batch works too, so a pool of 0 threads draws everything on it.
+// Returns false if a thread could not be created.
+bool UIR_worker_pool_start(
+    UIR_WorkerPool *pool,
+    uint32_t thread_count
+);
+
+// Joins the workers. No batch may be drawing.
+void UIR_worker_pool_stop(
+    UIR_WorkerPool *pool
+);
+
+// Draws every panel, as UIR_draw would, and blocks until all are done.
+// Call from one thread at a time. Returns the total number of tiles redrawn.
+uint32_t UIR_draw_batch(
+    UIR_WorkerPool *pool,
+    UIR_BatchPanel *panels,
+    uint32_t panel_count
+);
+
+#endif
@@ -0,0 +1,434 @@
+// for posix_madvise
+#define _POSIX_C_SOURCE 200112L
+
+#include "uir_tiled.h"
+
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Levels start on page boundaries, so a level's tiles never share a page with the header or
+// another level.
+#define UIR_TILED_ALIGN 4096
+
+// Downsampled pixels average at most this many source pixels along each axis, spread over the
+// block they cover, so every level costs about as much to write as the full image.
+#define UIR_TILED_SAMPLES 16
+
+#define UIR_TILED_MAX_TILE_SIZE 4096
+
+static const char UIR_TILED_MAGIC[8] = { 'U', 'I', 'R', 'T', 'I', 'L', 'E', 0 };
+
+// A file is the header, then each level's tiles, from the full image down.
+typedef struct UIR_TiledHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t flags;
+    uint32_t tile_size;
+    uint32_t width, height;
+    uint32_t level_count;
+    uint32_t padding;
+    uint64_t level_offsets[UIR_TILED_IMAGE_MAX_LEVELS];
+} UIR_TiledHeader;
+
+static uint32_t UIR_tiled_bytes_per_pixel(
+    uint32_t format
+) {
+    switch (format) {
+        case UIR_IMAGE_FORMAT_RGB: return 3;
+        case UIR_IMAGE_FORMAT_INDEXED: return 1;
+        default: return 4;
+    }
+}
+
+static uint64_t UIR_tiled_align(
+    uint64_t offset
+) {
+    return (offset + UIR_TILED_ALIGN - 1) & ~(uint64_t)(UIR_TILED_ALIGN - 1);
+}
+
+// Fills in the level sizes, and returns the level count, or 0 if there are too many.
+static uint32_t UIR_tiled_levels(
+    UIR_TiledImageLevel levels[UIR_TILED_IMAGE_MAX_LEVELS],
+    uint32_t width,
+    uint32_t height,
+    uint32_t tile_size
+) {
+    for (uint32_t i = 0; i < UIR_TILED_IMAGE_MAX_LEVELS; ++i) {
+        levels[i] = (UIR_TiledImageLevel) {
+            .width = width,
+            .height = height,
+            .tiles_x = (uint32_t)(((uint64_t)width + tile_size - 1) / tile_size),
+            .tiles_y = (uint32_t)(((uint64_t)height + tile_size - 1) / tile_size),
+        };
+        if (width <= tile_size && height <= tile_size)
+            return i + 1;
+        width = (uint32_t)(((uint64_t)width + 1) / 2);
+        height = (uint32_t)(((uint64_t)height + 1) / 2);
+    }
+    return 0;
+}
+
+// ------------------------------
+// Writing
+
+static bool UIR_tiled_write_zeros(
+    FILE *file,
+    uint64_t size
+) {
+    static const uint8_t zeros[1024];
+    while (size) {
+        size_t n = size < sizeof(zeros) ? (size_t)size : sizeof(zeros);
+        if (fwrite(zeros, 1, n, file) != n)
+            return false;
+        size -= n;
+    }
+    return true;
+}
+
+// Averages pixels sampled evenly over [x0, x1) x [y0, y1) into out.
+static void UIR_tiled_average(
+    const uint8_t *pixels,
+    uint32_t stride,
+    uint32_t bpp,
+    uint32_t x0,
+    uint32_t y0,
+    uint32_t x1,
+    uint32_t y1,
+    uint8_t *out
+) {
+    uint32_t w = x1 - x0;
+    uint32_t h = y1 - y0;
+    uint32_t nx = w < UIR_TILED_SAMPLES ? w : UIR_TILED_SAMPLES;
+    uint32_t ny = h < UIR_TILED_SAMPLES ? h : UIR_TILED_SAMPLES;
+
+    uint32_t sums[4] = { 0 };
+    for (uint32_t j = 0; j < ny; ++j) {
+        uint32_t y = y0 + (uint32_t)((uint64_t)j * h / ny);
+        const uint8_t *row = &pixels[(size_t)y * stride];
+        for (uint32_t i = 0; i < nx; ++i) {
+            uint32_t x = x0 + (uint32_t)((uint64_t)i * w / nx);
+            for (uint32_t c = 0; c < bpp; ++c)
+                sums[c] += row[(size_t)x * bpp + c];
+        }
+    }
+
+    uint32_t count = nx * ny;
+    for (uint32_t c = 0; c < bpp; ++c)
+        out[c] = (uint8_t)((sums[c] + count / 2) / count);
+}
+
+// Writes the rows of one tile of level `level`, padded to tile_size square.
+static bool UIR_tiled_write_tile(
+    FILE *file,
+    const uint8_t *pixels,
+    uint32_t width,
+    uint32_t height,
+    uint32_t stride,
+    uint32_t bpp,
+    uint32_t tile_size,
+    const UIR_TiledImageLevel *level,
+    uint32_t level_index,
+    uint32_t tile_x,
+    uint32_t tile_y
+) {
+    uint32_t x0 = tile_x * tile_size;
+    uint32_t y0 = tile_y * tile_size;
+    uint32_t w = level->width - x0 < tile_size ? level->width - x0 : tile_size;
+    uint32_t h = level->height - y0 < tile_size ? level->height - y0 : tile_size;
+
+    for (uint32_t y = 0; y < h; ++y) {
+        if (level_index == 0) {
+            const uint8_t *src = &pixels[(size_t)(y0 + y) * stride + (size_t)x0 * bpp];
+            if (fwrite(src, bpp, w, file) != w)
+                return false;
+        } else {
+            uint8_t chunk[1024];
+            size_t used = 0;
+            uint64_t sy0 = (uint64_t)(y0 + y) << level_index;
+            uint64_t sy1 = (uint64_t)(y0 + y + 1) << level_index;
+            for (uint32_t x = 0; x < w; ++x) {
+                uint64_t sx0 = (uint64_t)(x0 + x) << level_index;
+                uint64_t sx1 = (uint64_t)(x0 + x + 1) << level_index;
+                UIR_tiled_average(
+                    pixels, stride, bpp,
+                    (uint32_t)sx0, (uint32_t)sy0,
+                    (uint32_t)(sx1 < width ? sx1 : width), (uint32_t)(sy1 < height ? sy1 : height),
+                    &chunk[used]
+                );
+                used += bpp;
+                if (used + bpp > sizeof(chunk) || x + 1 == w) {
+                    if (fwrite(chunk, 1, used, file) != used)
+                        return false;
+                    used = 0;
+                }
+            }
+        }
+        if (!UIR_tiled_write_zeros(file, (uint64_t)(tile_size - w) * bpp))
+            return false;
+    }
+    return UIR_tiled_write_zeros(file, (uint64_t)(tile_size - h) * tile_size * bpp);
+}
+
+bool UIR_tiled_image_write(
+    FILE *file,
+    const uint8_t *pixels,
+    uint32_t width,
+    uint32_t height,
+    uint32_t stride,
+    uint32_t format,
+    uint32_t tile_size
+) {
+    if (format >= UIR_IMAGE_FORMAT_INDEXED)
+        return false;
+    if (!width || !height || !tile_size || tile_size > UIR_TILED_MAX_TILE_SIZE)
+        return false;
+
+    UIR_TiledImageLevel levels[UIR_TILED_IMAGE_MAX_LEVELS];
+    uint32_t level_count = UIR_tiled_levels(levels, width, height, tile_size);
+    if (!level_count)
+        return false;
+
+    uint32_t bpp = UIR_tiled_bytes_per_pixel(format);
+    uint64_t tile_bytes = (uint64_t)tile_size * tile_size * bpp;
+
+    UIR_TiledHeader header = {
+        .version = UIR_TILED_IMAGE_VERSION,
+        .format = format,
+        .tile_size = tile_size,
+        .width = width,
+        .height = height,
+        .level_count = level_count,
+    };
+    memcpy(header.magic, UIR_TILED_MAGIC, sizeof(header.magic));
+
+    // opaque if every alpha is 255, so tiles can be copied instead of blended
+    bool opaque = true;
+    if (format != UIR_IMAGE_FORMAT_RGB) {
+        for (uint32_t y = 0; y < height && opaque; ++y) {
+            const uint8_t *row = &pixels[(size_t)y * stride];
+            uint8_t all = 255;
+            for (uint32_t x = 0; x < width; ++x)
+                all &= row[(size_t)x * 4 + 3];
+            opaque = all == 255;
+        }
+    }
+    header.flags = opaque ? UIR_IMAGE_OPAQUE : 0;
+
+    uint64_t offset = UIR_tiled_align(sizeof(header));
+    for (uint32_t i = 0; i < level_count; ++i) {
+        header.level_offsets[i] = offset;
+        offset = UIR_tiled_align(offset + (uint64_t)levels[i].tiles_x * levels[i].tiles_y * tile_bytes);
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+        return false;
+    uint64_t written = sizeof(header);
+
+    for (uint32_t i = 0; i < level_count; ++i) {
+        if (!UIR_tiled_write_zeros(file, header.level_offsets[i] - written))
+            return false;
+        written = header.level_offsets[i];
+
+        for (uint32_t ty = 0; ty < levels[i].tiles_y; ++ty) {
+            for (uint32_t tx = 0; tx < levels[i].tiles_x; ++tx) {
+                if (!UIR_tiled_write_tile(file, pixels, width, height, stride, bpp, tile_size, &levels[i], i, tx, ty))
+                    return false;
+                written += tile_bytes;
+            }
+        }
+    }
+    // pad the last level, so every level maps whole pages
+    return UIR_tiled_write_zeros(file, offset - written);
+}
+
+// ------------------------------
+// Reading
+
+bool UIR_tiled_image_open(
+    UIR_TiledImage *image,
+    const unsigned char *data,
+    size_t size
+) {
+    UIR_TiledHeader header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, UIR_TILED_MAGIC, sizeof(header.magic)) != 0)
+        return false;
+    if (header.version != UIR_TILED_IMAGE_VERSION)
+        return false;
+    if (header.format >= UIR_IMAGE_FORMAT_INDEXED)
+        return false;
+    if (!header.width || !header.height || !header.tile_size || header.tile_size > UIR_TILED_MAX_TILE_SIZE)
+        return false;
+
+    *image = (UIR_TiledImage) {
+        .data = data,
+        .size = size,
+        .format = header.format,
+        .flags = header.flags,
+        .tile_size = header.tile_size,
+        .tile_bytes = (size_t)header.tile_size * header.tile_size * UIR_tiled_bytes_per_pixel(header.format),
+    };
+    image->level_count = UIR_tiled_levels(image->levels, header.width, header.height, header.tile_size);
+    if (!image->level_count || image->level_count != header.level_count)
+        return false;
+
+    for (uint32_t i = 0; i < image->level_count; ++i) {
+        UIR_TiledImageLevel *level = &image->levels[i];
+        uint64_t offset = header.level_offsets[i];
+        uint64_t level_bytes = (uint64_t)level->tiles_x * level->tiles_y * image->tile_bytes;
+        if (offset < sizeof(header) || offset > size || level_bytes > size - offset)
+            return false;
+        level->tiles = &data[offset];
+    }
+    return true;
+}
+
+uint32_t UIR_tiled_image_level(
+    const UIR_TiledImage *image,
+    UIR_Rect rect
+) {
+    float w = rect.x1 - rect.x0;
+    float h = rect.y1 - rect.y0;
+    uint32_t level = 0;
+    while (level + 1 < image->level_count
+        && (float)image->levels[level + 1].width >= w
+        && (float)image->levels[level + 1].height >= h)
+        level++;
+    return level;
+}
+
+// The tiles of a level drawn at rect that overlap view.
+typedef struct UIR_TiledRange {
+    const UIR_TiledImageLevel *level;
+    float scale; // panel px per level px
+    uint32_t x0, y0, x1, y1;
+} UIR_TiledRange;
+
+static uint32_t UIR_tiled_range_axis(
+    float offset,
+    float tile_extent,
+    uint32_t tile_count,
+    bool round_up
+) {
+    float t = offset / tile_extent;
+    t = round_up ? ceilf(t) : floorf(t);
+    if (!(t > 0.f))
+        return 0;
+    return t < (float)tile_count ? (uint32_t)t : tile_count;
+}
+
+static bool UIR_tiled_range(
+    UIR_TiledRange *range,
+    const UIR_TiledImage *image,
+    UIR_Rect rect,
+    UIR_Rect view
+) {
+    if (!(rect.x1 > rect.x0 && rect.y1 > rect.y0 && view.x1 > view.x0 && view.y1 > view.y0))
+        return false;
+
+    const UIR_TiledImageLevel *level = &image->levels[UIR_tiled_image_level(image, rect)];
+    range->level = level;
+    // image commands have one scale, so the image keeps its aspect ratio, fitting inside rect
+    float scale_x = (rect.x1 - rect.x0) / (float)level->width;
+    float scale_y = (rect.y1 - rect.y0) / (float)level->height;
+    range->scale = scale_x < scale_y ? scale_x : scale_y;
+
+    float tile_extent = range->scale * (float)image->tile_size;
+    range->x0 = UIR_tiled_range_axis(view.x0 - rect.x0, tile_extent, level->tiles_x, false);
+    range->y0 = UIR_tiled_range_axis(view.y0 - rect.y0, tile_extent, level->tiles_y, false);
+    range->x1 = UIR_tiled_range_axis(view.x1 - rect.x0, tile_extent, level->tiles_x, true);
+    range->y1 = UIR_tiled_range_axis(view.y1 - rect.y0, tile_extent, level->tiles_y, true);
+    return range->x0 < range->x1 && range->y0 < range->y1;
+}
+
+// Level px boundaries rounded to whole panel px, so tiles that share an edge share its rounding.
+static float UIR_tiled_edge(
+    float origin,
+    float scale,
+    uint32_t px
+) {
+    return floorf(origin + (float)px * scale + 0.5f);
+}
+
+uint32_t UIR_tiled_image_cmds(
+    const UIR_TiledImage *image,
+    UIR_Rect rect,
+    UIR_Rect view,
+    UIR_DrawCmd *cmds,
+    uint32_t cmd_capacity
+) {
+    UIR_TiledRange range;
+    if (!UIR_tiled_range(&range, image, rect, view))
+        return 0;
+
+    const UIR_TiledImageLevel *level = range.level;
+    uint32_t tile_size = image->tile_size;
+    uint32_t bpp = UIR_tiled_bytes_per_pixel(image->format);
+    uint32_t count = 0;
+
+    for (uint32_t ty = range.y0; ty < range.y1; ++ty) {
+        uint32_t py0 = ty * tile_size;
+        uint32_t py1 = level->height - py0 < tile_size ? level->height : py0 + tile_size;
+        float y0 = UIR_tiled_edge(rect.y0, range.scale, py0);
+        float y1 = UIR_tiled_edge(rect.y0, range.scale, py1);
+        if (!(y1 > y0 && y1 > view.y0 && y0 < view.y1))
+            continue;
+
+        for (uint32_t tx = range.x0; tx < range.x1; ++tx) {
+            uint32_t px0 = tx * tile_size;
+            uint32_t px1 = level->width - px0 < tile_size ? level->width : px0 + tile_size;
+            float x0 = UIR_tiled_edge(rect.x0, range.scale, px0);
+            float x1 = UIR_tiled_edge(rect.x0, range.scale, px1);
+            if (!(x1 > x0 && x1 > view.x0 && x0 < view.x1))
+                continue;
+
+            if (count < cmd_capacity) {
+                // rounding the edges leaves the two scales under a px apart, and the larger
+                // never samples past the tile's pixels
+                float scale_x = (x1 - x0) / (float)(px1 - px0);
+                float scale_y = (y1 - y0) / (float)(py1 - py0);
+                const uint8_t *tile = &level->tiles[((size_t)ty * level->tiles_x + tx) * image->tile_bytes];
+
+                cmds[count] = (UIR_DrawCmd) { .image = {
+                    .type = UIR_DRAW_IMAGE_RGBA,
+                    .rect = { x0, y0, x1, y1 },
+                    .data = (uint8_t*)(uintptr_t)tile,
+                    .data_stride = tile_size * bpp,
+                    .scale = scale_x > scale_y ? scale_x : scale_y,
+                    .flags = image->flags,
+                    .format = image->format,
+                }};
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+void UIR_tiled_image_prefetch(
+    const UIR_TiledImage *image,
+    UIR_Rect rect,
+    UIR_Rect view
+) {
+    UIR_TiledRange range;
+    if (!UIR_tiled_range(&range, image, rect, view))
+        return;
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t page_mask = page_size > 0 ? (uintptr_t)page_size - 1 : UIR_TILED_ALIGN - 1;
+
+    // a row of tiles is contiguous, so each is one request
+    const UIR_TiledImageLevel *level = range.level;
+    for (uint32_t ty = range.y0; ty < range.y1; ++ty) {
+        uintptr_t start = (uintptr_t)&level->tiles[((size_t)ty * level->tiles_x + range.x0) * image->tile_bytes];
+        uintptr_t end = start + (range.x1 - range.x0) * image->tile_bytes;
+        start &= ~page_mask;
+        posix_madvise((void*)start, end - start, POSIX_MADV_WILLNEED);
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef UIR_TILED_H
+#define UIR_TILED_H
+
+#include "uir.h"
+
+#include <stdio.h>
+
+// ----------------------
+// Tiled images
+//
+// Images larger than memory, such as maps and slide scans, stored in a file as a pyramid of
+// levels, each half the size of the one before, down to a single tile. Each level is a grid of
+// square tiles, and each tile's pixels are contiguous, so drawing part of the image only reads
+// the tiles it shows.
+//
+// The file is meant to be mapped: UIR_tiled_image_cmds makes an image command per visible tile
+// of the level closest to the size drawn, pointing straight into the mapping, so only the pages
+// the rasterizer samples are read from disk. Commands hash tiles by address, so panning only
+// redraws the panel tiles whose image tiles moved or appeared.
+//
+// The image keeps its aspect ratio: it is drawn at the largest size that fits in rect, from rect's
+// top left corner. Each image tile is drawn at a whole pixel rect, and scaled to fit it, so
+// neighbouring tiles meet without gaps, and may sample up to a pixel away from a single image
+// drawn at the same size.
+
+#define UIR_TILED_IMAGE_VERSION 1
+#define UIR_TILED_IMAGE_MAX_LEVELS 24
+
+typedef struct UIR_TiledImageLevel {
+    uint32_t width, height;   // px
+    uint32_t tiles_x, tiles_y;
+    const uint8_t *tiles;     // the level's first tile, then the rest row by row
+} UIR_TiledImageLevel;
+
+typedef struct UIR_TiledImage {
+    // ----------------------
+    // Read Only!
+
+    const unsigned char *data;
+    size_t size;
+
+    uint32_t format;      // UIR_ImageFormat, not indexed
+    uint32_t flags;       // UIR_IMAGE_*
+    uint32_t tile_size;   // px
+    size_t tile_bytes;    // tile_size rows of tile_size px, edge tiles padded
+    uint32_t level_count;
+    UIR_TiledImageLevel levels[UIR_TILED_IMAGE_MAX_LEVELS];
+} UIR_TiledImage;
+
+// Writes pixels as a tiled image file, downsampling each level from pixels with a box filter.
+// Reads pixels once per level, so they may themselves be a mapped file.
+// Returns false if the format is indexed, a size is 0, or a write failed.
+bool UIR_tiled_image_write(
+    FILE *file,
+    const uint8_t *pixels,
+    uint32_t width,
+    uint32_t height,
+    uint32_t stride,
+    uint32_t format,
+    uint32_t tile_size
+);
+
+// data is the whole file, and must stay valid while commands made from it are drawn.
+// Returns false if it isn't a tiled image from this version, or is cut short.
+bool UIR_tiled_image_open(
+    UIR_TiledImage *image,
+    const unsigned char *data,
+    size_t size
+);
+
+// Returns the level UIR_tiled_image_cmds draws the image with at rect: the smallest that isn't
+// smaller than rect, or the full image.
+uint32_t UIR_tiled_image_level(
+    const UIR_TiledImage *image,
+    UIR_Rect rect
+);
+
+// Writes an image command for each tile of the image drawn at rect that is inside view, such as
+// the visible part of the panel, up to cmd_capacity. Returns the number of tiles inside view.
+uint32_t UIR_tiled_image_cmds(
+    const UIR_TiledImage *image,
+    UIR_Rect rect,
+    UIR_Rect view,
+    UIR_DrawCmd *cmds,
+    uint32_t cmd_capacity
+);
+
+// Asks the OS to start reading the tiles UIR_tiled_image_cmds would make for view, such as where
+// a scroll or zoom is heading, so they are resident before they are drawn.
+void UIR_tiled_image_prefetch(
+    const UIR_TiledImage *image,
+    UIR_Rect rect,
+    UIR_Rect view
+);
+
+#endif
@@ -0,0 +1,103 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "uir_trace.h"
+
+#include <time.h>
+#include <inttypes.h>
+
+// Chrome trace threads, used as tracks.
+#define UIR_TRACE_TRACK_PHASES 1
+#define UIR_TRACE_TRACK_TILES 2
+
+static uint64_t UIR_trace_file_now(void *user_data) {
+    (void)user_data;
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+// Chrome traces count in microseconds, relative to the first event.
+static double UIR_trace_file_us(
+    UIR_TraceFile *trace_file,
+    uint64_t ns
+) {
+    return (double)(ns - trace_file->origin) / 1000.0;
+}
+
+static void UIR_trace_file_separator(UIR_TraceFile *trace_file) {
+    fputs(trace_file->event_count++ ? ",\n" : "\n", trace_file->file);
+}
+
+static void UIR_trace_file_span(
+    void *user_data,
+    const UIR_TraceSpan *span
+) {
+    UIR_TraceFile *trace_file = user_data;
+    bool is_tile = span->tile_x >= 0;
+
+    UIR_trace_file_separator(trace_file);
+    fprintf(
+        trace_file->file,
+        "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+        span->name,
+        is_tile ? UIR_TRACE_TRACK_TILES : UIR_TRACE_TRACK_PHASES,
+        UIR_trace_file_us(trace_file, span->start),
+        (double)span->duration / 1000.0
+    );
+    if (is_tile)
+        fprintf(trace_file->file, "\"tile_x\":%d,\"tile_y\":%d,\"cmds\":%u}}", span->tile_x, span->tile_y, span->count);
+    else
+        fprintf(trace_file->file, "\"count\":%u}}", span->count);
+}
+
+void UIR_trace_file_begin(
+    UIR_TraceFile *trace_file,
+    FILE *file,
+    uint32_t tile_sample_rate
+) {
+    *trace_file = (UIR_TraceFile) {
+        .trace = {
+            .now = UIR_trace_file_now,
+            .span = UIR_trace_file_span,
+            .user_data = trace_file,
+            .tile_sample_rate = tile_sample_rate,
+        },
+        .file = file,
+        .origin = UIR_trace_file_now(NULL),
+    };
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+
+    // name the tracks
+    const char *track_names[] = { "UIR_draw", "tiles" };
+    int tracks[] = { UIR_TRACE_TRACK_PHASES, UIR_TRACE_TRACK_TILES };
+    for (uint32_t i = 0; i < 2; ++i) {
+        UIR_trace_file_separator(trace_file);
+        fprintf(
+            file,
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            tracks[i], track_names[i]
+        );
+    }
+}
+
+void UIR_trace_file_frame(
+    UIR_TraceFile *trace_file,
+    uint64_t frame_id
+) {
+    UIR_trace_file_separator(trace_file);
+    fprintf(
+        trace_file->file,
+        "{\"name\":\"frame %" PRIu64 "\",\"ph\":\"i\",\"s\":\"p\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+        frame_id,
+        UIR_TRACE_TRACK_PHASES,
+        UIR_trace_file_us(trace_file, UIR_trace_file_now(NULL))
+    );
+}
+
+void UIR_trace_file_end(
+    UIR_TraceFile *trace_file
+) {
+    fputs("\n]}\n", trace_file->file);
+    fflush(trace_file->file);
+}
@@ -0,0 +1,41 @@
+#ifndef UIR_TRACE_H
+#define UIR_TRACE_H
+
+#include "uir.h"
+
+#include <stdio.h>
+
+// ----------------------
+// Chrome trace writer
+//
+// Writes UIR_draw's spans as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open.
+// Phases appear on one track, and sampled tiles on another, labelled with their grid position.
+
+typedef struct UIR_TraceFile {
+    // Point uir->trace here.
+    UIR_Trace trace;
+
+    FILE *file;
+    uint64_t origin;
+    uint32_t event_count;
+} UIR_TraceFile;
+
+// Starts the JSON. Traces 1 in tile_sample_rate drawn tiles, or none if 0.
+void UIR_trace_file_begin(
+    UIR_TraceFile *trace_file,
+    FILE *file,
+    uint32_t tile_sample_rate
+);
+
+// Marks the start of an app frame, so frames are easy to find.
+void UIR_trace_file_frame(
+    UIR_TraceFile *trace_file,
+    uint64_t frame_id
+);
+
+// Finishes the JSON. Does not close the file.
+void UIR_trace_file_end(
+    UIR_TraceFile *trace_file
+);
+
+#endif